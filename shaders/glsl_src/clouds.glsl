@@ -0,0 +1,290 @@
+// Cloud layer raymarching shared by cloud passes, expects ubo.glsl, lighting.glsl, noise.glsl and sky.glsl
+#define CLOUD_MAX_STEPS 128
+// fine steps without density before the march falls back to coarse steps
+#define CLOUD_COARSE_AFTER 6
+// march stops once the layer behind is hidden
+#define CLOUD_OPAQUE 0.01
+
+const float CloudShapeScale = 45.0;
+// base step of the view march, also used to bake light attenuation
+#define CloudBaseStep ((Rct - Rcb) / 48.0)
+
+vec3 sphereStart;
+vec3 sphereEnd;
+float sphereRSq;
+// view distance of the first dense sample of the last trace, zero when the ray met no cloud
+float cloudDistance;
+
+// used for shadow sampling
+vec3 light_kernel[] =
+{
+    vec3(0.5, 0.5, 0.5),
+    vec3(-0.628, 0.64, 0.234),
+    vec3(0.23, -0.123, 0.75),
+    vec3(0.98, 0.45, -0.32),
+    vec3(-0.1, -0.54, 0.945),
+    vec3(0.0, 0.6, -0.78),
+};
+
+layout(set = 1, binding = 1) uniform CloudLayer
+{
+    float Coverage;
+    float VerticalSpan;
+    float Absorption;
+    float WindSpeed;
+} Clouds;
+
+layout(set = 1, binding = 2) uniform sampler3D CloudLowFrequency;
+layout(set = 1, binding = 3) uniform sampler3D CloudHighFrequency;
+layout(set = 1, binding = 4) uniform sampler2D TransmittanceLUT;
+layout(set = 1, binding = 5) uniform sampler2D IrradianceLUT;
+layout(set = 1, binding = 7) uniform sampler3D CloudBounds;
+layout(set = 1, binding = 8) uniform sampler3D CloudLighting;
+
+float GetHeightFraction(vec3 p)
+{
+    return 1.0 - saturate(dot(p, p) / sphereRSq);
+}
+
+vec3 GetUV(vec3 p, float scale, float speed_mod)
+{
+    return scale * p / Rg + vec2(ubo.Time * Clouds.WindSpeed * speed_mod, 0.0).xyx;
+}
+
+float SampleCloudShape(vec3 x0, int lod)
+{
+    float height = GetHeightFraction(x0);
+    vec3 uv =  GetUV(x0, CloudShapeScale, 0.01);
+
+    vec4 low_frequency_noise = textureLod(CloudLowFrequency, uv, lod);
+    float base = low_frequency_noise.r;
+    base = remap(base, 1.0 - Clouds.Coverage, 1.0, 0.0, 1.0);
+
+    base *= saturate(remap(height, mix(0.8, 0.25, Clouds.VerticalSpan), mix(0.95, 0.4, Clouds.VerticalSpan), 0.0, 1.0));
+    base *= Clouds.Coverage;
+
+    return base;
+}
+
+// GPU-Pro-7
+float SampleDensity(vec3 x0, int lod)
+{
+    float height = GetHeightFraction(x0);
+    vec3 uv =  GetUV(x0, 750.0, 0.3);
+
+    float base = SampleCloudShape(x0, lod);
+
+    //return base;
+
+    vec4 high_frequency_noise = textureLod(CloudHighFrequency, uv, 0.0);
+    float high_frequency_fbm = high_frequency_noise.r * 0.625 + high_frequency_noise.g * 0.25 + high_frequency_noise.b * 0.125;
+    float high_frequency_modifier = mix(high_frequency_fbm, 1.0 - high_frequency_fbm, saturate(height * 45.0));
+
+    return remap(base, high_frequency_modifier * 0.1, 1.0, 0.0, 1.0) * height;
+}
+
+// volumetric-cloudscapes-of-horizon-zero-dawn
+float MarchToLight(vec3 rs, vec3 rd, float stepsize)
+{
+    vec3 pos = rs;
+    float density = 0.0;
+    float radius = 1.0;
+    float transmittance = 1.0;
+
+    stepsize *= 6.f;
+    for (int i = 0; i <= 6; i++)
+    {
+        pos = rs + float(i) * radius * light_kernel[i];
+
+        float sampled_density = SampleDensity(pos, 2);
+
+        if (sampled_density > 0.0)
+        {
+            float transmittance_light = BeerLambert(stepsize * sampled_density * Clouds.Absorption);
+            transmittance *= transmittance_light;
+        }
+        
+        density += sampled_density;
+        rs += stepsize * rd;
+        radius += 1.f / 6.f;
+    }
+
+    return transmittance;
+}
+
+// Lighting volume spans the cloud shell up to the horizon around an origin under the camera,
+// horizontal axes are square root mapped so resolution is highest near the viewer
+#define CloudLightingExtent sqrt(Rct * Rct - Rg * Rg)
+
+vec3 CloudLightingUV(vec3 p, vec2 origin)
+{
+    vec2 d = clamp((p.xz - origin) / CloudLightingExtent, -1.0, 1.0);
+    vec2 xz = 0.5 + 0.5 * sign(d) * sqrt(abs(d));
+    float h = (distance(p, vec3(0.0, -Rg, 0.0)) - Rcb) / (Rct - Rcb);
+    return vec3(xz.x, saturate(h), xz.y);
+}
+
+vec3 CloudLightingPosition(vec3 uv, vec2 origin)
+{
+    vec2 s = 2.0 * uv.xz - 1.0;
+    vec2 xz = origin + sign(s) * s * s * CloudLightingExtent;
+    float r = mix(Rcb, Rct, uv.y);
+    return vec3(xz.x, sqrt(max(r * r - dot(xz, xz), 0.0)) - Rg, xz.y);
+}
+
+// Transmittance of the cloud layer above the sample, approximates occlusion of the sky
+float MarchToSky(vec3 rs)
+{
+    vec3 up = normalize(vec3(0.0, Rg, 0.0) + rs);
+    float stepsize = max(Rct - distance(rs, vec3(0.0, -Rg, 0.0)), 0.0) / 4.0;
+    float depth = 0.0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        depth += max(SampleDensity(rs + (float(i) + 0.5) * stepsize * up, 2), 0.0);
+    }
+
+    return BeerLambert(depth * stepsize * Clouds.Absorption);
+}
+
+// Sky light reaching a cloud sample, scaled by visibility of the sky baked into the lighting volume
+vec3 CloudAmbient(vec3 p, vec3 rl, float visibility)
+{
+    vec3 x = vec3(0.0, Rg, 0.0) + p;
+    float r = length(x);
+    return GetIrradiance(IrradianceLUT, r, dot(x, rl) / r) * MaxLightIntensity * ONE_OVER_4PI * visibility;
+}
+
+// Whole bounds cell is empty when even its densest shape texel is cut by coverage
+bool IsCellEmpty(vec3 uv)
+{
+    ivec3 size = textureSize(CloudBounds, 0);
+    ivec3 cell = min(ivec3(fract(uv) * vec3(size)), size - 1);
+    return texelFetch(CloudBounds, cell, 0).r <= 1.0 - Clouds.Coverage;
+}
+
+// Ray distance to the far face of the bounds cell, duv is the uv change per unit of distance
+float CellExitDistance(vec3 uv, vec3 duv)
+{
+    vec3 size = vec3(textureSize(CloudBounds, 0));
+    vec3 p = uv * size;
+    vec3 d = duv * size;
+    vec3 face = floor(p) + step(0.0, d);
+    vec3 t = mix(vec3(1e30), (face - p) / d, greaterThan(abs(d), vec3(1e-12)));
+    return min(t.x, min(t.y, t.z));
+}
+
+// I doubt it's physically correct but looks nice
+// Empty cells are skipped through CloudBounds, clear air inside a cell is crossed with coarse
+// shape only steps and full density is sampled only around clouds
+// Sun and sky light of samples come from CloudLighting baked around origin
+vec4 MarchToCloud(vec3 rs, vec3 re, vec3 rd, vec2 screen, float jitter, vec2 origin)
+{
+    const float len = distance(rs, re);
+    // need more precision near horizon, long grazing rays are capped by step count
+    const float stepsize = max(CloudBaseStep, len / float(CLOUD_MAX_STEPS));
+    const vec3 duv = CloudShapeScale * rd / Rg;
+
+    vec4 scattering = vec4(0.0, 0.0, 0.0, 1.0);
+    vec3 rl = normalize(ubo.SunDirection.xyz);
+    float phase = HGDPhase(dot(rl, rd), 0.75, -0.15, 0.5, MieG);
+    //float phase = DualLobeFunction(dot(rl, rd), MieG, -0.25, 0.65);
+
+    // jitter trades banding for noise that is cleaned up by temporal reprojection
+    float t = jitter * stepsize;
+    int misses = CLOUD_COARSE_AFTER;
+    vec3 entry = re;
+
+    for (int i = 0; i < CLOUD_MAX_STEPS && t < len; ++i)
+    {
+        vec3 pos = rs + t * rd;
+        vec3 uv = GetUV(pos, CloudShapeScale, 0.01);
+
+        if (IsCellEmpty(uv))
+        {
+            t += CellExitDistance(uv, duv) + jitter * stepsize;
+            misses = CLOUD_COARSE_AFTER;
+            continue;
+        }
+
+        if (misses >= CLOUD_COARSE_AFTER)
+        {
+            if (SampleCloudShape(pos, 0) <= 0.0)
+            {
+                t += 2.0 * stepsize;
+                continue;
+            }
+
+            // cloud edge is somewhere within the last coarse step
+            t = max(t - stepsize, 0.0);
+            misses = 0;
+            continue;
+        }
+
+        float sample_density = SampleDensity(pos, 0);
+
+        if (sample_density <= 0.0)
+        {
+            misses++;
+            t += stepsize;
+            continue;
+        }
+
+        misses = 0;
+        entry = scattering.a == 1.0 ? pos : entry;
+
+        // thin cloud contributes little, so it is integrated over longer steps
+        float dt = stepsize * mix(2.0, 1.0, saturate(sample_density * 8.0));
+        float extinction = sample_density * Clouds.Absorption;
+        float transmittance = BeerLambert(dt * extinction);
+
+        vec4 light = textureLod(CloudLighting, CloudLightingUV(pos, origin), 0.0);
+        float Vis = Powder(dt, sample_density, Clouds.Absorption);
+
+        vec3 E = sample_density * (light.rgb * phase * Vis + CloudAmbient(pos, rl, light.a));
+        vec3 inScat = (E - E * transmittance) / sample_density;
+
+        scattering.rgb += inScat * scattering.a;
+        scattering.a *= transmittance;
+
+        if (scattering.a < CLOUD_OPAQUE)
+            break;
+
+        t += dt;
+    }
+
+    cloudDistance = scattering.a != 1.0 ? distance(ubo.CameraPosition.xyz, entry) : 0.0;
+
+    if (scattering.a != 1.0)
+    {
+        vec3 eye = vec3(0.0, Rg, 0.0) + ubo.CameraPosition.xyz;
+        float r = length(eye);
+        vec3 L = GetTransmittanceWithShadow(TransmittanceLUT, r, dot(eye, rl) / r) * MaxLightIntensity;
+        vec3 S = AerialPerspective(screen, distance(ubo.CameraPosition.xyz, entry)).rgb;
+        // aerial perspective
+        scattering.rgb += (S + phase * L * scattering.a) * (1.0 - scattering.a);
+    }
+
+    return scattering;
+}
+
+// Scattering and transmittance of the cloud layer along the view ray, rgb is premultiplied
+// jitter in [0, 1) offsets the first sample by a fraction of a step
+vec4 TraceClouds(vec3 RayDirection, vec2 ScreenUV, float jitter, vec2 origin)
+{
+    cloudDistance = 0.0;
+
+    if (dot(RayDirection, vec3(0.0, 1.0, 0.0)) < 0.0) 
+        return vec4(0.0, 0.0, 0.0, 1.0);
+
+    vec3 RayOrigin = ubo.CameraPosition.xyz;
+    vec3 SphereCenter = vec3(0.0, -Rg, 0.0);
+    if (RaySphereintersection(RayOrigin, RayDirection, SphereCenter, Rcb, sphereStart)
+    && RaySphereintersection(RayOrigin, RayDirection, SphereCenter, Rct, sphereEnd)) 
+    {
+        sphereRSq = dot(sphereEnd, sphereEnd);
+        return MarchToCloud(sphereStart, sphereEnd, RayDirection, ScreenUV, jitter, origin);
+    }
+
+    return vec4(0.0, 0.0, 0.0, 1.0);
+}
\ No newline at end of file
@@ -7,31 +7,50 @@
 #define INSCATTERING_SPHERE_SAMPLES 8
 #define IRRADIANCE_SAMPLES 32
 
+struct AtmosphereProfile
+{
+    vec3 RayleighScattering;
+    float BottomRadius;
+    vec3 MieScattering;
+    float TopRadius;
+    vec3 MieExtinction;
+    float RayleighScaleHeight;
+    float MieScaleHeight;
+    float MieAnisotropy;
+    float CloudBottomHeight;
+    float CloudTopHeight;
+};
+
+// Lengths are stored in kilometers, LUTs are computed in kilometers and rendering works in meters
 #ifdef LUT_MEASURES
-const float Rg = 6360.0;
-const float Rt = 6420.0;
+layout(set = 1, binding = 0) uniform AtmosphereBuffer
+{
+    AtmosphereProfile Atmosphere;
+};
+const float LengthUnit = 1.0;
 #else
-const float Rg = 6360.0 * 1e3;
-const float Rt = 6420.0 * 1e3;
+layout(set = 0, binding = 1) uniform AtmosphereBuffer
+{
+    AtmosphereProfile Atmosphere;
+};
+const float LengthUnit = 1e3;
 #endif
 
-const float Rcb = 6370.0 * 1e3;
-const float Rct = 6385.0 * 1e3;
+#define Rg (Atmosphere.BottomRadius * LengthUnit)
+#define Rt (Atmosphere.TopRadius * LengthUnit)
 
-const float HR = 8.0;
-const vec3 BetaR = vec3(5.8e-3, 1.35e-2, 3.31e-2);
+// Cloud layer shell, heights are relative to the ground so the layer follows runtime planet changes
+#define Rcb ((Atmosphere.BottomRadius + Atmosphere.CloudBottomHeight) * LengthUnit)
+#define Rct ((Atmosphere.BottomRadius + Atmosphere.CloudTopHeight) * LengthUnit)
 
-// clear sky
-//const float HM = 1.2;
-//const vec3 BetaMSca = vec3(4e-3);
-//const vec3 BetaMEx = BetaMSca / 0.9;
+#define HR Atmosphere.RayleighScaleHeight
+#define BetaR Atmosphere.RayleighScattering
 
-// partly cloudy
-const float HM = 3.0;
-const vec3 BetaMSca = vec3(3e-3);
-const vec3 BetaMEx = BetaMSca / 0.9;
+#define HM Atmosphere.MieScaleHeight
+#define BetaMSca Atmosphere.MieScattering
+#define BetaMEx Atmosphere.MieExtinction
 
-const float MieG = 0.65;
+#define MieG Atmosphere.MieAnisotropy
 
 const float MaxLightIntensity = 25.0;
 const int DIM_MU = 128;
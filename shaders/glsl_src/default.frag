@@ -2,6 +2,8 @@
 #include "ubo.glsl"
 #include "lighting.glsl"
 #include "brdf.glsl"
+#include "sky.glsl"
+#include "environment.glsl"
 
 struct SMaterial
 {
@@ -24,25 +26,12 @@ layout(location = 0) in vec2 inUV;
 layout(location = 1) in vec4 WorldPosition;
 layout(location = 2) in mat3 TBN;
 
-layout(set = 1, binding = 1) uniform sampler2D TransmittanceLUT;
-layout(set = 1, binding = 2) uniform sampler2D IrradianceLUT;
-layout(set = 1, binding = 3) uniform sampler3D InscatteringLUT;
 layout(set = 1, binding = 4) uniform sampler2D AlbedoMap;
 layout(set = 1, binding = 5) uniform sampler2D NormalHeightMap;
 layout(set = 1, binding = 6) uniform sampler2D ARMMap;
 
 layout(location = 0) out vec4 outColor;
 
-// very simplified version which skips aerial perspective and scattering
-vec3 PointRadiance(vec3 Sun, vec3 Eye, vec3 Point)
-{
-    vec3 View = normalize(Point - Eye);
-    const float Rp = length(Point);
-    const float DotPL = dot(Point, Sun) / Rp;
-
-    return GetTransmittanceWithShadow(TransmittanceLUT, Rp, DotPL) * MaxLightIntensity;
-}
-
 // course-notes-moving-frostbite-to-pbr-v2
 vec3 GetDiffuseTerm(vec3 Albedo, float NdotL, float NdotV, float LdotH, float Roughness)
 {
@@ -57,8 +46,8 @@ vec3 GetDiffuseTerm(vec3 Albedo, float NdotL, float NdotV, float LdotH, float Ro
     return Albedo * vec3(LightScatter * ViewScatter * EnergyFactor);
 }
 
-// get specular and ambient part from sunlight
-vec3 DirectSunlight(vec3 Eye, vec3 Point, vec3 V, vec3 L, vec3 N, in SMaterial Material)
+// get specular and diffuse part from sunlight, radiance at the camera is baked with the environment
+vec3 DirectSunlight(vec3 V, vec3 L, vec3 N, in SMaterial Material)
 {
     vec3 H = normalize(V + L);
 
@@ -77,10 +66,27 @@ vec3 DirectSunlight(vec3 Eye, vec3 Point, vec3 V, vec3 L, vec3 N, in SMaterial M
     vec3 specular = vec3(max((D * G * F) / (4.0 * NdotV * NdotL), 0.001));
     vec3 diffuse = kD * GetDiffuseTerm(Material.Albedo.rgb, NdotL, NdotV, LdotH, Material.Roughness);
     //vec3 diffuse = kD * Material.Albedo.rgb;
-    vec3 ambient = Material.AO * vec3(0.01) * Material.Albedo.rgb;
-    vec3 radiance = PointRadiance(L, Eye, Point);
+    vec3 radiance = Environment.SunRadiance.rgb;
+
+    return ((specular + diffuse) / PI * NdotL) * radiance * NdotV;
+}
+
+// sky light from the baked irradiance harmonics and the split sum prefiltered cube
+vec3 AmbientLight(vec3 V, vec3 N, in SMaterial Material)
+{
+    float NdotV = saturate(dot(N, V));
+
+    vec3 F0 = mix(vec3(0.04), Material.Albedo.rgb, Material.Metallic);
+    vec3 F = FresnelSchlick(NdotV, F0);
+    vec3 kD = (1.0 - F) * (1.0 - Material.Metallic);
+    vec3 diffuse = kD * Material.Albedo.rgb * SkyIrradiance(N) / PI;
 
-    return ambient * radiance + ((specular + diffuse) / PI * NdotL) * radiance * NdotV;
+    float lod = Material.Roughness * float(textureQueryLevels(SpecularCube) - 1);
+    vec3 prefiltered = textureLod(SpecularCube, reflect(-V, N), lod).rgb;
+    vec2 brdf = textureLod(BrdfLUT, vec2(NdotV, Material.Roughness), 0.0).rg;
+    vec3 specular = prefiltered * (F0 * brdf.x + brdf.y);
+
+    return (diffuse + specular) * Material.AO;
 }
 
 vec2 Displace(vec2 inUV, vec3 V)
@@ -111,10 +117,6 @@ vec2 Displace(vec2 inUV, vec3 V)
 
 void main()
 {
-    // these are used to sample atmosphere, so we offset them to ground level
-    vec3 Point = WorldPosition.xyz + vec3(0.0, Rg, 0.0);
-    vec3 Eye = ubo.CameraPosition.xyz + vec3(0.0, Rg, 0.0);
-    
     // getting default lighting vectors
     vec3 V = normalize(ubo.CameraPosition.xyz - WorldPosition.xyz);
     vec3 L = normalize(ubo.SunDirection.xyz);
@@ -140,6 +142,9 @@ void main()
         discard;
 
     // getting the color
-    vec3 Lo = DirectSunlight(Eye, Point, V, L, N, Material);
-    outColor = vec4(Lo, PushConstants.ColorMask.a * Material.Albedo.a);
+    vec3 Lo = DirectSunlight(V, L, N, Material) + AmbientLight(V, N, Material);
+
+    // aerial perspective between the camera and the surface
+    vec4 AP = AerialPerspective(gl_FragCoord.xy / ubo.Resolution, distance(ubo.CameraPosition.xyz, WorldPosition.xyz));
+    outColor = vec4(Lo * AP.a + AP.rgb, PushConstants.ColorMask.a * Material.Albedo.a);
 }
\ No newline at end of file
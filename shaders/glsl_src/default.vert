@@ -16,10 +16,6 @@ layout(location = 0) out vec2 FragUV;
 layout(location = 1) out vec4 WorldPosition;
 layout(location = 2) out mat3 TBN;
 
-layout(set = 1, binding = 1) uniform sampler2D TransmittanceLUT;
-layout(set = 1, binding = 2) uniform sampler2D IrradianceLUT;
-layout(set = 1, binding = 3) uniform sampler3D InscatteringLUT;
-
 void main()
 {
     mat3 mNormal = transpose(mat3(inverse(PushConstants.WorldMatrix))); // for non-uniform scaled objects, strips the scale information and leaves the rotation vectors
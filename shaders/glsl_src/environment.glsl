@@ -0,0 +1,73 @@
+// Image based lighting baked from the sky whenever the sun moves, expects ubo.glsl and lighting.glsl
+layout(set = 0, binding = 4) readonly buffer EnvironmentLighting
+{
+    // irradiance of the sky projected on L2 spherical harmonics, already convolved with the cosine lobe
+    vec4 IrradianceSH[9];
+    vec4 SunRadiance;
+} Environment;
+
+layout(set = 0, binding = 5) uniform samplerCube SpecularCube;
+layout(set = 0, binding = 6) uniform sampler2D BrdfLUT;
+
+// Direction through a texel of a cubemap face, z selects the face in +X -X +Y -Y +Z -Z order
+vec3 CubeDirection(ivec3 texel, int size)
+{
+    vec2 st = 2.0 * (vec2(texel.xy) + 0.5) / float(size) - 1.0;
+
+    switch (texel.z)
+    {
+    case 0: return normalize(vec3(1.0, -st.y, -st.x));
+    case 1: return normalize(vec3(-1.0, -st.y, st.x));
+    case 2: return normalize(vec3(st.x, 1.0, st.y));
+    case 3: return normalize(vec3(st.x, -1.0, -st.y));
+    case 4: return normalize(vec3(st.x, -st.y, 1.0));
+    default: return normalize(vec3(-st.x, -st.y, -1.0));
+    }
+}
+
+void SHBasis(vec3 n, out float Y[9])
+{
+    Y[0] = 0.282095;
+    Y[1] = 0.488603 * n.y;
+    Y[2] = 0.488603 * n.z;
+    Y[3] = 0.488603 * n.x;
+    Y[4] = 1.092548 * n.x * n.y;
+    Y[5] = 1.092548 * n.y * n.z;
+    Y[6] = 0.315392 * (3.0 * n.z * n.z - 1.0);
+    Y[7] = 1.092548 * n.x * n.z;
+    Y[8] = 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+vec3 SkyIrradiance(vec3 N)
+{
+    float Y[9];
+    SHBasis(N, Y);
+
+    vec3 E = vec3(0.0);
+    for (int i = 0; i < 9; i++)
+    {
+        E += Environment.IrradianceSH[i].rgb * Y[i];
+    }
+
+    return max(E, 0.0);
+}
+
+vec2 Hammersley(uint i, uint count)
+{
+    return vec2(float(i) / float(count), float(bitfieldReverse(i)) * 2.3283064365386963e-10);
+}
+
+// GGX half vector around N, roughness follows DistributionGGX
+vec3 ImportanceSampleGGX(vec2 Xi, vec3 N, float roughness)
+{
+    float a = roughness * roughness;
+    float phi = 2.0 * PI * Xi.x;
+    float cosTheta = sqrt((1.0 - Xi.y) / (1.0 + (a * a - 1.0) * Xi.y));
+    float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+
+    return normalize(tangent * cos(phi) * sinTheta + bitangent * sin(phi) * sinTheta + N * cosTheta);
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+#version 460
+
+layout(location=0) out vec2 UV;
+
+// Fullscreen triangle at the far plane, early depth test keeps it off pixels covered by geometry
+void main()
+{
+    UV = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	gl_Position = vec4(UV * 2.0f - 1.0f, 1.0f, 1.0f);
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+layout(set = 3, binding = 0) uniform sampler2D HiZ;
+
+layout(set = 3, binding = 1) uniform OcclusionBuffer
+{
+    mat4 PreviousViewProjection;
+    vec4 Params; // x - pyramid holds valid depth, y - mip count
+} occlusion;
+
+// Test world space sphere against the farthest depth of the previous frame
+bool IsOccluded(vec3 center, float radius)
+{
+    if (occlusion.Params.x == 0.0)
+        return false;
+
+    vec3 minNDC = vec3(1e9);
+    vec3 maxNDC = vec3(-1e9);
+
+    for (int i = 0; i < 8; i++)
+    {
+        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = occlusion.PreviousViewProjection * vec4(corner, 1.0);
+
+        // Bounds crossing the camera plane can't be projected
+        if (clip.w <= 1e-4)
+            return false;
+
+        vec3 ndc = clip.xyz / clip.w;
+        minNDC = min(minNDC, ndc);
+        maxNDC = max(maxNDC, ndc);
+    }
+
+    if (minNDC.z <= 0.0)
+        return false;
+
+    vec2 uvMin = clamp(minNDC.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 uvMax = clamp(maxNDC.xy * 0.5 + 0.5, 0.0, 1.0);
+
+    // Pick the level where the rectangle spans at most 2x2 texels
+    vec2 size = (uvMax - uvMin) * vec2(textureSize(HiZ, 0));
+    int mip = int(clamp(ceil(log2(max(max(size.x, size.y), 1.0))), 0.0, occlusion.Params.y - 1.0));
+
+    ivec2 mipSize = textureSize(HiZ, mip);
+    ivec2 a = min(ivec2(uvMin * vec2(mipSize)), mipSize - 1);
+    ivec2 b = min(ivec2(uvMax * vec2(mipSize)), mipSize - 1);
+
+    float depth = max(max(texelFetch(HiZ, a, mip).r, texelFetch(HiZ, ivec2(b.x, a.y), mip).r),
+        max(texelFetch(HiZ, ivec2(a.x, b.y), mip).r, texelFetch(HiZ, b, mip).r));
+
+    return minNDC.z > depth;
+}
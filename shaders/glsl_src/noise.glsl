@@ -60,6 +60,68 @@ vec3 pcg3d(vec3 p)
     return vec3(v) / float(0xffffffffu);
 }
 
+#ifdef NOISE_TILE
+// Feature points of lattice cells covered by the workgroup tile (plus a one cell border), computed once per tile
+#define NOISE_CACHE_DIM 8
+shared vec3 FeaturePoints[NOISE_CACHE_DIM * NOISE_CACHE_DIM * NOISE_CACHE_DIM];
+
+vec3 TileMin = vec3(0.0);
+vec3 TileMax = vec3(0.0);
+ivec3 CacheOrigin = ivec3(0);
+ivec3 CacheSize = ivec3(0);
+bool CacheValid = false;
+
+// Has to be called before any 3D noise with the extent of the target image
+void noise_tile(uvec3 size)
+{
+    const uvec3 first = gl_WorkGroupID * gl_WorkGroupSize;
+    const uvec3 last = min(first + gl_WorkGroupSize, size) - 1u;
+
+    TileMin = vec3(first) / vec3(size);
+    TileMax = vec3(last) / vec3(size);
+}
+
+// Contains barriers, every invocation of the workgroup has to reach it
+void noise_cache(float freq)
+{
+    CacheOrigin = ivec3(floor(TileMin * freq)) - 1;
+    CacheSize = ivec3(floor(TileMax * freq)) + 2 - CacheOrigin;
+    // High frequencies span too many cells per tile, those fall back to hashing per invocation
+    CacheValid = all(lessThanEqual(CacheSize, ivec3(NOISE_CACHE_DIM)));
+
+    barrier();
+
+    if (CacheValid) {
+        const uint count = uint(CacheSize.x * CacheSize.y * CacheSize.z);
+        const uint groupSize = gl_WorkGroupSize.x * gl_WorkGroupSize.y * gl_WorkGroupSize.z;
+
+        for (uint c = gl_LocalInvocationIndex; c < count; c += groupSize) {
+            const ivec3 cell = CacheOrigin + ivec3(c % CacheSize.x, (c / CacheSize.x) % CacheSize.y, c / (CacheSize.x * CacheSize.y));
+            FeaturePoints[c] = pcg3d(mod(vec3(cell), freq));
+        }
+    }
+
+    barrier();
+}
+
+vec3 lattice3d(vec3 cell, float freq)
+{
+    if (CacheValid) {
+        const ivec3 c = ivec3(cell) - CacheOrigin;
+        return FeaturePoints[c.x + CacheSize.x * (c.y + CacheSize.y * c.z)];
+    }
+
+    return pcg3d(mod(cell, freq));
+}
+#else
+void noise_cache(float freq) {}
+
+vec3 lattice3d(vec3 cell, float freq)
+{
+    return pcg3d(mod(cell, freq));
+}
+#endif
+
 float worley(vec2 p0, float freq)
 {
     float min_d = 1.0;
@@ -79,6 +141,8 @@ float worley(vec2 p0, float freq)
 
 float worley(vec3 p0, float freq)
 {
+    noise_cache(freq);
+
     float min_d = 1.0;
     const vec3 i = floor(p0 * freq);
     const vec3 f = fract(p0 * freq);
@@ -87,8 +151,7 @@ float worley(vec3 p0, float freq)
         for (int y = -1; y <= 1; y++) {
             for (int z = -1; z <= 1; z++) {
                 vec3 p1 = vec3(x, y, z);
-                vec3 neighbour_cell = mod(i + p1, freq);
-                min_d = min(min_d, distance(pcg3d(neighbour_cell), f - p1));
+                min_d = min(min_d, distance(lattice3d(i + p1, freq), f - p1));
             }
         }
     }
@@ -115,19 +178,21 @@ float perlin(vec2 x0, float freq)
 
 float perlin(vec3 x0, float freq) 
 {
+    noise_cache(freq);
+
     vec3 i = floor(x0 * freq);
     vec3 f = fract(x0 * freq);
     
     vec2 of = vec2(0.0, 1.0);
 
-    vec3 ga = pcg3d(mod(i + of.xxx, freq));
-    vec3 gb = pcg3d(mod(i + of.yxx, freq));
-    vec3 gc = pcg3d(mod(i + of.xyx, freq));
-    vec3 gd = pcg3d(mod(i + of.yyx, freq));
-    vec3 ge = pcg3d(mod(i + of.xxy, freq));
-    vec3 gf = pcg3d(mod(i + of.yxy, freq));
-    vec3 gg = pcg3d(mod(i + of.xyy, freq));
-    vec3 gh = pcg3d(mod(i + of.yyy, freq));
+    vec3 ga = lattice3d(i + of.xxx, freq);
+    vec3 gb = lattice3d(i + of.yxx, freq);
+    vec3 gc = lattice3d(i + of.xyx, freq);
+    vec3 gd = lattice3d(i + of.yyx, freq);
+    vec3 ge = lattice3d(i + of.xxy, freq);
+    vec3 gf = lattice3d(i + of.yxy, freq);
+    vec3 gg = lattice3d(i + of.xyy, freq);
+    vec3 gh = lattice3d(i + of.yyy, freq);
 
     float va = dot(ga, f);
     float vb = dot(gb, f - vec3(1.0, 0.0, 0.0));
@@ -0,0 +1,70 @@
+// Sky-view and aerial perspective LUTs baked every frame around the camera, expects ubo.glsl and lighting.glsl
+// Aerial perspective slices are spread exponentially up to the horizon of the cloud layer
+#define AERIAL_NEAR 100.0
+#define AERIAL_FAR 6e5
+
+layout(set = 0, binding = 2) uniform sampler2D SkyViewLUT;
+layout(set = 0, binding = 3) uniform sampler3D AerialPerspectiveLUT;
+
+// Sky is symmetric around the sun azimuth, so only half of the azimuth range is stored
+void SkyViewBasis(vec3 Up, vec3 Sun, out vec3 Forward, out vec3 Right)
+{
+    vec3 f = Sun - Up * dot(Sun, Up);
+    Forward = dot(f, f) > 1e-8 ? normalize(f) : normalize(cross(Up, abs(Up.x) < 0.9 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 0.0, 1.0)));
+    Right = cross(Up, Forward);
+}
+
+// Elevation is square root mapped so the horizon, where the sky changes fastest, gets most texels
+vec2 SkyViewUV(vec3 Up, vec3 Sun, vec3 View)
+{
+    vec3 Forward, Right;
+    SkyViewBasis(Up, Sun, Forward, Right);
+
+    float elevation = asin(clamp(dot(View, Up), -1.0, 1.0));
+    float azimuth = atan(abs(dot(View, Right)), dot(View, Forward));
+
+    return vec2(azimuth / PI, 0.5 + 0.5 * sign(elevation) * sqrt(abs(elevation) / (0.5 * PI)));
+}
+
+vec3 SkyViewDirection(vec3 Up, vec3 Sun, vec2 uv)
+{
+    vec3 Forward, Right;
+    SkyViewBasis(Up, Sun, Forward, Right);
+
+    float s = 2.0 * uv.y - 1.0;
+    float elevation = sign(s) * s * s * 0.5 * PI;
+    float azimuth = uv.x * PI;
+
+    return cos(elevation) * (cos(azimuth) * Forward + sin(azimuth) * Right) + sin(elevation) * Up;
+}
+
+float AerialSlice(float d)
+{
+    return log(max(d, AERIAL_NEAR) / AERIAL_NEAR) / log(AERIAL_FAR / AERIAL_NEAR);
+}
+
+float AerialDistance(float slice)
+{
+    return AERIAL_NEAR * pow(AERIAL_FAR / AERIAL_NEAR, slice);
+}
+
+// rgb is in-scattered light between the camera and distance d, alpha is mean transmittance
+vec4 AerialPerspective(vec2 ScreenUV, float d)
+{
+    vec4 ap = textureLod(AerialPerspectiveLUT, vec3(ScreenUV, AerialSlice(d)), 0.0);
+    return mix(vec4(0.0, 0.0, 0.0, 1.0), ap, saturate(d / AERIAL_NEAR));
+}
+
+vec3 SkyView(vec3 Eye, vec3 Sun, vec3 View)
+{
+    return textureLod(SkyViewLUT, SkyViewUV(normalize(Eye), Sun, View), 0.0).rgb;
+}
+
+// View ray through the screen position, matches the ray used by fullscreen passes
+vec3 ScreenRay(vec2 ScreenUV)
+{
+    vec4 ScreenNDC = vec4(2.0 * ScreenUV - 1.0, 1.0, 1.0);
+    vec4 ScreenView = inverse(ubo.ProjectionMatrix) * ScreenNDC;
+    vec4 ScreenWorld = inverse(ubo.ViewMatrix) * vec4(ScreenView.xy, -1.0, 0.0);
+    return normalize(ScreenWorld.xyz);
+}
\ No newline at end of file
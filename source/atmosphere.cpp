@@ -0,0 +1,320 @@
+#include "pch.hpp"
+#include "atmosphere.hpp"
+
+static TAuto<VulkanImage> create_intermediate(const RenderScope& Scope, const VkExtent3D& extent)
+{
+	VkImageCreateInfo imageCI{};
+	imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCI.arrayLayers = 1;
+	imageCI.extent = extent;
+	imageCI.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCI.mipLevels = 1;
+	imageCI.flags = 0;
+	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageCI.imageType = extent.depth > 1 ? VK_IMAGE_TYPE_3D : VK_IMAGE_TYPE_2D;
+
+	VkImageViewCreateInfo imageViewCI{};
+	imageViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imageViewCI.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	imageViewCI.viewType = extent.depth > 1 ? VK_IMAGE_VIEW_TYPE_3D : VK_IMAGE_VIEW_TYPE_2D;
+	imageViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageViewCI.subresourceRange.baseArrayLayer = 0;
+	imageViewCI.subresourceRange.baseMipLevel = 0;
+	imageViewCI.subresourceRange.layerCount = 1;
+	imageViewCI.subresourceRange.levelCount = 1;
+
+	VmaAllocationCreateInfo imageAlloc{};
+	imageAlloc.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+	TAuto<VulkanImage> image = std::make_unique<VulkanImage>(Scope);
+	image->CreateImage(imageCI, imageAlloc)
+		.CreateImageView(imageViewCI)
+		.CreateSampler(ESamplerType::PointClamp)
+		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+
+	return image;
+}
+
+static void dispatch(VkCommandBuffer cmd, const VulkanImage& target, uint32_t groupSize)
+{
+	const VkExtent3D& extent = target.GetExtent();
+	const uint32_t groupDepth = extent.depth > 1 ? groupSize : 1u;
+
+	vkCmdDispatch(cmd, (extent.width + groupSize - 1) / groupSize, (extent.height + groupSize - 1) / groupSize, (extent.depth + groupDepth - 1) / groupDepth);
+}
+
+static void compute_barrier(VkCommandBuffer cmd)
+{
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+}
+
+AtmosphereBaker::AtmosphereBaker(const RenderScope& InScope, const AtmosphereProfile& InProfile, VulkanImage& transmittance, VulkanImage& irradiance, VulkanImage& scattering)
+	: profile(InProfile), Transmittance(&transmittance), Irradiance(&irradiance), Scattering(&scattering), Scope(&InScope)
+{
+	VkBufferCreateInfo profileInfo{};
+	profileInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	profileInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	profileInfo.size = sizeof(AtmosphereProfile);
+	profileInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo profileAlloc{};
+	profileAlloc.usage = VMA_MEMORY_USAGE_AUTO;
+	profileAlloc.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+
+	profileBuffer = std::make_unique<Buffer>(*Scope, profileInfo, profileAlloc);
+	profileBuffer->Update(&profile, sizeof(AtmosphereProfile));
+
+	ProfileDSO = DescriptorSetDescriptor()
+		.AddUniformBuffer(0, VK_SHADER_STAGE_COMPUTE_BIT, *profileBuffer)
+		.Allocate(*Scope);
+
+	DeltaE = create_intermediate(*Scope, IrradianceExtent);
+	DeltaSR = create_intermediate(*Scope, ScatteringExtent);
+	DeltaSM = create_intermediate(*Scope, ScatteringExtent);
+	DeltaJ = create_intermediate(*Scope, ScatteringExtent);
+
+	TrDSO = DescriptorSetDescriptor()
+		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *Transmittance)
+		.Allocate(*Scope);
+
+	GenTrLUT = ComputePipelineDescriptor()
+		.SetShaderName("transmittance_comp")
+		.AddDescriptorLayout(TrDSO->GetLayout())
+		.AddDescriptorLayout(ProfileDSO->GetLayout())
+		.Construct(*Scope);
+
+	DeltaEDSO = DescriptorSetDescriptor()
+		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaE)
+		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *Transmittance)
+		.Allocate(*Scope);
+
+	GenDeltaELUT = ComputePipelineDescriptor()
+		.SetShaderName("deltaE_comp")
+		.AddDescriptorLayout(DeltaEDSO->GetLayout())
+		.AddDescriptorLayout(ProfileDSO->GetLayout())
+		.Construct(*Scope);
+
+	DeltaSRSMDSO = DescriptorSetDescriptor()
+		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSR)
+		.AddStorageImage(1, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSM)
+		.AddImageSampler(2, VK_SHADER_STAGE_COMPUTE_BIT, *Transmittance)
+		.Allocate(*Scope);
+
+	GenDeltaSRSMLUT = ComputePipelineDescriptor()
+		.SetShaderName("deltaSRSM_comp")
+		.AddDescriptorLayout(DeltaSRSMDSO->GetLayout())
+		.AddDescriptorLayout(ProfileDSO->GetLayout())
+		.Construct(*Scope);
+
+	SingleScatterDSO = DescriptorSetDescriptor()
+		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *Scattering)
+		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSR)
+		.AddImageSampler(2, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSM)
+		.Allocate(*Scope);
+
+	GenSingleScatterLUT = ComputePipelineDescriptor()
+		.SetShaderName("singleScattering_comp")
+		.AddDescriptorLayout(SingleScatterDSO->GetLayout())
+		.AddDescriptorLayout(ProfileDSO->GetLayout())
+		.Construct(*Scope);
+
+	DeltaJDSO = DescriptorSetDescriptor()
+		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaJ)
+		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *Transmittance)
+		.AddImageSampler(2, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaE)
+		.AddImageSampler(3, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSR)
+		.AddImageSampler(4, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSM)
+		.Allocate(*Scope);
+
+	GenDeltaJLUT = ComputePipelineDescriptor()
+		.SetShaderName("deltaJ_comp")
+		.AddDescriptorLayout(DeltaJDSO->GetLayout())
+		.AddDescriptorLayout(ProfileDSO->GetLayout())
+		.AddPushConstant({ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(int) })
+		.Construct(*Scope);
+
+	DeltaEnDSO = DescriptorSetDescriptor()
+		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaE)
+		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSR)
+		.AddImageSampler(2, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSM)
+		.Allocate(*Scope);
+
+	GenDeltaEnLUT = ComputePipelineDescriptor()
+		.SetShaderName("deltaEn_comp")
+		.AddDescriptorLayout(DeltaEnDSO->GetLayout())
+		.AddDescriptorLayout(ProfileDSO->GetLayout())
+		.AddPushConstant({ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(int) })
+		.Construct(*Scope);
+
+	DeltaSDSO = DescriptorSetDescriptor()
+		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSR)
+		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *Transmittance)
+		.AddImageSampler(2, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaJ)
+		.Allocate(*Scope);
+
+	GenDeltaSLUT = ComputePipelineDescriptor()
+		.SetShaderName("deltaS_comp")
+		.AddDescriptorLayout(DeltaSDSO->GetLayout())
+		.AddDescriptorLayout(ProfileDSO->GetLayout())
+		.Construct(*Scope);
+
+	AddEDSO = DescriptorSetDescriptor()
+		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *Irradiance)
+		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaE)
+		.Allocate(*Scope);
+
+	AddE = ComputePipelineDescriptor()
+		.SetShaderName("addE_comp")
+		.AddDescriptorLayout(AddEDSO->GetLayout())
+		.AddDescriptorLayout(ProfileDSO->GetLayout())
+		.Construct(*Scope);
+
+	AddSDSO = DescriptorSetDescriptor()
+		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *Scattering)
+		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSR)
+		.Allocate(*Scope);
+
+	AddS = ComputePipelineDescriptor()
+		.SetShaderName("addS_comp")
+		.AddDescriptorLayout(AddSDSO->GetLayout())
+		.AddDescriptorLayout(ProfileDSO->GetLayout())
+		.Construct(*Scope);
+}
+
+AtmosphereBaker::~AtmosphereBaker()
+{
+	// Last submitted step might still be running
+	Scope->GetQueue(VK_QUEUE_COMPUTE_BIT).Wait(ticket);
+
+	if (semaphore != VK_NULL_HANDLE)
+		vkDestroySemaphore(Scope->GetDevice(), semaphore, VK_NULL_HANDLE);
+}
+
+void AtmosphereBaker::Record(VkCommandBuffer cmd)
+{
+	for (uint32_t step = 0; step < GetStepCount(); step++) {
+		record_step(cmd, step);
+	}
+}
+
+VkBool32 AtmosphereBaker::Advance()
+{
+	const Queue& Queue = Scope->GetQueue(VK_QUEUE_COMPUTE_BIT);
+
+	if (semaphore == VK_NULL_HANDLE)
+		::CreateSemaphore(Scope->GetDevice(), &semaphore);
+
+	if (!Queue.IsComplete(ticket))
+		return 0;
+
+	if (submittedSteps == GetStepCount())
+		return 1;
+
+	VkCommandBuffer cmd;
+	Queue.AllocateCommandBuffers(1, &cmd);
+
+	::BeginOneTimeSubmitCmd(cmd);
+	record_step(cmd, submittedSteps);
+	::EndCommandBuffer(cmd);
+
+	Queue::Batch step{};
+	step.commandBuffers = { cmd };
+
+	if (++submittedSteps == GetStepCount())
+	{
+		VkSemaphoreSubmitInfo signal{};
+		signal.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+		signal.semaphore = semaphore;
+		signal.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+		step.signals.push_back(signal);
+	}
+
+	ticket = Queue.Submit({ step });
+
+	return 0;
+}
+
+void AtmosphereBaker::record_step(VkCommandBuffer cmd, uint32_t step)
+{
+	// Previous step might have been recorded in another submission
+	compute_barrier(cmd);
+
+	if (step == 0)
+	{
+		GenTrLUT->BindPipeline(cmd);
+		TrDSO->BindSet(0, cmd, *GenTrLUT);
+		ProfileDSO->BindSet(1, cmd, *GenTrLUT);
+		dispatch(cmd, *Transmittance, 8u);
+		return;
+	}
+
+	if (step == 1)
+	{
+		// Irradiance only accumulates higher scattering orders
+		VkClearColorValue clearColor{};
+		VkImageSubresourceRange subRes = Irradiance->GetSubResourceRange();
+		vkCmdClearColorImage(cmd, Irradiance->GetImage(), VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &subRes);
+
+		GenDeltaELUT->BindPipeline(cmd);
+		DeltaEDSO->BindSet(0, cmd, *GenDeltaELUT);
+		ProfileDSO->BindSet(1, cmd, *GenDeltaELUT);
+		dispatch(cmd, *DeltaE, 8u);
+
+		GenDeltaSRSMLUT->BindPipeline(cmd);
+		DeltaSRSMDSO->BindSet(0, cmd, *GenDeltaSRSMLUT);
+		ProfileDSO->BindSet(1, cmd, *GenDeltaSRSMLUT);
+		dispatch(cmd, *DeltaSR, 4u);
+
+		compute_barrier(cmd);
+
+		GenSingleScatterLUT->BindPipeline(cmd);
+		SingleScatterDSO->BindSet(0, cmd, *GenSingleScatterLUT);
+		ProfileDSO->BindSet(1, cmd, *GenSingleScatterLUT);
+		dispatch(cmd, *Scattering, 4u);
+		return;
+	}
+
+	int Sample = static_cast<int>(step) - 1;
+
+	GenDeltaJLUT->BindPipeline(cmd);
+	GenDeltaJLUT->PushConstants(cmd, &Sample, sizeof(int), 0, VK_SHADER_STAGE_COMPUTE_BIT);
+	DeltaJDSO->BindSet(0, cmd, *GenDeltaJLUT);
+	ProfileDSO->BindSet(1, cmd, *GenDeltaJLUT);
+	dispatch(cmd, *DeltaJ, 4u);
+
+	// DeltaJ reads DeltaE of the previous order, which is overwritten next
+	compute_barrier(cmd);
+
+	GenDeltaEnLUT->BindPipeline(cmd);
+	GenDeltaEnLUT->PushConstants(cmd, &Sample, sizeof(int), 0, VK_SHADER_STAGE_COMPUTE_BIT);
+	DeltaEnDSO->BindSet(0, cmd, *GenDeltaEnLUT);
+	ProfileDSO->BindSet(1, cmd, *GenDeltaEnLUT);
+	dispatch(cmd, *DeltaE, 8u);
+
+	compute_barrier(cmd);
+
+	GenDeltaSLUT->BindPipeline(cmd);
+	DeltaSDSO->BindSet(0, cmd, *GenDeltaSLUT);
+	ProfileDSO->BindSet(1, cmd, *GenDeltaSLUT);
+	dispatch(cmd, *DeltaSR, 4u);
+
+	AddE->BindPipeline(cmd);
+	AddEDSO->BindSet(0, cmd, *AddE);
+	ProfileDSO->BindSet(1, cmd, *AddE);
+	dispatch(cmd, *Irradiance, 8u);
+
+	compute_barrier(cmd);
+
+	AddS->BindPipeline(cmd);
+	AddSDSO->BindSet(0, cmd, *AddS);
+	ProfileDSO->BindSet(1, cmd, *AddS);
+	dispatch(cmd, *Scattering, 4u);
+}
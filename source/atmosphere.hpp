@@ -0,0 +1,99 @@
+#pragma once
+#include "pch.hpp"
+#include "scope.hpp"
+#include "vulkan_objects/image.hpp"
+#include "vulkan_objects/buffer.hpp"
+#include "vulkan_objects/descriptor_set.hpp"
+#include "vulkan_objects/pipeline.hpp"
+#include "vulkan_api.hpp"
+/*
+* !@brief Computes Transmittance, Irradiance and Scattering LUTs of an atmosphere (Bruneton) on the compute queue.
+* The chain is split into steps: transmittance, single scattering and one step per scattering order.
+* Steps can be recorded all at once or submitted one per frame, so a recompute does not stall rendering.
+*/
+class AtmosphereBaker
+{
+public:
+	/*
+	* !@brief Create intermediate images and pipelines of the chain
+	*
+	* @param[in] Scope - render scope
+	* @param[in] profile - atmosphere to compute LUTs for
+	* @param[in] transmittance - 32 bit float RGBA target of TransmittanceExtent
+	* @param[in] irradiance - 32 bit float RGBA target of IrradianceExtent
+	* @param[in] scattering - 32 bit float RGBA target of ScatteringExtent
+	*/
+	AtmosphereBaker(const RenderScope& Scope, const AtmosphereProfile& profile, VulkanImage& transmittance, VulkanImage& irradiance, VulkanImage& scattering);
+
+	~AtmosphereBaker();
+
+	AtmosphereBaker(const AtmosphereBaker& other) = delete;
+
+	void operator=(const AtmosphereBaker& other) = delete;
+	/*
+	* !@brief Record every step of the chain
+	*/
+	void Record(VkCommandBuffer cmd);
+	/*
+	* !@brief Submit the next step once the previous one has finished, call once per frame
+	*
+	* @return true when every step has finished
+	*/
+	VkBool32 Advance();
+	/*
+	* !@brief Signaled by the last step submitted through Advance, has to be waited before targets are read on other queues
+	*/
+	const VkSemaphore& GetSemaphore() const { return semaphore; };
+
+	const AtmosphereProfile& GetProfile() const { return profile; };
+
+	uint32_t GetStepCount() const { return 2u + scatteringOrders; };
+
+	static constexpr VkExtent3D TransmittanceExtent = { 256u, 64u, 1u };
+	static constexpr VkExtent3D IrradianceExtent = { 64u, 16u, 1u };
+	static constexpr VkExtent3D ScatteringExtent = { 256u, 128u, 32u };
+
+private:
+	void record_step(VkCommandBuffer cmd, uint32_t step);
+
+	AtmosphereProfile profile = {};
+
+	VulkanImage* Transmittance = VK_NULL_HANDLE;
+	VulkanImage* Irradiance = VK_NULL_HANDLE;
+	VulkanImage* Scattering = VK_NULL_HANDLE;
+
+	TAuto<Buffer> profileBuffer = VK_NULL_HANDLE;
+	TAuto<VulkanImage> DeltaE = VK_NULL_HANDLE;
+	TAuto<VulkanImage> DeltaSR = VK_NULL_HANDLE;
+	TAuto<VulkanImage> DeltaSM = VK_NULL_HANDLE;
+	TAuto<VulkanImage> DeltaJ = VK_NULL_HANDLE;
+
+	TAuto<DescriptorSet> ProfileDSO = VK_NULL_HANDLE;
+	TAuto<DescriptorSet> TrDSO = VK_NULL_HANDLE;
+	TAuto<DescriptorSet> DeltaEDSO = VK_NULL_HANDLE;
+	TAuto<DescriptorSet> DeltaSRSMDSO = VK_NULL_HANDLE;
+	TAuto<DescriptorSet> SingleScatterDSO = VK_NULL_HANDLE;
+	TAuto<DescriptorSet> DeltaJDSO = VK_NULL_HANDLE;
+	TAuto<DescriptorSet> DeltaEnDSO = VK_NULL_HANDLE;
+	TAuto<DescriptorSet> DeltaSDSO = VK_NULL_HANDLE;
+	TAuto<DescriptorSet> AddEDSO = VK_NULL_HANDLE;
+	TAuto<DescriptorSet> AddSDSO = VK_NULL_HANDLE;
+
+	TAuto<Pipeline> GenTrLUT = VK_NULL_HANDLE;
+	TAuto<Pipeline> GenDeltaELUT = VK_NULL_HANDLE;
+	TAuto<Pipeline> GenDeltaSRSMLUT = VK_NULL_HANDLE;
+	TAuto<Pipeline> GenSingleScatterLUT = VK_NULL_HANDLE;
+	TAuto<Pipeline> GenDeltaJLUT = VK_NULL_HANDLE;
+	TAuto<Pipeline> GenDeltaEnLUT = VK_NULL_HANDLE;
+	TAuto<Pipeline> GenDeltaSLUT = VK_NULL_HANDLE;
+	TAuto<Pipeline> AddE = VK_NULL_HANDLE;
+	TAuto<Pipeline> AddS = VK_NULL_HANDLE;
+
+	Queue::Ticket ticket = 0;
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	uint32_t submittedSteps = 0;
+
+	const uint32_t scatteringOrders = 5u;
+
+	const RenderScope* Scope = VK_NULL_HANDLE;
+};
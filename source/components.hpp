@@ -105,6 +105,15 @@ namespace GRComponents
 		glm::vec3 RGB = glm::vec3(1.0);
 	};
 	/*
+	* !@brief Level of detail the mesh was drawn with during the last frame, updated by the renderer
+	*/
+	struct LevelOfDetail
+	{
+		uint32_t Level = 0;
+		uint32_t Count = 1;
+		uint32_t Triangles = 0;
+	};
+	/*
 	* !@brief Projection matrix
 	*/
 	struct Projection
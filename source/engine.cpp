@@ -20,7 +20,7 @@ namespace GR
 
 		listener = new EventListener();
 		window = new Window(Settings.ApplicationName.c_str(), Settings.WindowExtents.x, Settings.WindowExtents.y);
-		renderer = new VulkanBase(window->glfwWindow, registry);
+		renderer = new VulkanBase(window->glfwWindow, registry, Settings.LutPrecision);
 
 		context = { listener , renderer, this };
 
@@ -78,9 +78,9 @@ namespace GR
 		return glfwGetTime();
 	}
 
-	Entity GrayEngine::AddMesh(const std::string& MeshPath) const
+	Entity GrayEngine::AddMesh(const std::string& MeshPath, uint32_t LodLevels) const
 	{
-		return renderer->AddMesh(MeshPath);
+		return renderer->AddMesh(MeshPath, LodLevels);
 	}
 
 	Entity GrayEngine::AddShape(const GRShape::Shape& Descriptor) const
@@ -133,4 +133,9 @@ namespace GR
 		renderer->Wait();
 		registry.clear();
 	}
+
+	TVector<HeapBudget> GrayEngine::GetMemoryBudget() const
+	{
+		return renderer->GetMemoryBudget();
+	}
 };
\ No newline at end of file
@@ -117,10 +117,11 @@ namespace GR
 		* !@brief Load mesh from file
 		* 
 		* @param[in] MeshPath - local path to the mesh file
+		* @param[in] LodLevels - maximum amount of levels of detail to generate, including the full detail one
 		* 
 		* @return New entity handle
 		*/
-		GRAPI Entity AddMesh(const std::string& MeshPath) const;
+		GRAPI Entity AddMesh(const std::string& MeshPath, uint32_t LodLevels = 1u) const;
 		/*
 		* !@brief Generate mesh from shape descriptor
 		* 
@@ -182,5 +183,11 @@ namespace GR
 		* !@brief Erase all entities from the scene
 		*/
 		GRAPI void ClearEntities();
+		/*
+		* !@brief Get memory usage and budget of every device memory heap
+		* 
+		* @return Collection of heap budgets
+		*/
+		GRAPI TVector<HeapBudget> GetMemoryBudget() const;
 	};
 };
\ No newline at end of file
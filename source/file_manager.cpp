@@ -1,5 +1,7 @@
 #include "pch.hpp"
 #include "file_manager.hpp"
+#include "mesh_lod.hpp"
+#include "meshlet.hpp"
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <assimp/Importer.hpp>
@@ -122,31 +124,30 @@ TAuto<VulkanImage> create_image(const RenderScope& Scope, void* pixels, int coun
 		.CreateImageView(imageViewCI)
 		.CreateSampler(ESamplerType::BillinearRepeat);
 
+	const Queue& transferQueue = Scope.GetQueue(VK_QUEUE_TRANSFER_BIT);
+	const Queue& graphicsQueue = Scope.GetQueue(VK_QUEUE_GRAPHICS_BIT);
+
 	VkCommandBuffer cmd;
-	Scope.GetQueue(VK_QUEUE_TRANSFER_BIT)
-		.AllocateCommandBuffers(1, &cmd);
+	transferQueue.AllocateCommandBuffers(1, &cmd);
 
 	BeginOneTimeSubmitCmd(cmd);
 	target->TransitionLayout(cmd, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 	CopyBufferToImage(cmd, target->GetImage(), stagingBuffer.GetBuffer(), subRes, { (uint32_t)w, (uint32_t)h, 1u });
 	EndCommandBuffer(cmd);
 
-	Scope.GetQueue(VK_QUEUE_TRANSFER_BIT)
-		.Submit(cmd)
-		.Wait()
-		.FreeCommandBuffers(1, &cmd);
+	const Queue::Ticket upload = transferQueue.Submit(cmd);
 
-	Scope.GetQueue(VK_QUEUE_GRAPHICS_BIT)
-		.AllocateCommandBuffers(1, &cmd);
+	graphicsQueue.AllocateCommandBuffers(1, &cmd);
 
 	BeginOneTimeSubmitCmd(cmd);
 	target->GenerateMipMaps(cmd);
 	EndCommandBuffer(cmd);
 
-	Scope.GetQueue(VK_QUEUE_GRAPHICS_BIT)
-		.Submit(cmd)
-		.Wait()
-		.FreeCommandBuffers(1, &cmd);
+	// Mips wait for the upload on the device, host only waits once before the staging buffer goes away
+	Queue::Batch mips{};
+	mips.commandBuffers = { cmd };
+	mips.waits = { transferQueue.WaitInfo(upload, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT) };
+	graphicsQueue.Wait(graphicsQueue.Submit({ mips }));
 
 	return target;
 }
@@ -166,7 +167,7 @@ TAuto<VulkanImage> GRVkFile::_importImage(const RenderScope& Scope, const char*
 	return target;
 }
 
-TAuto<Mesh> GRVkFile::_importMesh(const RenderScope& Scope, const char* path)
+TAuto<Mesh> GRVkFile::_importMesh(const RenderScope& Scope, const char* path, uint32_t lodCount)
 {
 	std::unordered_map<Vertex, uint32_t> uniqueVertices{};
 	TVector<uint32_t> indices;
@@ -216,5 +217,9 @@ TAuto<Mesh> GRVkFile::_importMesh(const RenderScope& Scope, const char* path)
 		}
 	}
 
-	return std::make_unique<Mesh>(Scope, vertices.data(), vertices.size(), indices.data(), indices.size());
+	TVector<MeshLod> lods = GRMeshLod::GenerateLods(vertices, indices, lodCount);
+
+	TVector<Meshlet> meshlets = GRMeshlet::Build(vertices, indices, lods);
+
+	return std::make_unique<Mesh>(Scope, vertices.data(), vertices.size(), indices.data(), indices.size(), lods, meshlets);
 }
\ No newline at end of file
@@ -9,5 +9,5 @@ namespace GRVkFile
 {
 	TAuto<VulkanImage> _importImage(const RenderScope& Scope, const char* path, const VkFormat& format, const VkImageCreateFlags& flags = 0);
 
-	TAuto<Mesh> _importMesh(const RenderScope& Scope, const char* path);
+	TAuto<Mesh> _importMesh(const RenderScope& Scope, const char* path, uint32_t lodCount = 1u);
 };
\ No newline at end of file
@@ -0,0 +1,270 @@
+#include "pch.hpp"
+#include "mesh_lod.hpp"
+#include <numeric>
+#include <algorithm>
+#include <unordered_map>
+#ifndef GLM_ENABLE_EXPERIMENTAL
+#define GLM_ENABLE_EXPERIMENTAL
+#endif
+#include <glm/gtx/hash.hpp>
+
+struct Quadric
+{
+	double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+	double b2 = 0.0, bc = 0.0, bd = 0.0;
+	double c2 = 0.0, cd = 0.0;
+	double d2 = 0.0;
+};
+
+struct Collapse
+{
+	uint32_t from;
+	uint32_t to;
+	double cost;
+};
+
+static Quadric plane_quadric(const TVec3& p0, const TVec3& p1, const TVec3& p2)
+{
+	Quadric Q{};
+	glm::dvec3 n = glm::cross(glm::dvec3(p1 - p0), glm::dvec3(p2 - p0));
+	double length = glm::length(n);
+
+	if (length <= 0.0)
+		return Q;
+
+	n /= length;
+	double d = -glm::dot(n, glm::dvec3(p0));
+
+	Q.a2 = n.x * n.x; Q.ab = n.x * n.y; Q.ac = n.x * n.z; Q.ad = n.x * d;
+	Q.b2 = n.y * n.y; Q.bc = n.y * n.z; Q.bd = n.y * d;
+	Q.c2 = n.z * n.z; Q.cd = n.z * d;
+	Q.d2 = d * d;
+
+	return Q;
+}
+
+static void accumulate(Quadric& Q, const Quadric& R)
+{
+	Q.a2 += R.a2; Q.ab += R.ab; Q.ac += R.ac; Q.ad += R.ad;
+	Q.b2 += R.b2; Q.bc += R.bc; Q.bd += R.bd;
+	Q.c2 += R.c2; Q.cd += R.cd;
+	Q.d2 += R.d2;
+}
+
+// Sum of squared distances from p to all planes accumulated in Q
+static double evaluate(const Quadric& Q, const TVec3& p)
+{
+	double x = p.x, y = p.y, z = p.z;
+
+	double r = Q.a2 * x * x + 2.0 * Q.ab * x * y + 2.0 * Q.ac * x * z + 2.0 * Q.ad * x
+		+ Q.b2 * y * y + 2.0 * Q.bc * y * z + 2.0 * Q.bd * y
+		+ Q.c2 * z * z + 2.0 * Q.cd * z
+		+ Q.d2;
+
+	return glm::abs(r);
+}
+
+// Moving 'from' onto 'to' must not turn any of the remaining triangles around
+static bool flips(const TVector<Vertex>& vertices, const TVector<uint32_t>& indices, const uint32_t* triangles, size_t count, uint32_t from, uint32_t to)
+{
+	for (size_t t = 0; t < count; t++)
+	{
+		const uint32_t* tri = &indices[triangles[t] * 3];
+
+		if (tri[0] == to || tri[1] == to || tri[2] == to)
+			continue;
+
+		TVec3 p[3] = { vertices[tri[0]].position, vertices[tri[1]].position, vertices[tri[2]].position };
+		TVec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			if (tri[k] == from)
+				p[k] = vertices[to].position;
+		}
+
+		TVec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+		if (glm::dot(before, after) < 0.25f * glm::length(before) * glm::length(after))
+			return true;
+	}
+
+	return false;
+}
+
+float GRMeshLod::Simplify(const TVector<Vertex>& vertices, const TVector<uint32_t>& indices, size_t targetIndexCount, TVector<uint32_t>& result)
+{
+	const size_t vertexCount = vertices.size();
+	result = indices;
+
+	// Vertices sharing position with other vertices or lying on an open boundary stay in place
+	TVector<uint8_t> locked(vertexCount, 0);
+	{
+		TVector<uint32_t> wedge(vertexCount);
+		std::unordered_map<TVec3, uint32_t> positions{};
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			auto [it, inserted] = positions.try_emplace(vertices[v].position, v);
+			wedge[v] = it->second;
+
+			if (!inserted)
+			{
+				locked[v] = 1;
+				locked[it->second] = 1;
+			}
+		}
+
+		std::unordered_map<uint64_t, uint32_t> edges{};
+		for (size_t i = 0; i + 2 < result.size(); i += 3)
+		{
+			for (uint32_t e = 0; e < 3; e++)
+			{
+				uint32_t a = wedge[result[i + e]];
+				uint32_t b = wedge[result[i + (e + 1) % 3]];
+				edges[(uint64_t(glm::min(a, b)) << 32) | glm::max(a, b)]++;
+			}
+		}
+
+		for (const auto& [key, count] : edges)
+		{
+			if (count == 1)
+			{
+				locked[key >> 32] = 1;
+				locked[key & UINT32_MAX] = 1;
+			}
+		}
+	}
+
+	TVector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i + 2 < result.size(); i += 3)
+	{
+		Quadric Q = plane_quadric(vertices[result[i]].position, vertices[result[i + 1]].position, vertices[result[i + 2]].position);
+
+		for (uint32_t k = 0; k < 3; k++)
+			accumulate(quadrics[result[i + k]], Q);
+	}
+
+	double maxError = 0.0;
+	TVector<uint32_t> remap(vertexCount);
+	TVector<uint8_t> touched(vertexCount);
+	TVector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	TVector<uint32_t> adjacency = {};
+	TVector<Collapse> collapses = {};
+
+	// Every pass collapses the cheapest independent edges, then rebuilds the triangle list
+	while (result.size() > targetIndexCount)
+	{
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0u);
+		for (uint32_t index : result)
+			adjacencyOffsets[index + 1]++;
+
+		for (size_t v = 0; v < vertexCount; v++)
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+		adjacency.resize(result.size());
+		TVector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < result.size(); i++)
+			adjacency[cursor[result[i]]++] = static_cast<uint32_t>(i / 3);
+
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (uint32_t e = 0; e < 3; e++)
+			{
+				uint32_t a = result[i + e];
+				uint32_t b = result[i + (e + 1) % 3];
+
+				if (!locked[a])
+					collapses.push_back({ a, b, evaluate(quadrics[a], vertices[b].position) + evaluate(quadrics[b], vertices[b].position) });
+
+				if (!locked[b])
+					collapses.push_back({ b, a, evaluate(quadrics[a], vertices[a].position) + evaluate(quadrics[b], vertices[a].position) });
+			}
+		}
+
+		if (collapses.empty())
+			break;
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& l, const Collapse& r) { return l.cost < r.cost; });
+
+		std::iota(remap.begin(), remap.end(), 0u);
+		std::fill(touched.begin(), touched.end(), uint8_t(0));
+
+		const size_t trianglesToRemove = (result.size() - targetIndexCount + 2) / 3;
+		size_t removed = 0;
+
+		for (const Collapse& collapse : collapses)
+		{
+			if (removed >= trianglesToRemove)
+				break;
+
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			const uint32_t* triangles = &adjacency[adjacencyOffsets[collapse.from]];
+			const size_t count = adjacencyOffsets[collapse.from + 1] - adjacencyOffsets[collapse.from];
+
+			if (flips(vertices, result, triangles, count, collapse.from, collapse.to))
+				continue;
+
+			remap[collapse.from] = collapse.to;
+			accumulate(quadrics[collapse.to], quadrics[collapse.from]);
+			maxError = glm::max(maxError, collapse.cost);
+
+			// Neighbourhood of the collapsed vertex is frozen for this pass, its flip tests would be stale otherwise
+			for (size_t t = 0; t < count; t++)
+			{
+				const uint32_t* tri = &result[triangles[t] * 3];
+				removed += (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) ? 1 : 0;
+
+				for (uint32_t k = 0; k < 3; k++)
+					touched[tri[k]] = 1;
+			}
+		}
+
+		if (removed == 0)
+			break;
+
+		size_t write = 0;
+		for (size_t i = 0; i + 2 < result.size(); i += 3)
+		{
+			uint32_t a = remap[result[i]];
+			uint32_t b = remap[result[i + 1]];
+			uint32_t c = remap[result[i + 2]];
+
+			if (a == b || b == c || a == c)
+				continue;
+
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	return static_cast<float>(glm::sqrt(maxError));
+}
+
+TVector<MeshLod> GRMeshLod::GenerateLods(const TVector<Vertex>& vertices, TVector<uint32_t>& indices, uint32_t lodCount)
+{
+	TVector<MeshLod> lods = { { 0u, static_cast<uint32_t>(indices.size()), 0.0f } };
+	const TVector<uint32_t> source = indices;
+	TVector<uint32_t> previous = indices;
+
+	// Every level is simplified from LOD0, so its error is measured against the full mesh
+	while (lods.size() < lodCount)
+	{
+		TVector<uint32_t> simplified = {};
+		const float error = Simplify(vertices, source, ((source.size() >> lods.size()) / 3) * 3, simplified);
+
+		// Level is not worth the memory if it removed less than a tenth of triangles
+		if (simplified.empty() || simplified.size() * 10 > previous.size() * 9)
+			break;
+
+		lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(simplified.size()), error });
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+		previous = std::move(simplified);
+	}
+
+	return lods;
+}
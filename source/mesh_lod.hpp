@@ -0,0 +1,32 @@
+#pragma once
+#include "pch.hpp"
+#include "vulkan_objects/mesh.hpp"
+
+namespace GRMeshLod
+{
+	/*
+	* !@brief Simplify triangle list with quadric error metric edge collapses.
+	* Vertices are only collapsed onto existing ones, so simplified indices reference the same vertex buffer.
+	* Vertices shared by several wedges (uv seams, submesh borders) and open boundaries are kept in place
+	*
+	* @param[in] vertices - vertex buffer referenced by indices
+	* @param[in] indices - triangle list to simplify
+	* @param[in] targetIndexCount - stop once the triangle list is not bigger than this
+	* @param[out] result - simplified triangle list
+	*
+	* @return Approximate geometric error introduced by the simplification in object space units
+	*/
+	float Simplify(const TVector<Vertex>& vertices, const TVector<uint32_t>& indices, size_t targetIndexCount, TVector<uint32_t>& result);
+	/*
+	* !@brief Build chain of simplified levels of detail, each one has about half the triangles of the previous.
+	* Every level is simplified from the full detail one, so its error is measured against it.
+	* Index lists of additional levels are appended to indices
+	*
+	* @param[in] vertices - vertex buffer referenced by indices
+	* @param[in] indices - triangle list of the full detail level, gets additional levels appended
+	* @param[in] lodCount - maximum amount of levels, including the original one
+	*
+	* @return Index ranges of all levels, chain stops early when mesh can't be simplified any further
+	*/
+	TVector<MeshLod> GenerateLods(const TVector<Vertex>& vertices, TVector<uint32_t>& indices, uint32_t lodCount);
+};
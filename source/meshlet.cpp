@@ -0,0 +1,183 @@
+#include "pch.hpp"
+#include "meshlet.hpp"
+#include <numeric>
+#include <algorithm>
+
+static const uint32_t maxMeshletVertices = 64u;
+static const uint32_t maxMeshletTriangles = 124u;
+
+static Meshlet compute_bounds(const TVector<Vertex>& vertices, const uint32_t* indices, uint32_t indexCount)
+{
+	Meshlet meshlet{};
+
+	TVec3 minBound = TVec3(std::numeric_limits<float>::max());
+	TVec3 maxBound = TVec3(std::numeric_limits<float>::lowest());
+	for (uint32_t i = 0; i < indexCount; i++) {
+		minBound = glm::min(minBound, vertices[indices[i]].position);
+		maxBound = glm::max(maxBound, vertices[indices[i]].position);
+	}
+
+	TVec3 center = (minBound + maxBound) * 0.5f;
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < indexCount; i++) {
+		radius = glm::max(radius, glm::distance(center, vertices[indices[i]].position));
+	}
+	meshlet.sphere = TVec4(center, radius);
+
+	TVector<TVec3> normals = {};
+	TVec3 axis = TVec3(0.0);
+	for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		const TVec3& p0 = vertices[indices[i]].position;
+		TVec3 n = glm::cross(vertices[indices[i + 1]].position - p0, vertices[indices[i + 2]].position - p0);
+		float length = glm::length(n);
+
+		if (length > 0.0f) {
+			normals.push_back(n / length);
+			axis += normals.back();
+		}
+	}
+
+	// Cone with the sine of its spread in w, one means the cluster can face any direction
+	meshlet.cone = TVec4(0.0, 0.0, 0.0, 1.0);
+	if (glm::length(axis) > 1e-6f)
+	{
+		axis = glm::normalize(axis);
+
+		float minDot = 1.0f;
+		for (const TVec3& n : normals) {
+			minDot = glm::min(minDot, glm::dot(n, axis));
+		}
+
+		if (minDot > 0.0f) {
+			meshlet.cone = TVec4(axis, glm::sqrt(1.0f - minDot * minDot));
+		}
+	}
+
+	return meshlet;
+}
+
+static void build_range(const TVector<Vertex>& vertices, TVector<uint32_t>& indices, uint32_t firstIndex, uint32_t indexCount, TVector<Meshlet>& meshlets)
+{
+	const uint32_t triangleCount = indexCount / 3;
+	const uint32_t* triangles = indices.data() + firstIndex;
+
+	TVector<uint32_t> adjacencyOffsets(vertices.size() + 1, 0u);
+	for (uint32_t i = 0; i < triangleCount * 3; i++)
+		adjacencyOffsets[triangles[i] + 1]++;
+
+	for (size_t v = 0; v < vertices.size(); v++)
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+	TVector<uint32_t> adjacency(triangleCount * 3);
+	TVector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (uint32_t i = 0; i < triangleCount * 3; i++)
+		adjacency[cursor[triangles[i]]++] = i / 3;
+
+	TVector<uint8_t> emitted(triangleCount, 0);
+	TVector<uint32_t> vertexTag(vertices.size(), UINT32_MAX);
+	TVector<uint32_t> candidates = {};
+	TVector<uint32_t> ordered = {};
+	ordered.reserve(triangleCount * 3);
+
+	uint32_t seed = 0;
+	uint32_t meshletId = 0;
+
+	// Grow every meshlet from a seed triangle, preferring neighbours which add the fewest new vertices
+	while (true)
+	{
+		while (seed < triangleCount && emitted[seed])
+			seed++;
+
+		if (seed == triangleCount)
+			break;
+
+		const uint32_t first = static_cast<uint32_t>(ordered.size());
+		uint32_t vertexCount = 0;
+		uint32_t count = 0;
+		uint32_t next = seed;
+		candidates.clear();
+
+		while (next != UINT32_MAX)
+		{
+			emitted[next] = 1;
+			count++;
+
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t v = triangles[next * 3 + k];
+				ordered.push_back(v);
+
+				if (vertexTag[v] != meshletId) {
+					vertexTag[v] = meshletId;
+					vertexCount++;
+				}
+
+				for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; a++) {
+					if (!emitted[adjacency[a]])
+						candidates.push_back(adjacency[a]);
+				}
+			}
+
+			std::erase_if(candidates, [&](uint32_t t) { return emitted[t] != 0; });
+
+			next = UINT32_MAX;
+			if (count == maxMeshletTriangles)
+				break;
+
+			uint32_t bestCost = UINT32_MAX;
+			for (uint32_t t : candidates)
+			{
+				uint32_t cost = 0;
+				for (uint32_t k = 0; k < 3; k++)
+					cost += vertexTag[triangles[t * 3 + k]] != meshletId ? 1 : 0;
+
+				if (vertexCount + cost <= maxMeshletVertices && cost < bestCost) {
+					bestCost = cost;
+					next = t;
+				}
+
+				if (bestCost == 0)
+					break;
+			}
+
+			// Disconnected pieces (e.g. flat shaded meshes) continue with the next triangle in original order
+			if (candidates.empty())
+			{
+				while (seed < triangleCount && emitted[seed])
+					seed++;
+
+				if (seed < triangleCount)
+				{
+					uint32_t cost = 0;
+					for (uint32_t k = 0; k < 3; k++)
+						cost += vertexTag[triangles[seed * 3 + k]] != meshletId ? 1 : 0;
+
+					next = vertexCount + cost <= maxMeshletVertices ? seed : UINT32_MAX;
+				}
+			}
+		}
+
+		Meshlet meshlet = compute_bounds(vertices, ordered.data() + first, count * 3);
+		meshlet.firstIndex = firstIndex + first;
+		meshlet.indexCount = count * 3;
+		meshlets.push_back(meshlet);
+		meshletId++;
+	}
+
+	std::copy(ordered.begin(), ordered.end(), indices.begin() + firstIndex);
+}
+
+TVector<Meshlet> GRMeshlet::Build(const TVector<Vertex>& vertices, TVector<uint32_t>& indices, TVector<MeshLod>& lods)
+{
+	TVector<Meshlet> meshlets = {};
+
+	for (MeshLod& lod : lods)
+	{
+		lod.firstMeshlet = static_cast<uint32_t>(meshlets.size());
+		build_range(vertices, indices, lod.firstIndex, lod.indexCount, meshlets);
+		lod.meshletCount = static_cast<uint32_t>(meshlets.size()) - lod.firstMeshlet;
+	}
+
+	return meshlets;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "pch.hpp"
+#include "vulkan_objects/mesh.hpp"
+
+namespace GRMeshlet
+{
+	/*
+	* !@brief Partition every level of detail into clusters of spatially close triangles.
+	* Triangles of each level are reordered in place, so every meshlet covers a contiguous index range
+	*
+	* @param[in] vertices - vertex buffer referenced by indices
+	* @param[in] indices - triangle lists of all levels of detail, reordered by meshlets
+	* @param[in] lods - index ranges of levels of detail, receive their meshlet ranges
+	*
+	* @return Meshlets of all levels with bounding spheres and normal cones in object space
+	*/
+	TVector<Meshlet> Build(const TVector<Vertex>& vertices, TVector<uint32_t>& indices, TVector<MeshLod>& lods);
+};
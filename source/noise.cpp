@@ -1,15 +1,132 @@
 #include "pch.hpp"
 #include "noise.hpp"
-#include "vulkan_objects/pipeline.hpp"
-#include "vulkan_objects/descriptor_set.hpp"
+
+#include <glm/gtc/packing.hpp>
+#include <filesystem>
+#include <cstring>
+
+extern std::string exec_path;
 
 extern TAuto<VulkanImage> create_image(const RenderScope& Scope, void* pixels, int count, int w, int h, const VkFormat& format, const VkImageCreateFlags& flags);
 
-TAuto<VulkanImage> generate(const char* shader, const RenderScope& Scope, VkFormat format, VkExtent3D imageSize, TVector<uint32_t> constants)
+static const uint32_t noiseCacheMagic = 0x5a4e5247u; // "GRNZ"
+static const uint32_t noiseCacheVersion = 1u;
+
+struct NoiseCacheHeader
+{
+	uint32_t magic = noiseCacheMagic;
+	uint32_t version = noiseCacheVersion;
+	uint64_t key = 0;
+	uint64_t size = 0;
+};
+/*
+* !@brief Hash of everything a noise image depends on, 0 if the shader binary is missing
+*/
+static uint64_t noise_cache_key(const ShaderRegistry& registry, const char* shader, VkFormat format, const VkExtent3D& imageSize, const TVector<uint32_t>& constants)
+{
+	const uint64_t shaderHash = registry.GetHash(shader);
+	if (shaderHash == 0)
+		return 0;
+
+	uint64_t hash = ::Fnv1a(FNV1A_OFFSET, &shaderHash, sizeof(uint64_t));
+	hash = ::Fnv1a(hash, &format, sizeof(VkFormat));
+	hash = ::Fnv1a(hash, &imageSize, sizeof(VkExtent3D));
+
+	return ::Fnv1a(hash, constants.data(), constants.size() * sizeof(uint32_t));
+}
+
+static VkDeviceSize texel_size(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8_UNORM:
+		return 1u;
+	case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+	case VK_FORMAT_R8G8B8A8_UNORM:
+		return 4u;
+	default:
+		assert(false && "Unsupported noise format");
+		return 0u;
+	}
+}
+
+static std::string noise_cache_path(uint64_t key)
+{
+	return exec_path + "cache\\noise_" + std::to_string(key) + ".bin";
+}
+/*
+* !@brief Append cached texels of the image to texels
+*
+* @return VK_TRUE if the cache matches the key and size, texels are left untouched otherwise
+*/
+static VkBool32 read_noise_cache(uint64_t key, VkDeviceSize size, TVector<char>& texels)
+{
+	std::ifstream cacheFile(noise_cache_path(key), std::ios::binary);
+	if (!cacheFile.is_open())
+		return 0;
+
+	NoiseCacheHeader header{};
+	cacheFile.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!cacheFile || header.magic != noiseCacheMagic || header.version != noiseCacheVersion || header.key != key || header.size != size)
+		return 0;
+
+	const size_t offset = texels.size();
+	texels.resize(offset + size);
+	cacheFile.read(texels.data() + offset, size);
+
+	if (!cacheFile) {
+		texels.resize(offset);
+		return 0;
+	}
+
+	return 1;
+}
+
+static void write_noise_cache(uint64_t key, const char* texels, VkDeviceSize size)
+{
+	NoiseCacheHeader header{};
+	header.key = key;
+	header.size = size;
+
+	// A missing cache only costs a regeneration on the next launch, so failures are ignored
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(noise_cache_path(key)).parent_path(), error);
+
+	std::ofstream cacheFile(noise_cache_path(key), std::ios::binary | std::ios::trunc);
+	if (cacheFile.is_open())
+	{
+		cacheFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		cacheFile.write(texels, size);
+	}
+}
+
+GRNoise::NoiseBatch::NoiseBatch(const RenderScope& InScope) : Scope(&InScope)
+{
+	Scope->GetQueue(VK_QUEUE_COMPUTE_BIT)
+		.AllocateCommandBuffers(1, &computeCmd);
+	Scope->GetQueue(VK_QUEUE_GRAPHICS_BIT)
+		.AllocateCommandBuffers(1, &graphicsCmd);
+
+	::BeginOneTimeSubmitCmd(computeCmd);
+	::BeginOneTimeSubmitCmd(graphicsCmd);
+}
+
+GRNoise::NoiseBatch::~NoiseBatch()
+{
+	if (!images.empty())
+		Submit();
+
+	Scope->GetQueue(VK_QUEUE_COMPUTE_BIT)
+		.FreeCommandBuffers(1, &computeCmd);
+	Scope->GetQueue(VK_QUEUE_GRAPHICS_BIT)
+		.FreeCommandBuffers(1, &graphicsCmd);
+}
+
+TAuto<VulkanImage> GRNoise::NoiseBatch::Add(const char* shader, VkFormat format, VkExtent3D imageSize, const TVector<uint32_t>& constants)
 {
 	TVector<uint32_t> queueFamilyIndices;
-	queueFamilyIndices.push_back(Scope.GetQueue(VK_QUEUE_GRAPHICS_BIT).GetFamilyIndex());
-	queueFamilyIndices.push_back(Scope.GetQueue(VK_QUEUE_COMPUTE_BIT).GetFamilyIndex());
+	queueFamilyIndices.push_back(Scope->GetQueue(VK_QUEUE_GRAPHICS_BIT).GetFamilyIndex());
+	queueFamilyIndices.push_back(Scope->GetQueue(VK_QUEUE_COMPUTE_BIT).GetFamilyIndex());
 	VkImageCreateInfo noiseInfo{};
 	noiseInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	noiseInfo.arrayLayers = 1u;
@@ -37,15 +154,30 @@ TAuto<VulkanImage> generate(const char* shader, const RenderScope& Scope, VkForm
 	noiseImageView.subresourceRange.layerCount = 1u;
 	noiseImageView.subresourceRange.levelCount = 1u;
 
-	TAuto<VulkanImage> noise = std::make_unique<VulkanImage>(Scope);
+	TAuto<VulkanImage> noise = std::make_unique<VulkanImage>(*Scope);
 	noise->CreateImage(noiseInfo, noiseAllocCreateInfo)
 		.CreateImageView(noiseImageView)
 		.CreateSampler(ESamplerType::LinearRepeat)
-		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+		.TransitionLayout(computeCmd, VK_IMAGE_LAYOUT_GENERAL);
+
+	CachedImage cached{};
+	cached.image = noise.get();
+	cached.key = noise_cache_key(Scope->GetShaderRegistry(), shader, format, imageSize, constants);
+	cached.offset = uploadTexels.size();
+	cached.size = texel_size(format) * imageSize.width * imageSize.height * imageSize.depth;
+	cached.loaded = cached.key != 0 && read_noise_cache(cached.key, cached.size, uploadTexels);
+
+	if (cached.loaded)
+	{
+		noise->GenerateMipMaps(graphicsCmd);
+		images.push_back(cached);
+
+		return noise;
+	}
 
 	ComputePipelineDescriptor noise_pipeline{};
 	TAuto<DescriptorSet> noise_set = DescriptorSetDescriptor().AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *noise)
-		.Allocate(Scope);
+		.Allocate(*Scope);
 	noise_pipeline.SetShaderName(shader) 
 		.AddDescriptorLayout(noise_set->GetLayout());
 
@@ -53,26 +185,190 @@ TAuto<VulkanImage> generate(const char* shader, const RenderScope& Scope, VkForm
 		noise_pipeline.AddSpecializationConstant(i, constants[i]);
 	}
 
-	TAuto<Pipeline> pipeline = noise_pipeline.Construct(Scope);
+	TAuto<Pipeline> pipeline = noise_pipeline.Construct(*Scope);
+
+	// Shaders run 8x8x4 tiles over 3D images and 8x8x1 over 2D ones
+	const uint32_t tileDepth = imageSize.depth == 1u ? 1u : 4u;
 
-	VkCommandBuffer cmd;
-	Scope.GetQueue(VK_QUEUE_COMPUTE_BIT)
-		.AllocateCommandBuffers(1, &cmd);
-	::BeginOneTimeSubmitCmd(cmd);
-	pipeline->BindPipeline(cmd);
-	noise_set->BindSet(0, cmd, *pipeline);
-	vkCmdDispatch(cmd, noise->GetExtent().width, noise->GetExtent().height, noise->GetExtent().depth);
-	::EndCommandBuffer(cmd);
-	Scope.GetQueue(VK_QUEUE_COMPUTE_BIT)
-		.Submit(cmd)
-		.Wait()
-		.FreeCommandBuffers(1, &cmd);
+	pipeline->BindPipeline(computeCmd);
+	noise_set->BindSet(0, computeCmd, *pipeline);
+	vkCmdDispatch(computeCmd, (imageSize.width + 7u) / 8u, (imageSize.height + 7u) / 8u, (imageSize.depth + tileDepth - 1u) / tileDepth);
 
-	noise->GenerateMipMaps();
+	noise->GenerateMipMaps(graphicsCmd);
+
+	sets.push_back(std::move(noise_set));
+	pipelines.push_back(std::move(pipeline));
+	images.push_back(cached);
 
 	return noise;
 }
 
+void GRNoise::NoiseBatch::Submit()
+{
+	TAuto<Buffer> staging = VK_NULL_HANDLE;
+	if (!uploadTexels.empty())
+	{
+		VkBufferCreateInfo stagingInfo{};
+		stagingInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		stagingInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		stagingInfo.size = uploadTexels.size();
+		stagingInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		VmaAllocationCreateInfo stagingAlloc{};
+		stagingAlloc.usage = VMA_MEMORY_USAGE_AUTO;
+		stagingAlloc.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+
+		staging = std::make_unique<Buffer>(*Scope, stagingInfo, stagingAlloc);
+		staging->Update(uploadTexels.data(), uploadTexels.size());
+	}
+
+	VkDeviceSize readbackSize = 0;
+	for (CachedImage& cached : images)
+	{
+		if (cached.loaded || cached.key == 0)
+			continue;
+
+		cached.offset = readbackSize;
+		readbackSize += cached.size;
+	}
+
+	TAuto<Buffer> readback = VK_NULL_HANDLE;
+	if (readbackSize > 0)
+	{
+		VkBufferCreateInfo readbackInfo{};
+		readbackInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		readbackInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		readbackInfo.size = readbackSize;
+		readbackInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		VmaAllocationCreateInfo readbackAlloc{};
+		readbackAlloc.usage = VMA_MEMORY_USAGE_AUTO;
+		readbackAlloc.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+
+		readback = std::make_unique<Buffer>(*Scope, readbackInfo, readbackAlloc);
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(computeCmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+	}
+
+	for (const CachedImage& cached : images)
+	{
+		if (!cached.loaded && cached.key == 0)
+			continue;
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = cached.offset;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = cached.image->GetExtent();
+
+		if (cached.loaded)
+			vkCmdCopyBufferToImage(computeCmd, staging->GetBuffer(), cached.image->GetImage(), VK_IMAGE_LAYOUT_GENERAL, 1u, &region);
+		else
+			vkCmdCopyImageToBuffer(computeCmd, cached.image->GetImage(), VK_IMAGE_LAYOUT_GENERAL, readback->GetBuffer(), 1u, &region);
+	}
+
+	if (readbackSize > 0)
+	{
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(computeCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+	}
+
+	::EndCommandBuffer(computeCmd);
+	::EndCommandBuffer(graphicsCmd);
+
+	const Queue& computeQueue = Scope->GetQueue(VK_QUEUE_COMPUTE_BIT);
+	const Queue& graphicsQueue = Scope->GetQueue(VK_QUEUE_GRAPHICS_BIT);
+
+	const Queue::Ticket dispatches = computeQueue.Submit(computeCmd);
+
+	// Transitions and mips of the whole batch wait for the dispatches at once
+	Queue::Batch graphicsBatch{};
+	graphicsBatch.commandBuffers = { graphicsCmd };
+	graphicsBatch.waits = { computeQueue.WaitInfo(dispatches, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT) };
+	graphicsQueue.Wait(graphicsQueue.Submit({ graphicsBatch }));
+
+	if (readbackSize > 0)
+	{
+		TVector<char> texels(readbackSize);
+		readback->Read(texels.data(), readbackSize);
+
+		for (const CachedImage& cached : images)
+		{
+			if (!cached.loaded && cached.key != 0)
+				write_noise_cache(cached.key, texels.data() + cached.offset, cached.size);
+		}
+	}
+
+	sets.clear();
+	pipelines.clear();
+	images.clear();
+	uploadTexels.clear();
+
+	// Submitted buffers are recycled by the queues, the next batch records into new ones
+	computeQueue.AllocateCommandBuffers(1, &computeCmd);
+	graphicsQueue.AllocateCommandBuffers(1, &graphicsCmd);
+	::BeginOneTimeSubmitCmd(computeCmd);
+	::BeginOneTimeSubmitCmd(graphicsCmd);
+}
+
+static TAuto<VulkanImage> generate(const char* shader, const RenderScope& Scope, VkFormat format, VkExtent3D imageSize, TVector<uint32_t> constants, GRNoise::NoiseBatch* batch)
+{
+	if (batch != VK_NULL_HANDLE)
+		return batch->Add(shader, format, imageSize, constants);
+
+	GRNoise::NoiseBatch single(Scope);
+	TAuto<VulkanImage> noise = single.Add(shader, format, imageSize, constants);
+	single.Submit();
+
+	return noise;
+}
+
+static TVec4 decode_texel(VkFormat format, const char* texel)
+{
+	uint32_t packed = 0u;
+	memcpy(&packed, texel, texel_size(format));
+
+	switch (format)
+	{
+	case VK_FORMAT_R8_UNORM:
+		return TVec4(float(packed & 0xFFu) / 255.f, 0.f, 0.f, 0.f);
+	case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+		return TVec4(glm::unpackF2x11_1x10(packed), 0.f);
+	case VK_FORMAT_R8G8B8A8_UNORM:
+		return glm::unpackUnorm4x8(packed);
+	default:
+		return TVec4(0.f);
+	}
+}
+
+uint32_t GRNoise::CompareWithCache(const RenderScope& Scope, const char* shader, VkFormat format, VkExtent3D imageSize, const TVector<uint32_t>& constants, const TVector<char>& baked, uint32_t samples, float tolerance)
+{
+	const uint64_t key = noise_cache_key(Scope.GetShaderRegistry(), shader, format, imageSize, constants);
+	const VkDeviceSize texel = texel_size(format);
+	const VkDeviceSize count = (VkDeviceSize)imageSize.width * imageSize.height * imageSize.depth;
+
+	TVector<char> cached = {};
+	if (key == 0 || baked.size() != count * texel || !read_noise_cache(key, count * texel, cached))
+		return UINT32_MAX;
+
+	const VkDeviceSize stride = std::max<VkDeviceSize>(count / std::max(samples, 1u), 1u);
+
+	uint32_t mismatches = 0u;
+	for (VkDeviceSize i = 0; i < count && samples > 0; i += stride, samples--) {
+		const TVec4 difference = glm::abs(decode_texel(format, cached.data() + i * texel) - decode_texel(format, baked.data() + i * texel));
+		mismatches += glm::any(glm::greaterThan(difference, TVec4(tolerance)));
+	}
+
+	return mismatches;
+}
+
 TAuto<VulkanImage> GRNoise::GenerateSolidColor(const RenderScope& Scope, VkExtent2D imageSize, VkFormat Format, std::byte r, std::byte g, std::byte b, std::byte a)
 {
 	std::byte* pixels = new std::byte[imageSize.width * imageSize.height * 4];
@@ -94,36 +390,32 @@ TAuto<VulkanImage> GRNoise::GenerateSolidColor(const RenderScope& Scope, VkExten
 	return target;
 }
 
-TAuto<VulkanImage> GRNoise::GeneratePerlin(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t octaves)
+TAuto<VulkanImage> GRNoise::GeneratePerlin(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t octaves, uint32_t seed, NoiseBatch* batch)
 {
-	return generate("perlin_comp", Scope, VK_FORMAT_R8_UNORM, imageSize, { frequency, octaves });
+	return generate("perlin_comp", Scope, VK_FORMAT_R8_UNORM, imageSize, { frequency, octaves, seed }, batch);
 }
 
-TAuto<VulkanImage> GRNoise::GenerateWorley(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t octaves)
+TAuto<VulkanImage> GRNoise::GenerateWorley(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t octaves, uint32_t seed, NoiseBatch* batch)
 {
-	return generate("worley_comp", Scope, VK_FORMAT_R8_UNORM, imageSize, { frequency, octaves });
+	return generate("worley_comp", Scope, VK_FORMAT_R8_UNORM, imageSize, { frequency, octaves, seed }, batch);
 }
 
-TAuto<VulkanImage> GRNoise::GenerateWorleyPerlin(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t worley_octaves, uint32_t perlin_octaves)
+TAuto<VulkanImage> GRNoise::GenerateWorleyPerlin(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t worley_octaves, uint32_t perlin_octaves, uint32_t seed, NoiseBatch* batch)
 {
-	return generate("worley_perlin_comp", Scope, VK_FORMAT_R8_UNORM, imageSize, { frequency, worley_octaves, perlin_octaves });
+	return generate("worley_perlin_comp", Scope, VK_FORMAT_R8_UNORM, imageSize, { frequency, worley_octaves, perlin_octaves, seed }, batch);
 }
 
-TAuto<VulkanImage> GRNoise::GenerateCloudShapeNoise(const RenderScope& Scope, VkExtent3D imageSize, uint32_t worley_frequency, uint32_t perlin_frequency)
+TAuto<VulkanImage> GRNoise::GenerateCloudShapeNoise(const RenderScope& Scope, VkExtent3D imageSize, uint32_t worley_frequency, uint32_t perlin_frequency, uint32_t seed, NoiseBatch* batch)
 {
-	uint32_t seed = 0;
-	seed = (uint32_t)&seed;
-	return generate("cloud_shape_comp", Scope, VK_FORMAT_R8_UNORM, imageSize, { worley_frequency, perlin_frequency, seed });
+	return generate("cloud_shape_comp", Scope, VK_FORMAT_R8_UNORM, imageSize, { worley_frequency, perlin_frequency, seed }, batch);
 }
 
-TAuto<VulkanImage> GRNoise::GenerateCloudDetailNoise(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t octaves)
+TAuto<VulkanImage> GRNoise::GenerateCloudDetailNoise(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t octaves, uint32_t seed, NoiseBatch* batch)
 {
-	uint32_t seed = 0;
-	seed = (uint32_t)&seed;
-	return generate("cloud_detail_comp", Scope, VK_FORMAT_B10G11R11_UFLOAT_PACK32, imageSize, { frequency, octaves, seed });
+	return generate("cloud_detail_comp", Scope, VK_FORMAT_B10G11R11_UFLOAT_PACK32, imageSize, { frequency, octaves, seed }, batch);
 }
 
-TAuto<VulkanImage> GRNoise::GenerateCheckerBoard(const RenderScope& Scope, VkExtent2D imageSize, uint32_t frequency)
+TAuto<VulkanImage> GRNoise::GenerateCheckerBoard(const RenderScope& Scope, VkExtent2D imageSize, uint32_t frequency, NoiseBatch* batch)
 {
-	return generate("checkerboard", Scope, VK_FORMAT_R8_UNORM, { imageSize.width, imageSize.height, 1u }, { frequency });
+	return generate("checkerboard", Scope, VK_FORMAT_R8_UNORM, { imageSize.width, imageSize.height, 1u }, { frequency }, batch);
 }
\ No newline at end of file
@@ -1,19 +1,114 @@
+#pragma once
 #include "scope.hpp"
 #include "vulkan_objects/image.hpp"
+#include "vulkan_objects/pipeline.hpp"
+#include "vulkan_objects/descriptor_set.hpp"
+#include "vulkan_objects/buffer.hpp"
 
 namespace GRNoise
 {
-	TAuto<VulkanImage> GeneratePerlin(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t octaves);
+	/*
+	* !@brief Records generation of several noise images into one compute submission, layout transitions
+	* and mips of every image are recorded into one graphics submission executed right after it.
+	* Generated images are cached on disk keyed by shader binary, format, extent and constants (seed included),
+	* cached images are uploaded from a single staging buffer instead of being generated.
+	* Images returned by Add or by Generate* functions taking a batch are valid after Submit.
+	*/
+	class NoiseBatch
+	{
+	public:
+		NoiseBatch(const RenderScope& Scope);
 
-	TAuto<VulkanImage> GenerateWorley(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t octaves);
+		~NoiseBatch();
 
-	TAuto<VulkanImage> GenerateWorleyPerlin(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t worley_octaves, uint32_t perlin_octaves);
+		NoiseBatch(const NoiseBatch& other) = delete;
 
-	TAuto<VulkanImage> GenerateCloudShapeNoise(const RenderScope& Scope, VkExtent3D imageSize, uint32_t worley_frequency, uint32_t perlin_frequency);
+		void operator=(const NoiseBatch& other) = delete;
+		/*
+		* !@brief Create the image and record its generation
+		*
+		* @param[in] shader - compute shader name, 8x8x4 workgroups are dispatched over the image
+		* @param[in] format - image format, has to support storage usage
+		* @param[in] imageSize - image extent, 2D image is created if depth is 1
+		* @param[in] constants - specialization constants of the shader, in order of constant_id
+		*/
+		TAuto<VulkanImage> Add(const char* shader, VkFormat format, VkExtent3D imageSize, const TVector<uint32_t>& constants);
+		/*
+		* !@brief Submit every recorded image and wait for completion
+		*/
+		void Submit();
 
-	TAuto<VulkanImage> GenerateCloudDetailNoise(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t octaves);
+	private:
+		struct CachedImage
+		{
+			VulkanImage* image = VK_NULL_HANDLE;
+			uint64_t key = 0;
+			VkDeviceSize offset = 0;
+			VkDeviceSize size = 0;
+			VkBool32 loaded = 0;
+		};
 
-	TAuto<VulkanImage> GenerateCheckerBoard(const RenderScope& Scope, VkExtent2D imageSize, uint32_t frequency);
+		TVector<CachedImage> images = {};
+		TVector<char> uploadTexels = {};
+
+		TVector<TAuto<DescriptorSet>> sets = {};
+		TVector<TAuto<Pipeline>> pipelines = {};
+
+		VkCommandBuffer computeCmd = VK_NULL_HANDLE;
+		VkCommandBuffer graphicsCmd = VK_NULL_HANDLE;
+
+		const RenderScope* Scope = VK_NULL_HANDLE;
+	};
+
+	TAuto<VulkanImage> GeneratePerlin(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t octaves, uint32_t seed, NoiseBatch* batch = VK_NULL_HANDLE);
+
+	TAuto<VulkanImage> GenerateWorley(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t octaves, uint32_t seed, NoiseBatch* batch = VK_NULL_HANDLE);
+
+	TAuto<VulkanImage> GenerateWorleyPerlin(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t worley_octaves, uint32_t perlin_octaves, uint32_t seed, NoiseBatch* batch = VK_NULL_HANDLE);
+
+	TAuto<VulkanImage> GenerateCloudShapeNoise(const RenderScope& Scope, VkExtent3D imageSize, uint32_t worley_frequency, uint32_t perlin_frequency, uint32_t seed, NoiseBatch* batch = VK_NULL_HANDLE);
+
+	TAuto<VulkanImage> GenerateCloudDetailNoise(const RenderScope& Scope, VkExtent3D imageSize, uint32_t frequency, uint32_t octaves, uint32_t seed, NoiseBatch* batch = VK_NULL_HANDLE);
+
+	TAuto<VulkanImage> GenerateCheckerBoard(const RenderScope& Scope, VkExtent2D imageSize, uint32_t frequency, NoiseBatch* batch = VK_NULL_HANDLE);
+
+	/*
+	* !@brief Compare evenly spaced texels of a CPU bake with the GPU image stored in the noise cache by a NoiseBatch.
+	* Texels are decoded before comparison, the CPU port is only expected to match the shaders within a tolerance
+	*
+	* @param[in] shader, format, imageSize, constants - parameters the image was generated with, as passed to NoiseBatch::Add
+	* @param[in] baked - texels produced by the matching Bake* function
+	* @param[in] samples - number of texels to compare
+	* @param[in] tolerance - largest absolute difference of a decoded channel counted as a match
+	*
+	* @return Number of compared texels that exceed the tolerance, UINT32_MAX if the cache holds no such image
+	*/
+	uint32_t CompareWithCache(const RenderScope& Scope, const char* shader, VkFormat format, VkExtent3D imageSize, const TVector<uint32_t>& constants, const TVector<char>& baked, uint32_t samples, float tolerance);
 
 	TAuto<VulkanImage> GenerateSolidColor(const RenderScope& Scope, VkExtent2D imageSize, VkFormat Format, std::byte r = std::byte(0), std::byte g = std::byte(0), std::byte b = std::byte(0), std::byte a = std::byte(0));
+
+	/*
+	* !@brief CPU versions of noise.glsl functions for offline baking and validation of the compute shaders.
+	* Hashes match the shaders bit for bit, float results may differ in the last bits where the GPU
+	* rounds division, square root or fused multiply-add differently.
+	*/
+	float Worley(const TVec3& p, float frequency, uint32_t seed);
+
+	float Perlin(const TVec3& p, float frequency, uint32_t seed);
+
+	float FbmWorley(const TVec3& p, float frequency, uint32_t octaves, uint32_t seed);
+
+	float FbmPerlin(const TVec3& p, float frequency, uint32_t octaves, uint32_t seed);
+	/*
+	* !@brief Bake texels of the matching Generate* image on CPU, four texels at a time and threaded over z slices
+	*
+	* @return Tightly packed texels in the image format, same layout as the noise cache
+	*/
+	TVector<char> BakePerlin(VkExtent3D imageSize, uint32_t frequency, uint32_t octaves, uint32_t seed);
+
+	TVector<char> BakeWorley(VkExtent3D imageSize, uint32_t frequency, uint32_t octaves, uint32_t seed);
+
+	TVector<char> BakeCloudShapeNoise(VkExtent3D imageSize, uint32_t worley_frequency, uint32_t perlin_frequency, uint32_t seed);
+
+	TVector<char> BakeCloudDetailNoise(VkExtent3D imageSize, uint32_t frequency, uint32_t octaves, uint32_t seed);
 };
\ No newline at end of file
@@ -0,0 +1,355 @@
+#include "pch.hpp"
+#include "noise.hpp"
+#include <glm/gtc/packing.hpp>
+#include <thread>
+
+#if defined(__SSE4_1__) || defined(_M_X64) || defined(__AVX__)
+#define GR_NOISE_SSE 1
+#include <immintrin.h>
+#else
+#define GR_NOISE_SSE 0
+#endif
+
+// Four lanes of float/uint math, SSE4.1 when available and plain arrays otherwise.
+// Every operation rounds exactly like its GLSL counterpart executed in IEEE single precision.
+namespace
+{
+#if GR_NOISE_SSE
+	struct F4 { __m128 v; };
+	struct U4 { __m128i v; };
+
+	inline F4 f4(float x) { return { _mm_set1_ps(x) }; }
+	inline F4 f4(float x, float y, float z, float w) { return { _mm_setr_ps(x, y, z, w) }; }
+	inline U4 u4(uint32_t x) { return { _mm_set1_epi32((int)x) }; }
+
+	inline F4 operator+(F4 a, F4 b) { return { _mm_add_ps(a.v, b.v) }; }
+	inline F4 operator-(F4 a, F4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+	inline F4 operator*(F4 a, F4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+	inline F4 operator/(F4 a, F4 b) { return { _mm_div_ps(a.v, b.v) }; }
+	inline F4 min(F4 a, F4 b) { return { _mm_min_ps(a.v, b.v) }; }
+	inline F4 max(F4 a, F4 b) { return { _mm_max_ps(a.v, b.v) }; }
+	inline F4 floor(F4 a) { return { _mm_floor_ps(a.v) }; }
+	inline F4 sqrt(F4 a) { return { _mm_sqrt_ps(a.v) }; }
+
+	inline U4 operator+(U4 a, U4 b) { return { _mm_add_epi32(a.v, b.v) }; }
+	inline U4 operator*(U4 a, U4 b) { return { _mm_mullo_epi32(a.v, b.v) }; }
+	inline U4 operator^(U4 a, U4 b) { return { _mm_xor_si128(a.v, b.v) }; }
+	inline U4 operator>>(U4 a, int s) { return { _mm_srli_epi32(a.v, s) }; }
+
+	inline U4 operator>>(U4 a, U4 s)
+	{
+#if defined(__AVX2__)
+		return { _mm_srlv_epi32(a.v, s.v) };
+#else
+		alignas(16) uint32_t va[4], vs[4];
+		_mm_store_si128((__m128i*)va, a.v);
+		_mm_store_si128((__m128i*)vs, s.v);
+		return { _mm_setr_epi32((int)(va[0] >> vs[0]), (int)(va[1] >> vs[1]), (int)(va[2] >> vs[2]), (int)(va[3] >> vs[3])) };
+#endif
+	}
+	// Inputs are non-negative lattice coordinates, truncation matches uvec3(p)
+	inline U4 to_uint(F4 a) { return { _mm_cvttps_epi32(a.v) }; }
+	// Unsigned conversion split in two exact halves so the final sum rounds once, like uint to float
+	inline F4 to_float(U4 a)
+	{
+		const __m128 hi = _mm_cvtepi32_ps(_mm_srli_epi32(a.v, 16));
+		const __m128 lo = _mm_cvtepi32_ps(_mm_and_si128(a.v, _mm_set1_epi32(0xffff)));
+		return { _mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0f)), lo) };
+	}
+
+	inline void store(F4 a, float* out) { _mm_storeu_ps(out, a.v); }
+#else
+	struct F4 { float v[4]; };
+	struct U4 { uint32_t v[4]; };
+
+	inline F4 f4(float x) { return { x, x, x, x }; }
+	inline F4 f4(float x, float y, float z, float w) { return { x, y, z, w }; }
+	inline U4 u4(uint32_t x) { return { x, x, x, x }; }
+
+#define GR_LANES(T, expr) T r; for (int l = 0; l < 4; l++) { r.v[l] = expr; } return r;
+	inline F4 operator+(F4 a, F4 b) { GR_LANES(F4, a.v[l] + b.v[l]) }
+	inline F4 operator-(F4 a, F4 b) { GR_LANES(F4, a.v[l] - b.v[l]) }
+	inline F4 operator*(F4 a, F4 b) { GR_LANES(F4, a.v[l] * b.v[l]) }
+	inline F4 operator/(F4 a, F4 b) { GR_LANES(F4, a.v[l] / b.v[l]) }
+	inline F4 min(F4 a, F4 b) { GR_LANES(F4, std::min(a.v[l], b.v[l])) }
+	inline F4 max(F4 a, F4 b) { GR_LANES(F4, std::max(a.v[l], b.v[l])) }
+	inline F4 floor(F4 a) { GR_LANES(F4, std::floor(a.v[l])) }
+	inline F4 sqrt(F4 a) { GR_LANES(F4, std::sqrt(a.v[l])) }
+
+	inline U4 operator+(U4 a, U4 b) { GR_LANES(U4, a.v[l] + b.v[l]) }
+	inline U4 operator*(U4 a, U4 b) { GR_LANES(U4, a.v[l] * b.v[l]) }
+	inline U4 operator^(U4 a, U4 b) { GR_LANES(U4, a.v[l] ^ b.v[l]) }
+	inline U4 operator>>(U4 a, int s) { GR_LANES(U4, a.v[l] >> s) }
+	inline U4 operator>>(U4 a, U4 s) { GR_LANES(U4, a.v[l] >> s.v[l]) }
+
+	inline U4 to_uint(F4 a) { GR_LANES(U4, (uint32_t)a.v[l]) }
+	inline F4 to_float(U4 a) { GR_LANES(F4, (float)a.v[l]) }
+#undef GR_LANES
+
+	inline void store(F4 a, float* out) { std::copy(a.v, a.v + 4, out); }
+#endif
+
+	inline F4 fract(F4 a) { return a - floor(a); }
+	inline F4 clamp(F4 a, float lo, float hi) { return min(max(a, f4(lo)), f4(hi)); }
+	// GLSL mod, x - y * floor(x / y)
+	inline F4 mod(F4 x, F4 y) { return x - y * floor(x / y); }
+
+	struct F4x3 { F4 x, y, z; };
+	struct U4x3 { U4 x, y, z; };
+
+	inline F4x3 operator+(const F4x3& a, const F4x3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	inline F4x3 operator-(const F4x3& a, const F4x3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	inline F4x3 operator*(const F4x3& a, F4 b) { return { a.x * b, a.y * b, a.z * b }; }
+	inline F4x3 floor(const F4x3& a) { return { floor(a.x), floor(a.y), floor(a.z) }; }
+	inline F4x3 fract(const F4x3& a) { return { fract(a.x), fract(a.y), fract(a.z) }; }
+	inline F4x3 mod(const F4x3& a, F4 b) { return { mod(a.x, b), mod(a.y, b), mod(a.z, b) }; }
+	inline F4x3 splat(float x, float y, float z) { return { f4(x), f4(y), f4(z) }; }
+	inline F4 dot(const F4x3& a, const F4x3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	inline F4 distance(const F4x3& a, const F4x3& b) { const F4x3 d = a - b; return sqrt(dot(d, d)); }
+	inline F4 smoothstep01(F4 x) { const F4 t = clamp(x, 0.0f, 1.0f); return t * t * (f4(3.0f) - f4(2.0f) * t); }
+	inline F4 remap(F4 orig, F4 old_min, F4 old_max, F4 new_min, F4 new_max)
+	{
+		return new_min + (((orig - old_min) / (old_max - old_min)) * (new_max - new_min));
+	}
+	// pcg3d from noise.glsl
+	F4x3 pcg3d(const F4x3& p, uint32_t seed)
+	{
+		const U4 m = u4(1664525u);
+		U4x3 v = { to_uint(p.x) * m + u4(seed), to_uint(p.y) * m + u4(seed), to_uint(p.z) * m + u4(seed) };
+
+		v.x = v.x + v.y * v.z;
+		v.y = v.y + v.z * v.x;
+		v.z = v.z + v.x * v.y;
+
+		// The shader converts the uvec3 shift to a scalar int, so every component shifts by the first one
+		const U4 k = u4(277803737u);
+		const U4 shift = (v.x >> 28) + u4(4u);
+		v.x = ((v.x >> shift) ^ v.x) * k;
+		v.y = ((v.y >> shift) ^ v.y) * k;
+		v.z = ((v.z >> shift) ^ v.z) * k;
+
+		v.x = v.x ^ (v.x >> 16);
+		v.y = v.y ^ (v.y >> 16);
+		v.z = v.z ^ (v.z >> 16);
+
+		v.x = v.x + v.y * v.z;
+		v.y = v.y + v.z * v.x;
+		v.z = v.z + v.x * v.y;
+
+		const F4 range = f4(float(0xffffffffu));
+		return { to_float(v.x) / range, to_float(v.y) / range, to_float(v.z) / range };
+	}
+
+	F4 worley(const F4x3& p0, float frequency, uint32_t seed)
+	{
+		const F4 freq = f4(frequency);
+		const F4x3 i = floor(p0 * freq);
+		const F4x3 f = fract(p0 * freq);
+
+		F4 min_d = f4(1.0f);
+		for (int x = -1; x <= 1; x++) {
+			for (int y = -1; y <= 1; y++) {
+				for (int z = -1; z <= 1; z++) {
+					const F4x3 p1 = splat((float)x, (float)y, (float)z);
+					min_d = min(min_d, distance(pcg3d(mod(i + p1, freq), seed), f - p1));
+				}
+			}
+		}
+
+		return f4(1.0f) - min_d;
+	}
+
+	F4 perlin(const F4x3& x0, float frequency, uint32_t seed)
+	{
+		const F4 freq = f4(frequency);
+		const F4x3 i = floor(x0 * freq);
+		const F4x3 f = fract(x0 * freq);
+
+		const F4 va = dot(pcg3d(mod(i + splat(0, 0, 0), freq), seed), f);
+		const F4 vb = dot(pcg3d(mod(i + splat(1, 0, 0), freq), seed), f - splat(1, 0, 0));
+		const F4 vc = dot(pcg3d(mod(i + splat(0, 1, 0), freq), seed), f - splat(0, 1, 0));
+		const F4 vd = dot(pcg3d(mod(i + splat(1, 1, 0), freq), seed), f - splat(1, 1, 0));
+		const F4 ve = dot(pcg3d(mod(i + splat(0, 0, 1), freq), seed), f - splat(0, 0, 1));
+		const F4 vf = dot(pcg3d(mod(i + splat(1, 0, 1), freq), seed), f - splat(1, 0, 1));
+		const F4 vg = dot(pcg3d(mod(i + splat(0, 1, 1), freq), seed), f - splat(0, 1, 1));
+		const F4 vh = dot(pcg3d(mod(i + splat(1, 1, 1), freq), seed), f - splat(1, 1, 1));
+
+		const F4x3 u = { smoothstep01(f.x), smoothstep01(f.y), smoothstep01(f.z) };
+
+		return va +
+			u.x * (vb - va) +
+			u.y * (vc - va) +
+			u.z * (ve - va) +
+			u.x * u.y * (va - vb - vc + vd) +
+			u.y * u.z * (va - vc - ve + vg) +
+			u.z * u.x * (va - vb - ve + vf) +
+			u.x * u.y * u.z * (f4(0.0f) - va + vb + vc - vd + ve - vf - vg + vh);
+	}
+
+	template<typename TNoise>
+	F4 fbm(TNoise noise, const F4x3& x, float f, uint32_t n, uint32_t seed)
+	{
+		F4 v = f4(0.0f);
+		float a = 0.5f;
+		float as = 0.0f;
+
+		for (uint32_t i = 0; i < n; i++) {
+			v = v + f4(a) * noise(x, f, seed);
+			f *= 2.0f;
+
+			as += a;
+			a *= a;
+		}
+
+		return clamp(v / f4(as) * f4(0.5f) + f4(0.5f), 0.0f, 1.0f);
+	}
+
+	F4 fbm_worley(const F4x3& x, float f, uint32_t n, uint32_t seed) { return fbm(worley, x, f, n, seed); }
+
+	F4 fbm_perlin(const F4x3& x, float f, uint32_t n, uint32_t seed) { return fbm(perlin, x, f, n, seed); }
+	// cloud_shape.comp
+	F4 cloud_shape(const F4x3& cell_loc, uint32_t frequency_worley, uint32_t frequency_perlin, uint32_t seed)
+	{
+		const float fw = (float)frequency_worley;
+
+		F4 worley01 = worley(cell_loc, fw * 2.0f, seed);
+		F4 worley02 = worley(cell_loc, fw * 8.0f, seed);
+		F4 worley03 = worley(cell_loc, fw * 12.0f, seed);
+
+		const F4 perlin = fbm_perlin(cell_loc, (float)frequency_perlin, 3u, seed);
+		const F4 perlin_worley = remap(perlin, f4(0.0f), f4(1.0f), worley01 * f4(0.625f) + worley02 * f4(0.25f) + worley03 * f4(0.125f), f4(1.0f));
+
+		worley01 = worley(cell_loc, fw, seed);
+		worley02 = worley(cell_loc, fw * 2.0f, seed);
+		worley03 = worley(cell_loc, fw * 4.0f, seed);
+		const F4 worley04 = worley(cell_loc, fw * 8.0f, seed);
+		const F4 worley05 = worley(cell_loc, fw * 16.0f, seed);
+
+		const F4 fbm02 = worley02 * f4(0.625f) + worley03 * f4(0.25f) + worley04 * f4(0.125f);
+		const F4 fbm03 = worley03 * f4(0.625f) + worley04 * f4(0.25f) + worley05 * f4(0.125f);
+		const F4 fbm04 = worley04 * f4(0.75f) + worley05 * f4(0.25f);
+
+		const F4 low_frequency_fbm = fbm02 * f4(0.625f) + fbm03 * f4(0.25f) + fbm04 * f4(0.125f);
+		return remap(perlin_worley, f4(0.0f) - (f4(1.0f) - low_frequency_fbm), f4(1.0f), f4(0.0f), f4(1.0f));
+	}
+}
+/*
+* !@brief Evaluate kernel over every texel of the volume, four texels of a row at a time,
+* z slices are distributed over hardware threads
+*
+* @param[in] kernel - receives normalized texel coordinates like gl_GlobalInvocationID / imageSize
+* and writes texels for the given number of lanes
+*/
+template<typename TKernel>
+static TVector<char> bake(VkExtent3D imageSize, size_t texelSize, TKernel kernel)
+{
+	TVector<char> texels(texelSize * imageSize.width * imageSize.height * imageSize.depth);
+
+	const uint32_t threadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), imageSize.depth));
+	TVector<std::future<void>> workers;
+
+	for (uint32_t t = 0; t < threadCount; t++)
+	{
+		workers.push_back(std::async(std::launch::async, [&, t]() {
+			const F4 size_x = f4((float)imageSize.width);
+			const F4 size_y = f4((float)imageSize.height);
+			const F4 size_z = f4((float)imageSize.depth);
+
+			for (uint32_t z = t; z < imageSize.depth; z += threadCount) {
+				for (uint32_t y = 0; y < imageSize.height; y++) {
+					for (uint32_t x = 0; x < imageSize.width; x += 4) {
+						const F4x3 cell_loc = {
+							f4((float)x, (float)(x + 1), (float)(x + 2), (float)(x + 3)) / size_x,
+							f4((float)y) / size_y,
+							f4((float)z) / size_z
+						};
+
+						const size_t texel = ((size_t)z * imageSize.height + y) * imageSize.width + x;
+						kernel(cell_loc, std::min(4u, imageSize.width - x), texels.data() + texel * texelSize);
+					}
+				}
+			}
+		}));
+	}
+
+	for (std::future<void>& worker : workers) {
+		worker.wait();
+	}
+
+	return texels;
+}
+
+static void store_unorm8(F4 value, uint32_t lanes, char* out)
+{
+	float values[4];
+	store(value, values);
+
+	for (uint32_t l = 0; l < lanes; l++) {
+		out[l] = (char)glm::packUnorm1x8(values[l]);
+	}
+}
+
+float GRNoise::Worley(const TVec3& p, float frequency, uint32_t seed)
+{
+	float value[4];
+	store(worley(splat(p.x, p.y, p.z), frequency, seed), value);
+	return value[0];
+}
+
+float GRNoise::Perlin(const TVec3& p, float frequency, uint32_t seed)
+{
+	float value[4];
+	store(perlin(splat(p.x, p.y, p.z), frequency, seed), value);
+	return value[0];
+}
+
+float GRNoise::FbmWorley(const TVec3& p, float frequency, uint32_t octaves, uint32_t seed)
+{
+	float value[4];
+	store(fbm_worley(splat(p.x, p.y, p.z), frequency, octaves, seed), value);
+	return value[0];
+}
+
+float GRNoise::FbmPerlin(const TVec3& p, float frequency, uint32_t octaves, uint32_t seed)
+{
+	float value[4];
+	store(fbm_perlin(splat(p.x, p.y, p.z), frequency, octaves, seed), value);
+	return value[0];
+}
+
+TVector<char> GRNoise::BakePerlin(VkExtent3D imageSize, uint32_t frequency, uint32_t octaves, uint32_t seed)
+{
+	return bake(imageSize, 1u, [=](const F4x3& cell_loc, uint32_t lanes, char* out) {
+		store_unorm8(fbm_perlin(cell_loc, (float)frequency, octaves, seed), lanes, out);
+	});
+}
+
+TVector<char> GRNoise::BakeWorley(VkExtent3D imageSize, uint32_t frequency, uint32_t octaves, uint32_t seed)
+{
+	return bake(imageSize, 1u, [=](const F4x3& cell_loc, uint32_t lanes, char* out) {
+		store_unorm8(fbm_worley(cell_loc, (float)frequency, octaves, seed), lanes, out);
+	});
+}
+
+TVector<char> GRNoise::BakeCloudShapeNoise(VkExtent3D imageSize, uint32_t worley_frequency, uint32_t perlin_frequency, uint32_t seed)
+{
+	return bake(imageSize, 1u, [=](const F4x3& cell_loc, uint32_t lanes, char* out) {
+		store_unorm8(cloud_shape(cell_loc, worley_frequency, perlin_frequency, seed), lanes, out);
+	});
+}
+
+TVector<char> GRNoise::BakeCloudDetailNoise(VkExtent3D imageSize, uint32_t frequency, uint32_t octaves, uint32_t seed)
+{
+	return bake(imageSize, sizeof(uint32_t), [=](const F4x3& cell_loc, uint32_t lanes, char* out) {
+		float channels[3][4];
+		for (uint32_t i = 0; i < 3; i++) {
+			store(fbm_worley(cell_loc, (float)(frequency * (i + 1)), octaves, seed), channels[i]);
+		}
+
+		// Alpha channel of the shader is dropped by the B10G11R11 target
+		for (uint32_t l = 0; l < lanes; l++) {
+			const uint32_t packed = glm::packF2x11_1x10(TVec3(channels[0][l], channels[1][l], channels[2][l]));
+			memcpy(out + l * sizeof(uint32_t), &packed, sizeof(uint32_t));
+		}
+	});
+}
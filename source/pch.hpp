@@ -8,4 +8,5 @@
 #include <chrono>
 #include <map>
 #include <future>
-#include <any>
\ No newline at end of file
+#include <any>
+#include <functional>
\ No newline at end of file
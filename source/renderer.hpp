@@ -8,12 +8,16 @@
 #include "vulkan_objects/buffer.hpp"
 #include "vulkan_objects/image.hpp"
 #include "vulkan_objects/mesh.hpp"
+#include "vulkan_objects/render_graph.hpp"
 #include "file_manager.hpp"
 #include "vulkan_api.hpp"
 #include "noise.hpp"
 #include "components.hpp"
 #include "structs.hpp"
 #include "shapes.hpp"
+#include "texture_streamer.hpp"
+#include "atmosphere.hpp"
+#include "startup_graph.hpp"
 
 #if DEBUG == 1
 #define VALIDATION
@@ -58,6 +62,10 @@ class VulkanBase
 	TVector<VkSemaphore> presentSemaphores = {};
 	TVector<VkSemaphore> swapchainSemaphores = {};
 	TVector<VkCommandBuffer> presentBuffers = {};
+	// Async passes of the frame graph, graphics and compute submissions signal the frame number
+	TVector<VkCommandBuffer> computeBuffers = {};
+	VkSemaphore graphicsTimeline = VK_NULL_HANDLE;
+	VkSemaphore computeTimeline = VK_NULL_HANDLE;
 	TVector<TAuto<Pipeline>> HDRPipelines = {};
 	TVector<TAuto<DescriptorSet>> HDRDescriptors = {};
 
@@ -77,12 +85,92 @@ class VulkanBase
 
 	TAuto<VulkanImage> CloudShape = VK_NULL_HANDLE;
 	TAuto<VulkanImage> CloudDetail = VK_NULL_HANDLE;
+	TAuto<VulkanImage> CloudBounds = VK_NULL_HANDLE;
+
+	TAuto<VulkanImage> CloudLighting = VK_NULL_HANDLE;
+	TAuto<DescriptorSet> CloudLightingSet = VK_NULL_HANDLE;
+	TAuto<Pipeline> cloudLightingPipeline = VK_NULL_HANDLE;
+	CloudLayerProfile cloud_settings = {};
+	TVec4 cloud_lighting_origin = TVec4(0.0);
+	TVec3 cloud_lighting_sun = TVec3(0.0);
+	double cloud_lighting_time = 0.0;
+	bool cloud_lighting_valid = false;
+
+	TArray<TAuto<VulkanImage>, 2> cloudTargets = {};
+	TArray<TAuto<VulkanImage>, 2> cloudDepthTargets = {};
+	TArray<TAuto<DescriptorSet>, 2> CloudTraceSets = {};
+	TArray<TAuto<DescriptorSet>, 2> CloudCompositeSets = {};
+	TVector<TAuto<DescriptorSet>> SceneDepthSets = {};
+	TAuto<Pipeline> cloudTracePipeline = VK_NULL_HANDLE;
+	TMat4 cloud_view_projection = TMat4(1.0);
+	uint32_t cloud_target = 0;
+	bool clouds_valid = false;
+
+	TAuto<RenderGraph> frameGraph = VK_NULL_HANDLE;
+
+	RenderGraph::Handle SkyViewLUT = 0;
+	RenderGraph::Handle AerialPerspectiveLUT = 0;
+	TAuto<DescriptorSet> SkyLutSet = VK_NULL_HANDLE;
+	TAuto<Pipeline> skyViewPipeline = VK_NULL_HANDLE;
+	TAuto<Pipeline> aerialPerspectivePipeline = VK_NULL_HANDLE;
+
+	RenderGraph::Handle SkyCube = 0;
+	TAuto<VulkanImage> SpecularCube = VK_NULL_HANDLE;
+	TAuto<VulkanImage> BrdfLUT = VK_NULL_HANDLE;
+	TAuto<Buffer> environmentBuffer = VK_NULL_HANDLE;
+	TAuto<DescriptorSet> EnvironmentCubeSet = VK_NULL_HANDLE;
+	TAuto<DescriptorSet> EnvironmentSHSet = VK_NULL_HANDLE;
+	TVector<TAuto<DescriptorSet>> EnvironmentPrefilterSets = {};
+	TAuto<Pipeline> environmentCubePipeline = VK_NULL_HANDLE;
+	TAuto<Pipeline> environmentPrefilterPipeline = VK_NULL_HANDLE;
+	TAuto<Pipeline> environmentSHPipeline = VK_NULL_HANDLE;
+	TVec3 environment_sun = TVec3(0.0);
+	bool environment_valid = false;
 
 	TAuto<VulkanImage> ScatteringLUT = VK_NULL_HANDLE;
 	TAuto<VulkanImage> IrradianceLUT = VK_NULL_HANDLE;
 	TAuto<VulkanImage> Transmittance = VK_NULL_HANDLE;
 
+	TVector<TAuto<Buffer>> drawCommands = {};
+	TVector<TAuto<DescriptorSet>> DrawCommandSets = {};
+	TAuto<Pipeline> meshletCullPipeline = VK_NULL_HANDLE;
+	TAuto<Pipeline> pbrPipeline = VK_NULL_HANDLE;
+	uint32_t drawCommandCapacity = 0;
+
+	TAuto<VulkanImage> hizPyramid = VK_NULL_HANDLE;
+	TVector<TAuto<DescriptorSet>> HiZDepthSets = {};
+	TVector<TAuto<DescriptorSet>> HiZReduceSets = {};
+	TAuto<Pipeline> hizReducePipeline = VK_NULL_HANDLE;
+	TVector<TAuto<Buffer>> occlusionUbo = {};
+	TVector<TAuto<DescriptorSet>> OcclusionSets = {};
+	TMat4 previous_view_projection = TMat4(1.0);
+	bool hiz_valid = false;
+	bool occlusion_culling = true;
+
+	ELutPrecision lut_precision = ELutPrecision::Full;
+
+	AtmosphereProfile atmosphere = {};
+	AtmosphereProfile pending_atmosphere = {};
+	bool atmosphere_dirty = false;
+	TVector<TAuto<Buffer>> atmosphereUbo = {};
+	TAuto<AtmosphereBaker> atmosphereBaker = VK_NULL_HANDLE;
+	TArray<TAuto<VulkanImage>, 3> atmosphereTargets = {};
+	VkSemaphore atmosphere_semaphore = VK_NULL_HANDLE;
+	TAuto<Buffer> atmosphereReadback = VK_NULL_HANDLE;
+	uint64_t atmosphere_readback_key = 0;
+	VkDeviceSize atmosphere_readback_size = 0;
+	uint64_t atmosphere_readback_frame = 0;
+
+	TAuto<TextureStreamer> streamer = VK_NULL_HANDLE;
+	TVector<std::pair<uint64_t, TShared<void>>> retired = {};
+
 	uint32_t swapchain_index = 0;
+	uint64_t frame_count = 0;
+	uint64_t last_pressure_relief = 0;
+
+	float lod_pixel_error = 1.0f;
+	RenderStats stats = {};
+	TVector<StartupTiming> startupTimings = {};
 
 #ifdef INCLUDE_GUI
 	VkDescriptorPool imguiPool = VK_NULL_HANDLE;
@@ -90,7 +178,7 @@ class VulkanBase
 
 public:
 	// !@brief Defined in renderer.cpp
-	VulkanBase(GLFWwindow* window, entt::registry& registry);
+	VulkanBase(GLFWwindow* window, entt::registry& registry, ELutPrecision lutPrecision = ELutPrecision::Full);
 
 	// !@brief Defined in renderer.cpp
 	~VulkanBase() noexcept;
@@ -106,10 +194,11 @@ public:
 	* !@brief Load mesh model to the scene. Defined in renderer.cpp.
 	* 
 	* @param[in] mesh_path - local path to the mesh file (for supported formats look at assimp)
+	* @param[in] lod_levels - maximum amount of levels of detail to generate, including the full detail one
 	* 
 	* @return New entity handle
 	*/
-	GRAPI entt::entity AddMesh(const std::string& mesh_path);
+	GRAPI entt::entity AddMesh(const std::string& mesh_path, uint32_t lod_levels = 1u);
 	/*
 	* !@brief Generate and add a simple shape to the scene. Defined in renderer.cpp.
 	* 
@@ -119,14 +208,15 @@ public:
 	*/
 	GRAPI entt::entity AddShape(const GRShape::Shape& descriptor);
 	/*
-	* !@brief INTERNAL. Import image file into the memory using specified format
+	* !@brief INTERNAL. Import image file into the memory using specified format.
+	* Only the low mips are resident at first, higher ones are streamed in as the image is seen on screen
 	* 
 	* @param[in] path - path to image file
 	* @param[in] format - format to store image in
 	* 
 	* @return Vulkan image memory
 	*/
-	TAuto<VulkanImage> _loadImage(const std::string& path, VkFormat format);
+	TShared<VulkanImage> _loadImage(const std::string& path, VkFormat format);
 	/*
 	* !@brief Wait on CPU for GPU to complete it's current rendering commands
 	*/
@@ -138,6 +228,79 @@ public:
 	*/
 	GRAPI void SetCloudLayerSettings(CloudLayerProfile settings);
 	/*
+	* !@brief Change the planet and its atmosphere. LUTs are recomputed on the compute queue
+	* over the next frames, current settings stay in use until the new LUTs are ready
+	* 
+	* @param[in] settings - new atmosphere settings
+	*/
+	GRAPI void SetAtmosphereSettings(AtmosphereProfile settings);
+	/*
+	* !@brief Limit the memory used by streamed texture mips. Mips are evicted
+	* when either this limit or the device memory budget is exceeded
+	* 
+	* @param[in] bytes - maximum size of resident texture mips, zero to only respect the device budget
+	*/
+	GRAPI void SetTextureMemoryBudget(VkDeviceSize bytes);
+	/*
+	* !@brief Get memory usage and budget of every device memory heap
+	* 
+	* @return Collection of heap budgets
+	*/
+	GRAPI TVector<HeapBudget> GetMemoryBudget() const;
+	/*
+	* !@brief Get time spent on every job of the renderer startup
+	* 
+	* @return Collection of job timings in the order the jobs were added
+	*/
+	GRAPI const TVector<StartupTiming>& GetStartupTimings() const;
+	/*
+	* !@brief Register a resource which can release its memory when the device runs out of it
+	* 
+	* @param[in] priority - resources with lower priority are released first
+	* @param[in] callback - function, which should free at least requested amount of bytes and return how much it freed
+	* 
+	* @return Handle of the registered callback
+	*/
+	GRAPI uint32_t AddMemoryPressureCallback(uint32_t priority, MemoryPressureCallback callback);
+	/*
+	* !@brief Unregister memory pressure callback
+	* 
+	* @param[in] handle - handle returned by AddMemoryPressureCallback
+	*/
+	GRAPI void RemoveMemoryPressureCallback(uint32_t handle);
+	/*
+	* !@brief Set how much geometric error of a level of detail may be visible on screen.
+	* Coarsest level with projected error below the threshold is drawn
+	* 
+	* @param[in] pixels - maximum error in pixels, zero always draws full detail meshes
+	*/
+	GRAPI void SetLodPixelError(float pixels);
+	/*
+	* !@brief Get counters of the last rendered frame
+	* 
+	* @return Frame statistics, levels of detail per entity are stored in GRComponents::LevelOfDetail
+	*/
+	GRAPI const RenderStats& GetRenderStats() const;
+	/*
+	* !@brief Toggle culling of meshes hidden behind the depth of the previous frame
+	* 
+	* @param[in] enable - true to test bounds against the depth pyramid
+	*/
+	GRAPI void SetOcclusionCulling(bool enable);
+	/*
+	* !@brief Measure the quantization error of the cached LUT texels: the 32 bit float texels of the
+	* LUT cache are rounded on CPU to the given precision and compared with themselves.
+	* Used to pick the cheapest precision within tolerance. The atmosphere integrals are not
+	* evaluated, so errors of the precompute itself are not part of the result
+	* 
+	* @param[in] precision - precision to evaluate
+	* @param[out] outError - max and mean relative error of every LUT
+	* 
+	* @return false if the cache holds no texels of the LUTs in use. After SetAtmosphereSettings
+	* this is the case from the moment new LUTs are in use until their cache entry is written a few frames later
+	*/
+	GRAPI VkBool32 MeasureLutQuantizationError(ELutPrecision precision, AtmosphereLutError& outError) const;
+	/*
 	* !@brief Should be modified to control the scene
 	*/
 	GR::Camera camera = {};
@@ -164,19 +327,73 @@ private:
 	VkBool32 create_hdr_pipeline();
 
 	// !@brief Defined in initialization.cpp
-	VkBool32 prepare_renderer_resources();
+	VkBool32 prepare_renderer_resources(StartupGraph::GpuWork& work);
+
+	// !@brief Defined in initialization.cpp
+	VkBool32 create_default_textures();
+
+	// !@brief Defined in initialization.cpp
+	VkBool32 create_draw_commands(uint32_t capacity);
+
+	// !@brief Defined in initialization.cpp
+	VkBool32 create_hiz_pyramid();
 
 	// !@brief Defined in initialization.cpp
 	TVector<const char*> getRequiredExtensions();
 
+	// !@brief Defined in precompute.cpp
+	VkBool32 create_atmosphere_luts(StartupGraph::GpuWork& work);
+
 	// !@brief Defined in precompute.cpp
 	VkBool32 atmosphere_precompute();
 
+	// !@brief Defined in precompute.cpp
+	TArray<TAuto<VulkanImage>, 3> create_atmosphere_targets();
+
+	// !@brief Defined in precompute.cpp
+	VkSemaphore update_atmosphere(VkCommandBuffer cmd);
+
+	// !@brief Defined in precompute.cpp
+	VkBool32 load_atmosphere_luts(uint64_t key);
+
+	// !@brief Defined in precompute.cpp
+	void store_atmosphere_luts(uint64_t key);
+
+	// !@brief Defined in precompute.cpp
+	void store_atmosphere_readback();
+
+	// !@brief Defined in precompute.cpp
+	VkBool32 convert_atmosphere_luts(StartupGraph::GpuWork& work, const TVector<VkSemaphoreSubmitInfo>& waits);
+
+	// !@brief Defined in initialization.cpp
+	VkBool32 create_frame_graph(StartupGraph::GpuWork& work);
+
+	// !@brief Defined in precompute.cpp
+	VkBool32 create_sky_luts();
+
+	// !@brief Defined in precompute.cpp
+	VkBool32 create_environment_maps(StartupGraph::GpuWork& work);
+
+	// !@brief Defined in precompute.cpp
+	VkBool32 create_cloud_noise(StartupGraph::GpuWork& work);
+
 	// !@brief Defined in precompute.cpp
 	VkBool32 volumetric_precompute();
 
+	// !@brief Defined in precompute.cpp
+	VkBool32 create_cloud_bounds(StartupGraph::GpuWork& work);
+
+	// !@brief Defined in precompute.cpp
+	VkBool32 create_cloud_lighting();
+
+	// !@brief Defined in precompute.cpp
+	VkBool32 create_cloud_targets();
+
+	// !@brief Defined in pbr_controls.cpp
+	void update_pbr_set(entt::entity ent);
+
 	// !@brief Defined in pbr_controls.cpp
-	void update_pipeline(entt::entity ent);
+	uint32_t get_textures_revision(entt::entity ent) const;
 
 	// !@brief Defined in pbr_controls.cpp
 	TAuto<DescriptorSet> create_pbr_set(const VulkanImage& albedo, const VulkanImage& nh, const VulkanImage& arm);
@@ -184,9 +401,36 @@ private:
 	// !@brief Defined in pbr_controls.cpp
 	TAuto<Pipeline> create_pbr_pipeline(const DescriptorSet& set);
 
+	// !@brief Defined in pbr_controls.cpp
+	TAuto<DescriptorSet> create_meshlet_set(const Mesh& mesh);
+
+	// !@brief Defined in pbr_controls.cpp
+	TAuto<Pipeline> create_meshlet_cull_pipeline(const DescriptorSet& set);
+
+	// !@brief Defined in renderer.cpp
+	void cull_objects(VkCommandBuffer cmd);
+
 	// !@brief Defined in renderer.cpp
 	void render_objects(VkCommandBuffer cmd);
 
+	// !@brief Defined in renderer.cpp
+	void draw_scene(VkCommandBuffer cmd);
+
+	// !@brief Defined in renderer.cpp
+	void build_hiz_pyramid(VkCommandBuffer cmd);
+
+	// !@brief Defined in renderer.cpp
+	void update_sky(VkCommandBuffer cmd);
+
+	// !@brief Defined in renderer.cpp
+	void update_environment(VkCommandBuffer cmd);
+
+	// !@brief Defined in renderer.cpp
+	void update_cloud_lighting(VkCommandBuffer cmd);
+
+	// !@brief Defined in renderer.cpp
+	void trace_clouds(VkCommandBuffer cmd);
+
 #ifdef VALIDATION
 	VkDebugUtilsMessengerEXT debugMessenger;
 	const TVector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation" };
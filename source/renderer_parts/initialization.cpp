@@ -58,65 +58,65 @@ VkBool32 VulkanBase::create_swapchain_images()
 
 	uint32_t imagesCount = Scope.GetMaxFramesInFlight();
 	swapchainImages.resize(imagesCount);
-	depthAttachments.resize(imagesCount);
-	hdrAttachments.resize(imagesCount);
 	VkBool32 res = vkGetSwapchainImagesKHR(Scope.GetDevice(), Scope.GetSwapchain(), &imagesCount, swapchainImages.data()) == VK_SUCCESS;
 
-	const TArray<uint32_t, 2> queueIndices = { Scope.GetQueue(VK_QUEUE_GRAPHICS_BIT).GetFamilyIndex(), Scope.GetQueue(VK_QUEUE_TRANSFER_BIT).GetFamilyIndex() };
-	VmaAllocationCreateInfo allocCreateInfo{};
-	allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.format = Scope.GetColorFormat();
 
 	for (size_t i = 0; i < swapchainImages.size(); i++)
 	{
 		VkImageView imageView;
-
-		VkImageViewCreateInfo viewInfo{};
-		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 		viewInfo.image = swapchainImages[i];
-		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		viewInfo.subresourceRange.baseArrayLayer = 0;
-		viewInfo.subresourceRange.layerCount = 1;
-		viewInfo.subresourceRange.baseMipLevel = 0;
-		viewInfo.subresourceRange.levelCount = 1;
-		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		viewInfo.format = Scope.GetColorFormat();
-
-		VkImageCreateInfo hdrInfo{};
-		hdrInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		hdrInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-		hdrInfo.arrayLayers = 1;
-		hdrInfo.extent = { Scope.GetSwapchainExtent().width, Scope.GetSwapchainExtent().height, 1 };
-		hdrInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		hdrInfo.imageType = VK_IMAGE_TYPE_2D;
-		hdrInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		hdrInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		hdrInfo.mipLevels = 1;
-		hdrInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
-		hdrInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
-		hdrInfo.queueFamilyIndexCount = queueIndices.size();
-		hdrInfo.pQueueFamilyIndices = queueIndices.data();
-
-		VkImageCreateInfo depthInfo{};
-		depthInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		depthInfo.format = Scope.GetDepthFormat();
-		depthInfo.arrayLayers = 1;
-		depthInfo.extent = { Scope.GetSwapchainExtent().width, Scope.GetSwapchainExtent().height, 1 };
-		depthInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		depthInfo.imageType = VK_IMAGE_TYPE_2D;
-		depthInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		depthInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		depthInfo.mipLevels = 1;
-		depthInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-		depthInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
-		depthInfo.queueFamilyIndexCount = queueIndices.size();
-		depthInfo.pQueueFamilyIndices = queueIndices.data();
-
 		res = (vkCreateImageView(Scope.GetDevice(), &viewInfo, VK_NULL_HANDLE, &imageView) == VK_SUCCESS) & res;
 		swapchainViews.push_back(imageView);
+	}
+
+	// HDR never leaves the render pass, tile based GPUs can keep it in on-chip memory
+	VkImageCreateInfo hdrInfo{};
+	hdrInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	hdrInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+	hdrInfo.arrayLayers = 1;
+	hdrInfo.extent = { Scope.GetSwapchainExtent().width, Scope.GetSwapchainExtent().height, 1 };
+	hdrInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	hdrInfo.imageType = VK_IMAGE_TYPE_2D;
+	hdrInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	hdrInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	hdrInfo.mipLevels = 1;
+	hdrInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	hdrInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	// Depth is sampled by the Hi-Z reduction after the render pass, so it has to be stored.
+	// Cloud composition reads it as an input attachment
+	VkImageCreateInfo depthInfo = hdrInfo;
+	depthInfo.format = Scope.GetDepthFormat();
+	depthInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+	VmaAllocationCreateInfo allocCreateInfo{};
+	allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+	VmaAllocationCreateInfo lazyAllocCreateInfo{};
+	lazyAllocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
 
+	uint32_t lazyMemoryType = 0;
+	const bool lazyMemory = vmaFindMemoryTypeIndexForImageInfo(Scope.GetAllocator(), &hdrInfo, &lazyAllocCreateInfo, &lazyMemoryType) == VK_SUCCESS;
+
+	// One set of attachments per frame in flight, frames pick theirs by frame_count like the async command buffers
+	depthAttachments.resize(imagesCount);
+	hdrAttachments.resize(depthAttachments.size());
+	for (size_t i = 0; i < hdrAttachments.size(); i++)
+	{
+		viewInfo.image = VK_NULL_HANDLE;
 		viewInfo.format = hdrInfo.format;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		hdrAttachments[i] = std::make_unique<VulkanImage>(Scope);
-		hdrAttachments[i]->CreateImage(hdrInfo, allocCreateInfo)
+		hdrAttachments[i]->CreateImage(hdrInfo, lazyMemory ? lazyAllocCreateInfo : allocCreateInfo)
 			.CreateImageView(viewInfo)
 			.TransitionLayout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
@@ -134,12 +134,15 @@ VkBool32 VulkanBase::create_framebuffers()
 {
 	assert(swapchainImages.size() > 0 && Scope.GetRenderPass() != VK_NULL_HANDLE);
 
-	framebuffers.resize(swapchainImages.size());
+	// Acquired image does not follow the frame slot, every slot gets a framebuffer for every swapchain image
+	framebuffers.resize(hdrAttachments.size() * swapchainImages.size());
 
 	VkBool32 res = 1;
 	for (size_t i = 0; i < framebuffers.size(); i++)
 	{
-		res = CreateFramebuffer(Scope.GetDevice(), Scope.GetRenderPass(), Scope.GetSwapchainExtent(), { hdrAttachments[i]->GetImageView(), swapchainViews[i], depthAttachments[i]->GetImageView() }, &framebuffers[i]) & res;
+		const size_t attachment = i / swapchainImages.size();
+		const size_t image = i % swapchainImages.size();
+		res = CreateFramebuffer(Scope.GetDevice(), Scope.GetRenderPass(), Scope.GetSwapchainExtent(), { hdrAttachments[attachment]->GetImageView(), swapchainViews[image], depthAttachments[attachment]->GetImageView() }, &framebuffers[i]) & res;
 	}
 
 	return res;
@@ -148,8 +151,8 @@ VkBool32 VulkanBase::create_framebuffers()
 VkBool32 VulkanBase::create_hdr_pipeline()
 {
 	VkBool32 res = 1;
-	HDRPipelines.resize(swapchainImages.size());
-	HDRDescriptors.resize(swapchainImages.size());
+	HDRPipelines.resize(hdrAttachments.size());
+	HDRDescriptors.resize(hdrAttachments.size());
 
 	for (size_t i = 0; i < HDRDescriptors.size(); i++)
 	{
@@ -161,14 +164,91 @@ VkBool32 VulkanBase::create_hdr_pipeline()
 			.SetShaderStage("fullscreen", VK_SHADER_STAGE_VERTEX_BIT)
 			.SetShaderStage("hdr_frag", VK_SHADER_STAGE_FRAGMENT_BIT)
 			.AddDescriptorLayout(HDRDescriptors[i]->GetLayout())
-			.SetSubpass(1)
+			.SetSubpass(2)
 			.Construct(Scope);
 	}
 
 	return res;
 }
 
-VkBool32 VulkanBase::prepare_renderer_resources()
+VkBool32 VulkanBase::create_frame_graph(StartupGraph::GpuWork& work)
+{
+	VkBool32 res = 1;
+	frameGraph = std::make_unique<RenderGraph>(Scope);
+
+	res = create_sky_luts() & res;
+	res = create_environment_maps(work) & res;
+
+	// Owned by the renderer and carried over between frames
+	const RenderGraph::Handle hiz = frameGraph->ImportResource("HiZ");
+	const RenderGraph::Handle commands = frameGraph->ImportResource("DrawCommands");
+	const RenderGraph::Handle depth = frameGraph->ImportResource("SceneDepth");
+	const RenderGraph::Handle specular = frameGraph->ImportResource("SpecularCube");
+	const RenderGraph::Handle environment = frameGraph->ImportResource("EnvironmentLighting");
+	const RenderGraph::Handle lighting = frameGraph->ImportResource("CloudLighting");
+	const RenderGraph::Handle clouds = frameGraph->ImportResource("CloudTargets");
+	const RenderGraph::Handle atmosphereLuts = frameGraph->ImportResource("AtmosphereLUTs");
+
+	frameGraph->AddPass("meshlet_cull", [this](VkCommandBuffer cmd) { cull_objects(cmd); })
+		.Read(hiz, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Write(commands, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	// Sky, environment and clouds run on the compute queue next to culling and the scene
+	frameGraph->AddPass("sky_luts", [this](VkCommandBuffer cmd) { update_sky(cmd); })
+		.Async()
+		.Read(atmosphereLuts, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Write(SkyViewLUT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Write(AerialPerspectiveLUT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	frameGraph->AddPass("environment", [this](VkCommandBuffer cmd) { update_environment(cmd); })
+		.Async()
+		.Read(atmosphereLuts, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Read(SkyViewLUT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Write(SkyCube, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Write(specular, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Write(environment, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	frameGraph->AddPass("cloud_lighting", [this](VkCommandBuffer cmd) { update_cloud_lighting(cmd); })
+		.Async()
+		.Read(atmosphereLuts, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Read(SkyViewLUT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Read(AerialPerspectiveLUT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Write(lighting, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	// Reads the history target and writes the other one
+	frameGraph->AddPass("cloud_trace", [this](VkCommandBuffer cmd) { trace_clouds(cmd); })
+		.Async()
+		.Read(atmosphereLuts, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Read(SkyViewLUT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Read(AerialPerspectiveLUT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Read(lighting, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Read(clouds, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Write(clouds, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	// Color attachments are synchronized by the subpass dependencies of the render pass
+	frameGraph->AddPass("scene", [this](VkCommandBuffer cmd) { draw_scene(cmd); })
+		.Read(commands, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
+		.Read(SkyViewLUT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+		.Read(AerialPerspectiveLUT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+		.Read(specular, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+		.Read(environment, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+		.Read(clouds, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+		.Read(atmosphereLuts, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+		.Write(depth, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)
+		.KeepAlive();
+
+	frameGraph->AddPass("hiz_pyramid", [this](VkCommandBuffer cmd) { build_hiz_pyramid(cmd); })
+		.Read(depth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+		.Write(hiz, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	// Last, so async passes of the same frame never wait on it
+	frameGraph->AddPass("atmosphere", [this](VkCommandBuffer cmd) { atmosphere_semaphore = update_atmosphere(cmd); })
+		.Write(atmosphereLuts, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	return frameGraph->Compile() & res;
+}
+
+VkBool32 VulkanBase::prepare_renderer_resources(StartupGraph::GpuWork& work)
 {
 	VkBool32 res = 1;
 	auto vertAttributes = Vertex::getAttributeDescriptions();
@@ -178,27 +258,175 @@ VkBool32 VulkanBase::prepare_renderer_resources()
 	uboInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	uboInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 	uboInfo.size = sizeof(UniformBuffer);
-	uboInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	Scope.ShareBetweenQueues(uboInfo);
 
 	VmaAllocationCreateInfo uboAllocCreateInfo{};
 	uboAllocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
 	uboAllocCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
 
+	VkBufferCreateInfo atmosphereInfo = uboInfo;
+	atmosphereInfo.size = sizeof(AtmosphereProfile);
+
+	res = create_frame_graph(work) & res;
+
 	ubo.resize(swapchainImages.size());
+	atmosphereUbo.resize(swapchainImages.size());
 	UBOSet.resize(swapchainImages.size());
 	for (uint32_t i = 0; i < ubo.size(); ++i)
 	{
 		ubo[i] = std::make_unique<Buffer>(Scope, uboInfo, uboAllocCreateInfo);
+		atmosphereUbo[i] = std::make_unique<Buffer>(Scope, atmosphereInfo, uboAllocCreateInfo);
 
 		UBOSet[i] = DescriptorSetDescriptor()
 			.AddUniformBuffer(0, VK_SHADER_STAGE_ALL, *ubo[i])
+			.AddUniformBuffer(1, VK_SHADER_STAGE_ALL, *atmosphereUbo[i])
+			.AddImageSampler(2, VK_SHADER_STAGE_ALL, frameGraph->GetImage(SkyViewLUT))
+			.AddImageSampler(3, VK_SHADER_STAGE_ALL, frameGraph->GetImage(AerialPerspectiveLUT))
+			.AddStorageBuffer(4, VK_SHADER_STAGE_ALL, *environmentBuffer)
+			.AddImageSampler(5, VK_SHADER_STAGE_ALL, *SpecularCube)
+			.AddImageSampler(6, VK_SHADER_STAGE_ALL, *BrdfLUT)
 			.Allocate(Scope);
 	}
 
+	res = create_draw_commands(1024u) & res;
+	res = create_hiz_pyramid() & res;
+
+	return res;
+}
+
+VkBool32 VulkanBase::create_default_textures()
+{
 	defaultWhite = std::shared_ptr<VulkanImage>(GRNoise::GenerateSolidColor(Scope, { 1, 1 }, VK_FORMAT_R8G8B8A8_SRGB, std::byte(255u), std::byte(255u), std::byte(255u), std::byte(255u)));
 	defaultBlack = std::shared_ptr<VulkanImage>(GRNoise::GenerateSolidColor(Scope, { 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM, std::byte(0u)));
 	defaultNormal = std::shared_ptr<VulkanImage>(GRNoise::GenerateSolidColor(Scope, { 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM, std::byte(127u), std::byte(127u), std::byte(255u), std::byte(255u)));
 	defaultARM = std::shared_ptr<VulkanImage>(GRNoise::GenerateSolidColor(Scope, { 1, 1 }, VK_FORMAT_R8G8B8A8_SRGB, std::byte(255u), std::byte(255u), std::byte(0u), std::byte(255u)));
 
-	return res;
-}
\ No newline at end of file
+	return defaultWhite && defaultBlack && defaultNormal && defaultARM;
+}
+
+VkBool32 VulkanBase::create_draw_commands(uint32_t capacity)
+{
+	VkBufferCreateInfo commandsInfo{};
+	commandsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	commandsInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+	commandsInfo.size = sizeof(VkDrawIndexedIndirectCommand) * capacity;
+	commandsInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo commandsAllocCreateInfo{};
+	commandsAllocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+	drawCommands.resize(swapchainImages.size());
+	DrawCommandSets.resize(swapchainImages.size());
+	for (uint32_t i = 0; i < drawCommands.size(); ++i)
+	{
+		// Frames in flight might still read the previous buffers
+		if (drawCommands[i])
+		{
+			retired.emplace_back(frame_count, TShared<Buffer>(std::move(drawCommands[i])));
+			retired.emplace_back(frame_count, TShared<DescriptorSet>(std::move(DrawCommandSets[i])));
+		}
+
+		drawCommands[i] = std::make_unique<Buffer>(Scope, commandsInfo, commandsAllocCreateInfo);
+
+		DrawCommandSets[i] = DescriptorSetDescriptor()
+			.AddStorageBuffer(0, VK_SHADER_STAGE_COMPUTE_BIT, *drawCommands[i])
+			.Allocate(Scope);
+	}
+
+	drawCommandCapacity = capacity;
+
+	return drawCommands.back() != VK_NULL_HANDLE;
+}
+
+VkBool32 VulkanBase::create_hiz_pyramid()
+{
+	const VkExtent2D extent = { glm::max(Scope.GetSwapchainExtent().width / 2, 1u), glm::max(Scope.GetSwapchainExtent().height / 2, 1u) };
+	const uint32_t mipLevels = static_cast<uint32_t>(glm::floor(glm::log2(static_cast<float>(glm::max(extent.width, extent.height))))) + 1u;
+
+	VkImageCreateInfo hizInfo{};
+	hizInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	hizInfo.format = VK_FORMAT_R32_SFLOAT;
+	hizInfo.arrayLayers = 1;
+	hizInfo.extent = { extent.width, extent.height, 1 };
+	hizInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	hizInfo.imageType = VK_IMAGE_TYPE_2D;
+	hizInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	hizInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	hizInfo.mipLevels = mipLevels;
+	hizInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	hizInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo hizAllocCreateInfo{};
+	hizAllocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = hizInfo.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = mipLevels;
+
+	hizPyramid = std::make_unique<VulkanImage>(Scope);
+	hizPyramid->CreateImage(hizInfo, hizAllocCreateInfo)
+		.CreateImageView(viewInfo)
+		.CreateSampler(ESamplerType::PointClamp)
+		.CreateMipViews()
+		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+
+	// Mip 0 is reduced from the depth attachment of the frame, others from the previous mip
+	HiZDepthSets.resize(depthAttachments.size());
+	for (uint32_t i = 0; i < HiZDepthSets.size(); ++i)
+	{
+		HiZDepthSets[i] = DescriptorSetDescriptor()
+			.AddImageSampler(0, VK_SHADER_STAGE_COMPUTE_BIT, { Scope.GetSampler(ESamplerType::PointClamp), depthAttachments[i]->GetImageView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL })
+			.AddStorageImage(1, VK_SHADER_STAGE_COMPUTE_BIT, { VK_NULL_HANDLE, hizPyramid->GetMipView(0), VK_IMAGE_LAYOUT_GENERAL })
+			.Allocate(Scope);
+	}
+
+	HiZReduceSets.resize(mipLevels - 1);
+	for (uint32_t mip = 1; mip < mipLevels; ++mip)
+	{
+		HiZReduceSets[mip - 1] = DescriptorSetDescriptor()
+			.AddImageSampler(0, VK_SHADER_STAGE_COMPUTE_BIT, { Scope.GetSampler(ESamplerType::PointClamp), hizPyramid->GetMipView(mip - 1), VK_IMAGE_LAYOUT_GENERAL })
+			.AddStorageImage(1, VK_SHADER_STAGE_COMPUTE_BIT, { VK_NULL_HANDLE, hizPyramid->GetMipView(mip), VK_IMAGE_LAYOUT_GENERAL })
+			.Allocate(Scope);
+	}
+
+	if (!hizReducePipeline)
+	{
+		hizReducePipeline = ComputePipelineDescriptor()
+			.SetShaderName("hiz_reduce_comp")
+			.AddDescriptorLayout(HiZDepthSets[0]->GetLayout())
+			.Construct(Scope);
+	}
+
+	VkBufferCreateInfo uboInfo{};
+	uboInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	uboInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	uboInfo.size = sizeof(OcclusionUniform);
+	uboInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo uboAllocCreateInfo{};
+	uboAllocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+	uboAllocCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+
+	occlusionUbo.resize(swapchainImages.size());
+	OcclusionSets.resize(swapchainImages.size());
+	for (uint32_t i = 0; i < occlusionUbo.size(); ++i)
+	{
+		occlusionUbo[i] = std::make_unique<Buffer>(Scope, uboInfo, uboAllocCreateInfo);
+
+		OcclusionSets[i] = DescriptorSetDescriptor()
+			.AddImageSampler(0, VK_SHADER_STAGE_COMPUTE_BIT, *hizPyramid)
+			.AddUniformBuffer(1, VK_SHADER_STAGE_COMPUTE_BIT, *occlusionUbo[i])
+			.Allocate(Scope);
+	}
+
+	// Pyramid holds no depth until the first frame is rendered
+	hiz_valid = false;
+
+	return IsPipelineValid(hizReducePipeline);
+}
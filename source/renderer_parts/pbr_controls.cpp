@@ -1,7 +1,7 @@
 #include "pch.hpp"
 #include "renderer.hpp"
 
-entt::entity VulkanBase::AddMesh(const std::string& mesh_path)
+entt::entity VulkanBase::AddMesh(const std::string& mesh_path, uint32_t lod_levels)
 {
 	entt::entity ent = registry.create();
 
@@ -16,11 +16,21 @@ entt::entity VulkanBase::AddMesh(const std::string& mesh_path)
 	registry.emplace_or_replace<GRComponents::NormalDisplacementMap>(ent, defaultNormal, &gro.dirty);
 	registry.emplace_or_replace<GRComponents::AORoughnessMetallicMap>(ent, defaultWhite, &gro.dirty);
 
-	gro.mesh = mesh_path != "" ? GRVkFile::_importMesh(Scope, mesh_path.c_str())
+	gro.mesh = mesh_path != "" ? GRVkFile::_importMesh(Scope, mesh_path.c_str(), lod_levels)
 		: GRShape::Cube().Generate(Scope);
+	registry.emplace_or_replace<GRComponents::LevelOfDetail>(ent, 0u, gro.mesh->GetLodCount(), gro.mesh->GetLod(0).indexCount / 3);
+	gro.meshletSet = create_meshlet_set(*gro.mesh);
+
+	if (!meshletCullPipeline)
+		meshletCullPipeline = create_meshlet_cull_pipeline(*gro.meshletSet);
 
 	gro.descriptorSet = create_pbr_set(*defaultWhite, *defaultNormal, *defaultARM);
-	gro.pipeline = create_pbr_pipeline(*gro.descriptorSet);
+
+	// Layouts of PBR sets come from the layout cache, every object binds the same pipeline
+	if (!pbrPipeline)
+		pbrPipeline = create_pbr_pipeline(*gro.descriptorSet);
+
+	gro.revision = get_textures_revision(ent);
 
 	return ent;
 }
@@ -40,32 +50,53 @@ entt::entity VulkanBase::AddShape(const GRShape::Shape& descriptor)
 	registry.emplace_or_replace<GRComponents::AORoughnessMetallicMap>(ent, defaultWhite, &gro.dirty);
 
 	gro.mesh = descriptor.Generate(Scope);
+	registry.emplace_or_replace<GRComponents::LevelOfDetail>(ent, 0u, gro.mesh->GetLodCount(), gro.mesh->GetLod(0).indexCount / 3);
+	gro.meshletSet = create_meshlet_set(*gro.mesh);
+
+	if (!meshletCullPipeline)
+		meshletCullPipeline = create_meshlet_cull_pipeline(*gro.meshletSet);
+
 	gro.descriptorSet = create_pbr_set(*defaultWhite, *defaultNormal, *defaultARM);
-	gro.pipeline = create_pbr_pipeline(*gro.descriptorSet);
+
+	// Layouts of PBR sets come from the layout cache, every object binds the same pipeline
+	if (!pbrPipeline)
+		pbrPipeline = create_pbr_pipeline(*gro.descriptorSet);
+
+	gro.revision = get_textures_revision(ent);
 
 	return ent;
 }
 
-void VulkanBase::update_pipeline(entt::entity ent)
+void VulkanBase::update_pbr_set(entt::entity ent)
 {
 	VulkanImage* albedo = static_cast<VulkanImage*>(registry.get<GRComponents::AlbedoMap>(ent).Get().get());
 	VulkanImage* nh = static_cast<VulkanImage*>(registry.get<GRComponents::NormalDisplacementMap>(ent).Get().get());
 	VulkanImage* arm = static_cast<VulkanImage*>(registry.get<GRComponents::AORoughnessMetallicMap>(ent).Get().get());
 
 	PBRObject& gro = registry.get<PBRObject>(ent);
+
+	// Previous set might still be bound by frames in flight
+	retired.emplace_back(frame_count, std::move(gro.descriptorSet));
+
 	gro.descriptorSet = create_pbr_set(*albedo, *nh, *arm);
-	gro.pipeline = create_pbr_pipeline(*gro.descriptorSet);
+	gro.revision = get_textures_revision(ent);
 	gro.dirty = false;
 }
 
+uint32_t VulkanBase::get_textures_revision(entt::entity ent) const
+{
+	const auto& [albedo, nh, arm] = registry.get<GRComponents::AlbedoMap, GRComponents::NormalDisplacementMap, GRComponents::AORoughnessMetallicMap>(ent);
+
+	return static_cast<VulkanImage*>(albedo.Get().get())->GetRevision()
+		+ static_cast<VulkanImage*>(nh.Get().get())->GetRevision()
+		+ static_cast<VulkanImage*>(arm.Get().get())->GetRevision();
+}
+
 TAuto<DescriptorSet> VulkanBase::create_pbr_set(const VulkanImage& albedo
 	, const VulkanImage& nh
 	, const VulkanImage& arm)
 {
 	return DescriptorSetDescriptor()
-		.AddImageSampler(1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, *Transmittance)
-		.AddImageSampler(2, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, *IrradianceLUT)
-		.AddImageSampler(3, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, *ScatteringLUT)
 		.AddImageSampler(4, VK_SHADER_STAGE_FRAGMENT_BIT, albedo)
 		.AddImageSampler(5, VK_SHADER_STAGE_FRAGMENT_BIT, nh)
 		.AddImageSampler(6, VK_SHADER_STAGE_FRAGMENT_BIT, arm)
@@ -88,4 +119,23 @@ TAuto<Pipeline> VulkanBase::create_pbr_pipeline(const DescriptorSet& set)
 		.AddPushConstant({ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PBRConstants::World) })
 		.AddPushConstant({ VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(PBRConstants::World),  sizeof(PBRConstants) - sizeof(PBRConstants::World) })
 		.Construct(Scope);
-};
\ No newline at end of file
+};
+
+TAuto<DescriptorSet> VulkanBase::create_meshlet_set(const Mesh& mesh)
+{
+	return DescriptorSetDescriptor()
+		.AddStorageBuffer(0, VK_SHADER_STAGE_COMPUTE_BIT, *mesh.GetMeshletBuffer())
+		.Allocate(Scope);
+}
+
+TAuto<Pipeline> VulkanBase::create_meshlet_cull_pipeline(const DescriptorSet& set)
+{
+	return ComputePipelineDescriptor()
+		.SetShaderName("meshlet_cull_comp")
+		.AddDescriptorLayout(UBOSet[0]->GetLayout())
+		.AddDescriptorLayout(set.GetLayout())
+		.AddDescriptorLayout(DrawCommandSets[0]->GetLayout())
+		.AddDescriptorLayout(OcclusionSets[0]->GetLayout())
+		.AddPushConstant({ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MeshletCullConstants) })
+		.Construct(Scope);
+}
@@ -1,322 +1,719 @@
 #include "pch.hpp"
 #include "renderer.hpp"
+#include "atmosphere.hpp"
+#include <filesystem>
+#include <glm/gtc/packing.hpp>
 
-VkBool32 VulkanBase::atmosphere_precompute()
+extern std::string exec_path;
+
+// Fixed so cloud volumes are reproducible between runs and can be served from the noise cache
+static const uint32_t cloudShapeSeed = 2798796415u;
+static const uint32_t cloudDetailSeed = 1597334673u;
+
+// Cloud shape texels per cell of the empty space skipping volume
+static const uint32_t cloudBoundsCell = 8u;
+
+// Sun light and sky visibility volume over the visible cloud shell, y spans the layer height
+static const VkExtent3D cloudLightingExtent = { 128u, 32u, 128u };
+
+// Sky-view LUT is latitude/longitude around the camera, aerial perspective is a froxel volume over the view frustum
+static const VkExtent3D skyViewExtent = { 192u, 108u, 1u };
+static const VkExtent3D aerialPerspectiveExtent = { 32u, 32u, 32u };
+
+// Sky is captured into a small cube and prefiltered per roughness mip, the split-sum BRDF term only depends on NdotV and roughness
+static const uint32_t environmentCubeSize = 64u;
+static const uint32_t environmentSpecularMips = 6u;
+static const VkExtent3D brdfLutExtent = { 128u, 128u, 1u };
+
+static const uint32_t atmosphereCacheMagic = 0x54414752u; // "GRAT"
+static const uint32_t atmosphereCacheVersion = 1u;
+
+struct AtmosphereCacheHeader
+{
+	uint32_t magic = atmosphereCacheMagic;
+	uint32_t version = atmosphereCacheVersion;
+	uint64_t key = 0;
+	uint64_t size = 0;
+};
+
+/*
+* !@brief Hash of everything LUTs depend on: precompute shader binaries, LUT layout and atmosphere settings.
+* Cloud layer heights trail the profile and are left out
+*/
+static uint64_t atmosphere_cache_key(const ShaderRegistry& registry, const TVector<const VulkanImage*>& luts, const AtmosphereProfile& profile)
+{
+	const char* shaders[] = { "transmittance_comp", "deltaE_comp", "deltaSRSM_comp", "singleScattering_comp",
+		"deltaJ_comp", "deltaEn_comp", "deltaS_comp", "addE_comp", "addS_comp" };
+
+	uint64_t hash = FNV1A_OFFSET;
+	for (const char* shader : shaders)
+	{
+		const uint64_t shaderHash = registry.GetHash(shader);
+		if (shaderHash == 0)
+			return 0;
+
+		hash = ::Fnv1a(hash, &shaderHash, sizeof(uint64_t));
+	}
+
+	for (const VulkanImage* lut : luts) {
+		hash = ::Fnv1a(hash, &lut->GetExtent(), sizeof(VkExtent3D));
+	}
+
+	return ::Fnv1a(hash, &profile, offsetof(AtmosphereProfile, CloudBottomHeight));
+}
+
+static VkDeviceSize lut_size(const VulkanImage& lut)
+{
+	const VkExtent3D& extent = lut.GetExtent();
+	return static_cast<VkDeviceSize>(extent.width) * extent.height * extent.depth * 4u * sizeof(float);
+}
+
+static std::string atmosphere_cache_path()
+{
+	return exec_path + "cache\\atmosphere_lut.bin";
+}
+
+static VkBool32 read_atmosphere_cache(uint64_t key, VkDeviceSize size, TVector<char>& texels)
+{
+	std::ifstream cacheFile(atmosphere_cache_path(), std::ios::binary);
+	if (!cacheFile.is_open())
+		return 0;
+
+	AtmosphereCacheHeader header{};
+	cacheFile.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!cacheFile || header.magic != atmosphereCacheMagic || header.version != atmosphereCacheVersion || header.key != key || header.size != size)
+		return 0;
+
+	texels.resize(size);
+	cacheFile.read(texels.data(), size);
+
+	return cacheFile ? 1 : 0;
+}
+
+static void write_atmosphere_cache(uint64_t key, const TVector<char>& texels)
+{
+	// Recomputes finishing close together may write from different worker threads
+	static std::mutex lock;
+	std::lock_guard<std::mutex> guard(lock);
+
+	AtmosphereCacheHeader header{};
+	header.key = key;
+	header.size = texels.size();
+
+	// A missing cache only costs a precompute on the next launch, so failures are ignored
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(atmosphere_cache_path()).parent_path(), error);
+
+	std::ofstream cacheFile(atmosphere_cache_path(), std::ios::binary | std::ios::trunc);
+	if (cacheFile.is_open())
+	{
+		cacheFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		cacheFile.write(texels.data(), texels.size());
+	}
+}
+
+static VkDeviceSize luts_size(const TVector<const VulkanImage*>& luts)
+{
+	VkDeviceSize size = 0;
+	for (const VulkanImage* lut : luts) {
+		size += lut_size(*lut);
+	}
+
+	return size;
+}
+
+static TAuto<Buffer> create_lut_readback(const RenderScope& Scope, const TVector<const VulkanImage*>& luts)
+{
+	VkBufferCreateInfo readbackInfo{};
+	readbackInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	readbackInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	readbackInfo.size = luts_size(luts);
+	readbackInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo readbackAlloc{};
+	readbackAlloc.usage = VMA_MEMORY_USAGE_AUTO;
+	readbackAlloc.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+
+	return std::make_unique<Buffer>(Scope, readbackInfo, readbackAlloc);
+}
+/*
+* !@brief Copy 32 bit float LUTs back to back into the readback buffer, in the layout of the cache file
+*/
+static void record_lut_readback(VkCommandBuffer cmd, const TVector<const VulkanImage*>& luts, const Buffer& readback)
+{
+	VkDeviceSize offset = 0;
+	for (const VulkanImage* lut : luts)
+	{
+		VkBufferImageCopy region{};
+		region.bufferOffset = offset;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = lut->GetExtent();
+		vkCmdCopyImageToBuffer(cmd, lut->GetImage(), VK_IMAGE_LAYOUT_GENERAL, readback.GetBuffer(), 1u, &region);
+
+		offset += lut_size(*lut);
+	}
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+}
+/*
+* !@brief Pick the storage format of a LUT, falls back to wider formats the device can not blit into
+*/
+static VkFormat select_lut_format(const RenderScope& Scope, ELutPrecision precision, bool alpha)
+{
+	const VkFormatFeatureFlags features = VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+	TVector<VkFormat> candidates = {};
+	if (precision == ELutPrecision::Packed && !alpha)
+		candidates.push_back(VK_FORMAT_B10G11R11_UFLOAT_PACK32);
+	if (precision != ELutPrecision::Full)
+		candidates.push_back(VK_FORMAT_R16G16B16A16_SFLOAT);
+
+	for (VkFormat format : candidates)
+	{
+		VkFormatProperties properties{};
+		vkGetPhysicalDeviceFormatProperties(Scope.GetPhysicalDevice(), format, &properties);
+
+		if ((properties.optimalTilingFeatures & features) == features)
+			return format;
+	}
+
+	return VK_FORMAT_R32G32B32A32_SFLOAT;
+}
+
+static TVec4 quantize_texel(VkFormat format, const TVec4& texel)
+{
+	switch (format)
+	{
+	case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+		return TVec4(glm::unpackF2x11_1x10(glm::packF2x11_1x10(TVec3(texel))), 1.0);
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+		return glm::unpackHalf4x16(glm::packHalf4x16(texel));
+	default:
+		return texel;
+	}
+}
+
+static LutError measure_lut_error(VkFormat format, const float* texels, size_t texelCount, bool alpha)
 {
-	TAuto<VulkanImage> DeltaE;
-	TAuto<VulkanImage> DeltaSR;
-	TAuto<VulkanImage> DeltaSM;
-	TAuto<VulkanImage> DeltaJ;
-
-	TAuto<DescriptorSet> TrDSO;
-	TAuto<DescriptorSet> DeltaEDSO;
-	TAuto<DescriptorSet> DeltaSRSMDSO;
-	TAuto<DescriptorSet> SingleScatterDSO;
-
-	TAuto<DescriptorSet> DeltaJDSO;
-	TAuto<DescriptorSet> DeltaEnDSO;
-	TAuto<DescriptorSet> DeltaSDSO;
-	TAuto<DescriptorSet> AddEDSO;
-	TAuto<DescriptorSet> AddSDSO;
-
-	TAuto<Pipeline> GenTrLUT;
-	TAuto<Pipeline> GenDeltaELUT;
-	TAuto<Pipeline> GenDeltaSRSMLUT;
-	TAuto<Pipeline> GenSingleScatterLUT;
-	TAuto<Pipeline> GenDeltaJLUT;
-	TAuto<Pipeline> GenDeltaEnLUT;
-	TAuto<Pipeline> GenDeltaSLUT;
-	TAuto<Pipeline> AddE;
-	TAuto<Pipeline> AddS;
-
-	VkImageSubresourceRange subRes{};
-	subRes.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subRes.baseArrayLayer = 0;
-	subRes.baseMipLevel = 0;
-	subRes.layerCount = 1;
-	subRes.levelCount = 1;
+	const uint32_t channels = alpha ? 4u : 3u;
+
+	LutError error{};
+	double errorSum = 0.0;
+	for (size_t i = 0; i < texelCount; i++)
+	{
+		const TVec4 reference = TVec4(texels[i * 4], texels[i * 4 + 1], texels[i * 4 + 2], texels[i * 4 + 3]);
+		const TVec4 quantized = quantize_texel(format, reference);
+
+		// Relative error, values under the floor only have to match absolutely
+		for (uint32_t c = 0; c < channels; c++)
+		{
+			const float delta = glm::abs(quantized[c] - reference[c]) / glm::max(glm::abs(reference[c]), 1e-6f);
+			error.MaxError = glm::max(error.MaxError, delta);
+			errorSum += delta;
+		}
+	}
+
+	error.MeanError = texelCount > 0 ? static_cast<float>(errorSum / (texelCount * channels)) : 0.0f;
+	return error;
+}
+
+TArray<TAuto<VulkanImage>, 3> VulkanBase::create_atmosphere_targets()
+{
+	const VkExtent3D extents[] = { AtmosphereBaker::TransmittanceExtent, AtmosphereBaker::IrradianceExtent, AtmosphereBaker::ScatteringExtent };
+
+	// Targets are written on the compute queue and read on the graphics queue
+	const uint32_t families[] = { Scope.GetQueue(VK_QUEUE_COMPUTE_BIT).GetFamilyIndex(), Scope.GetQueue(VK_QUEUE_GRAPHICS_BIT).GetFamilyIndex() };
 
 	VkImageCreateInfo imageCI{};
 	imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	imageCI.arrayLayers = 1;
-	imageCI.extent = { 256, 64, 1u };
 	imageCI.format = VK_FORMAT_R32G32B32A32_SFLOAT;
 	imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	imageCI.mipLevels = 1;
 	imageCI.flags = 0;
 	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-	imageCI.imageType = VK_IMAGE_TYPE_2D;
+	imageCI.sharingMode = families[0] != families[1] ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+	imageCI.queueFamilyIndexCount = families[0] != families[1] ? 2u : 0u;
+	imageCI.pQueueFamilyIndices = families;
+	imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
 	VkImageViewCreateInfo imageViewCI{};
 	imageViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	imageViewCI.format = VK_FORMAT_R32G32B32A32_SFLOAT;
-	imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	imageViewCI.subresourceRange = subRes;
+	imageViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageViewCI.subresourceRange.baseArrayLayer = 0;
+	imageViewCI.subresourceRange.baseMipLevel = 0;
+	imageViewCI.subresourceRange.layerCount = 1;
+	imageViewCI.subresourceRange.levelCount = 1;
 
 	VmaAllocationCreateInfo imageAlloc{};
 	imageAlloc.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
 
-	Transmittance = std::make_unique<VulkanImage>(Scope);
-	Transmittance->CreateImage(imageCI, imageAlloc)
-		.CreateImageView(imageViewCI)
-		.CreateSampler(ESamplerType::PointClamp)
-		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+	TArray<TAuto<VulkanImage>, 3> targets = {};
+	for (uint32_t i = 0; i < targets.size(); i++)
+	{
+		imageCI.extent = extents[i];
+		imageCI.imageType = extents[i].depth > 1 ? VK_IMAGE_TYPE_3D : VK_IMAGE_TYPE_2D;
+		imageViewCI.viewType = extents[i].depth > 1 ? VK_IMAGE_VIEW_TYPE_3D : VK_IMAGE_VIEW_TYPE_2D;
 
-	TrDSO = DescriptorSetDescriptor()
-		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *Transmittance)
-		.Allocate(Scope);
+		targets[i] = std::make_unique<VulkanImage>(Scope);
+		targets[i]->CreateImage(imageCI, imageAlloc)
+			.CreateImageView(imageViewCI)
+			.CreateSampler(ESamplerType::PointClamp)
+			.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+	}
 
-	GenTrLUT = ComputePipelineDescriptor()
-		.SetShaderName("transmittance_comp")
-		.AddDescriptorLayout(TrDSO->GetLayout())
-		.Construct(Scope);
+	return targets;
+}
 
-	imageCI.extent = { 64u, 16u, 1u };
-	DeltaE = std::make_unique<VulkanImage>(Scope);
-	DeltaE->CreateImage(imageCI, imageAlloc)
-		.CreateImageView(imageViewCI)
-		.CreateSampler(ESamplerType::PointClamp)
-		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+VkBool32 VulkanBase::create_atmosphere_luts(StartupGraph::GpuWork& work)
+{
+	TArray<TAuto<VulkanImage>, 3> targets = create_atmosphere_targets();
+	Transmittance = std::move(targets[0]);
+	IrradianceLUT = std::move(targets[1]);
+	ScatteringLUT = std::move(targets[2]);
 
-	DeltaEDSO = DescriptorSetDescriptor()
-		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaE)
-		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *Transmittance)
-		.Allocate(Scope);
+	// Precompute chain and its pipelines are only needed when no valid cache exists
+	const uint64_t key = atmosphere_cache_key(Scope.GetShaderRegistry(), { Transmittance.get(), IrradianceLUT.get(), ScatteringLUT.get() }, atmosphere);
+	VkSemaphoreSubmitInfo bake{};
+	if (key == 0 || !load_atmosphere_luts(key))
+	{
+		TShared<AtmosphereBaker> baker = std::make_shared<AtmosphereBaker>(Scope, atmosphere, *Transmittance, *IrradianceLUT, *ScatteringLUT);
 
-	GenDeltaELUT = ComputePipelineDescriptor()
-		.SetShaderName("deltaE_comp")
-		.AddDescriptorLayout(DeltaEDSO->GetLayout())
-		.Construct(Scope);
+		VkCommandBuffer cmd;
+		const Queue& Queue = Scope.GetQueue(VK_QUEUE_COMPUTE_BIT);
+		Queue.AllocateCommandBuffers(1, &cmd);
+		::BeginOneTimeSubmitCmd(cmd);
 
-	IrradianceLUT = std::make_unique<VulkanImage>(Scope);
-	IrradianceLUT->CreateImage(imageCI, imageAlloc)
-		.CreateImageView(imageViewCI)
-		.CreateSampler(ESamplerType::PointClamp)
-		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+		baker->Record(cmd);
 
-	imageCI.imageType = VK_IMAGE_TYPE_3D;
-	imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_3D;
-	imageCI.extent = { 256u, 128u, 32u };
-	DeltaSR = std::make_unique<VulkanImage>(Scope);
-	DeltaSR->CreateImage(imageCI, imageAlloc)
-		.CreateImageView(imageViewCI)
-		.CreateSampler(ESamplerType::PointClamp)
-		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+		::EndCommandBuffer(cmd);
+		bake = Queue.WaitInfo(Queue.Submit(cmd), VK_PIPELINE_STAGE_2_TRANSFER_BIT);
 
-	DeltaSM = std::make_unique<VulkanImage>(Scope);
-	DeltaSM->CreateImage(imageCI, imageAlloc)
-		.CreateImageView(imageViewCI)
-		.CreateSampler(ESamplerType::PointClamp)
-		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+		// The readback is submitted after the bake and waited for on the host
+		if (key != 0) {
+			store_atmosphere_luts(key);
+		}
+		else {
+			work.keepAlive.emplace_back(std::move(baker));
+		}
+	}
 
-	DeltaSRSMDSO = DescriptorSetDescriptor()
-		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSR)
-		.AddStorageImage(1, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSM)
-		.AddImageSampler(2, VK_SHADER_STAGE_COMPUTE_BIT, *Transmittance)
-		.Allocate(Scope);
+	convert_atmosphere_luts(work, bake.semaphore != VK_NULL_HANDLE ? TVector<VkSemaphoreSubmitInfo>{ bake } : TVector<VkSemaphoreSubmitInfo>{});
 
-	GenDeltaSRSMLUT = ComputePipelineDescriptor()
-		.SetShaderName("deltaSRSM_comp")
-		.AddDescriptorLayout(DeltaSRSMDSO->GetLayout())
-		.Construct(Scope);
+	Transmittance->CreateSampler(ESamplerType::LinearClamp);
+	ScatteringLUT->CreateSampler(ESamplerType::LinearClamp);
+	IrradianceLUT->CreateSampler(ESamplerType::LinearClamp);
 
-	ScatteringLUT = std::make_unique<VulkanImage>(Scope);
-	ScatteringLUT->CreateImage(imageCI, imageAlloc)
-		.CreateImageView(imageViewCI)
-		.CreateSampler(ESamplerType::PointClamp)
-		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+	return 1;
+}
+
+VkBool32 VulkanBase::atmosphere_precompute()
+{
+	skybox = std::make_unique<GraphicsObject>();
+	skybox->pipeline = GraphicsPipelineDescriptor()
+		.SetShaderStage("fullscreen_far", VK_SHADER_STAGE_VERTEX_BIT)
+		.SetShaderStage("background_frag", VK_SHADER_STAGE_FRAGMENT_BIT)
+		.SetCullMode(VK_CULL_MODE_NONE)
+		.SetDepthState(VK_TRUE, VK_FALSE)
+		.AddDescriptorLayout(UBOSet[0]->GetLayout())
+		.Construct(Scope);
 
-	SingleScatterDSO = DescriptorSetDescriptor()
-		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *ScatteringLUT)
-		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSR)
-		.AddImageSampler(2, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSM)
+	SkyLutSet = DescriptorSetDescriptor()
+		.AddImageSampler(0, VK_SHADER_STAGE_COMPUTE_BIT, *Transmittance)
+		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *ScatteringLUT)
+		.AddStorageImage(2, VK_SHADER_STAGE_COMPUTE_BIT, frameGraph->GetImage(SkyViewLUT))
+		.AddStorageImage(3, VK_SHADER_STAGE_COMPUTE_BIT, frameGraph->GetImage(AerialPerspectiveLUT))
 		.Allocate(Scope);
 
-	GenSingleScatterLUT = ComputePipelineDescriptor()
-		.SetShaderName("singleScattering_comp")
-		.AddDescriptorLayout(SingleScatterDSO->GetLayout())
+	skyViewPipeline = ComputePipelineDescriptor()
+		.SetShaderName("sky_view_comp")
+		.AddDescriptorLayout(UBOSet[0]->GetLayout())
+		.AddDescriptorLayout(SkyLutSet->GetLayout())
 		.Construct(Scope);
 
-	DeltaJ = std::make_unique<VulkanImage>(Scope);
-	DeltaJ->CreateImage(imageCI, imageAlloc)
-		.CreateImageView(imageViewCI)
-		.CreateSampler(ESamplerType::PointClamp)
-		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+	aerialPerspectivePipeline = ComputePipelineDescriptor()
+		.SetShaderName("aerial_perspective_comp")
+		.AddDescriptorLayout(UBOSet[0]->GetLayout())
+		.AddDescriptorLayout(SkyLutSet->GetLayout())
+		.Construct(Scope);
 
-	DeltaJDSO = DescriptorSetDescriptor()
-		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaJ)
-		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *Transmittance)
-		.AddImageSampler(2, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaE)
-		.AddImageSampler(3, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSR)
-		.AddImageSampler(4, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSM)
+	EnvironmentCubeSet = DescriptorSetDescriptor()
+		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, frameGraph->GetImage(SkyCube))
 		.Allocate(Scope);
 
-	GenDeltaJLUT = ComputePipelineDescriptor()
-		.SetShaderName("deltaJ_comp")
-		.AddDescriptorLayout(DeltaJDSO->GetLayout())
-		.AddPushConstant({ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(int) })
+	environmentCubePipeline = ComputePipelineDescriptor()
+		.SetShaderName("environment_cube_comp")
+		.AddDescriptorLayout(UBOSet[0]->GetLayout())
+		.AddDescriptorLayout(EnvironmentCubeSet->GetLayout())
 		.Construct(Scope);
 
-	DeltaEnDSO = DescriptorSetDescriptor()
-		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaE)
-		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSR)
-		.AddImageSampler(2, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSM)
-		.Allocate(Scope);
+	VkDescriptorImageInfo skyCubeInfo{};
+	skyCubeInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	skyCubeInfo.imageView = frameGraph->GetImage(SkyCube).GetImageView();
+	skyCubeInfo.sampler = frameGraph->GetImage(SkyCube).GetSampler();
 
-	GenDeltaEnLUT = ComputePipelineDescriptor()
-		.SetShaderName("deltaEn_comp")
-		.AddDescriptorLayout(DeltaEnDSO->GetLayout())
-		.AddPushConstant({ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(int) })
-		.Construct(Scope);
+	EnvironmentPrefilterSets.resize(environmentSpecularMips);
+	for (uint32_t mip = 0; mip < environmentSpecularMips; mip++)
+	{
+		VkDescriptorImageInfo targetInfo{};
+		targetInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		targetInfo.imageView = SpecularCube->GetMipView(mip);
 
-	DeltaSDSO = DescriptorSetDescriptor()
-		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSR)
-		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *Transmittance)
-		.AddImageSampler(2, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaJ)
-		.Allocate(Scope);
+		EnvironmentPrefilterSets[mip] = DescriptorSetDescriptor()
+			.AddImageSampler(0, VK_SHADER_STAGE_COMPUTE_BIT, skyCubeInfo)
+			.AddStorageImage(1, VK_SHADER_STAGE_COMPUTE_BIT, targetInfo)
+			.Allocate(Scope);
+	}
 
-	GenDeltaSLUT = ComputePipelineDescriptor()
-		.SetShaderName("deltaS_comp")
-		.AddDescriptorLayout(DeltaSDSO->GetLayout())
+	environmentPrefilterPipeline = ComputePipelineDescriptor()
+		.SetShaderName("environment_prefilter_comp")
+		.AddDescriptorLayout(UBOSet[0]->GetLayout())
+		.AddDescriptorLayout(EnvironmentPrefilterSets[0]->GetLayout())
+		.AddPushConstant({ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(float) })
 		.Construct(Scope);
 
-	AddEDSO = DescriptorSetDescriptor()
-		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *IrradianceLUT)
-		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaE)
+	EnvironmentSHSet = DescriptorSetDescriptor()
+		.AddImageSampler(0, VK_SHADER_STAGE_COMPUTE_BIT, frameGraph->GetImage(SkyCube))
+		.AddStorageBuffer(1, VK_SHADER_STAGE_COMPUTE_BIT, *environmentBuffer)
+		.AddImageSampler(2, VK_SHADER_STAGE_COMPUTE_BIT, *Transmittance)
 		.Allocate(Scope);
 
-	AddE = ComputePipelineDescriptor()
-		.SetShaderName("addE_comp")
-		.AddDescriptorLayout(AddEDSO->GetLayout())
+	environmentSHPipeline = ComputePipelineDescriptor()
+		.SetShaderName("environment_sh_comp")
+		.AddDescriptorLayout(UBOSet[0]->GetLayout())
+		.AddDescriptorLayout(EnvironmentSHSet->GetLayout())
 		.Construct(Scope);
 
-	AddSDSO = DescriptorSetDescriptor()
-		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *ScatteringLUT)
-		.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, *DeltaSR)
-		.Allocate(Scope);
+	return IsPipelineValid(skybox->pipeline) && IsPipelineValid(skyViewPipeline) && IsPipelineValid(aerialPerspectivePipeline)
+		&& IsPipelineValid(environmentCubePipeline) && IsPipelineValid(environmentPrefilterPipeline) && IsPipelineValid(environmentSHPipeline);
+}
 
-	AddS = ComputePipelineDescriptor()
-		.SetShaderName("addS_comp")
-		.AddDescriptorLayout(AddSDSO->GetLayout())
-		.Construct(Scope);
+VkSemaphore VulkanBase::update_atmosphere(VkCommandBuffer cmd)
+{
+	// Readback of the last recompute is done once its frame has left the frames in flight
+	if (atmosphereReadback && frame_count - atmosphere_readback_frame > swapchainImages.size()) {
+		store_atmosphere_readback();
+	}
+
+	if (!atmosphereBaker)
+	{
+		if (!atmosphere_dirty)
+			return VK_NULL_HANDLE;
+
+		atmosphereTargets = create_atmosphere_targets();
+		atmosphereBaker = std::make_unique<AtmosphereBaker>(Scope, pending_atmosphere, *atmosphereTargets[0], *atmosphereTargets[1], *atmosphereTargets[2]);
+		atmosphere_dirty = false;
+	}
+
+	if (!atmosphereBaker->Advance())
+		return VK_NULL_HANDLE;
+
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+
+	// Settings changed while baking, the result is stale and a new bake starts next frame
+	if (!atmosphere_dirty)
+	{
+		VulkanImage* luts[] = { Transmittance.get(), IrradianceLUT.get(), ScatteringLUT.get() };
+
+		// Blit converts the baked 32 bit float LUTs to the storage precision of the LUTs in use
+		for (uint32_t i = 0; i < std::size(luts); i++)
+		{
+			const VkExtent3D& extent = luts[i]->GetExtent();
+
+			VkImageBlit region{};
+			region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.srcSubresource.layerCount = 1;
+			region.srcOffsets[1] = { static_cast<int32_t>(extent.width), static_cast<int32_t>(extent.height), static_cast<int32_t>(extent.depth) };
+			region.dstSubresource = region.srcSubresource;
+			region.dstOffsets[1] = region.srcOffsets[1];
+			vkCmdBlitImage(cmd, atmosphereTargets[i]->GetImage(), VK_IMAGE_LAYOUT_GENERAL, luts[i]->GetImage(), VK_IMAGE_LAYOUT_GENERAL, 1u, &region, VK_FILTER_NEAREST);
+		}
+
+		// Baked targets also replace the cache entry, so the next launch starts with these settings
+		const TVector<const VulkanImage*> targets = { atmosphereTargets[0].get(), atmosphereTargets[1].get(), atmosphereTargets[2].get() };
+		const uint64_t key = atmosphere_cache_key(Scope.GetShaderRegistry(), targets, atmosphereBaker->GetProfile());
+		if (key != 0)
+		{
+			// Readback still in flight belongs to older settings, it is dropped with its frame
+			if (atmosphereReadback) {
+				retired.emplace_back(frame_count, std::move(atmosphereReadback));
+			}
+
+			atmosphereReadback = create_lut_readback(Scope, targets);
+			atmosphere_readback_key = key;
+			atmosphere_readback_size = luts_size(targets);
+			atmosphere_readback_frame = frame_count;
+			record_lut_readback(cmd, targets, *atmosphereReadback);
+		}
+
+		// Shaders of the next frame see the new LUTs together with the new settings
+		atmosphere = atmosphereBaker->GetProfile();
+		environment_valid = false;
+		semaphore = atmosphereBaker->GetSemaphore();
+	}
+
+	retired.emplace_back(frame_count, std::move(atmosphereBaker));
+	for (TAuto<VulkanImage>& target : atmosphereTargets) {
+		retired.emplace_back(frame_count, std::move(target));
+	}
+
+	return semaphore;
+}
+
+void VulkanBase::SetAtmosphereSettings(AtmosphereProfile settings)
+{
+	pending_atmosphere = settings;
+	atmosphere_dirty = true;
+}
+
+VkBool32 VulkanBase::load_atmosphere_luts(uint64_t key)
+{
+	const TVector<VulkanImage*> luts = { Transmittance.get(), IrradianceLUT.get(), ScatteringLUT.get() };
+
+	VkDeviceSize size = 0;
+	for (const VulkanImage* lut : luts) {
+		size += lut_size(*lut);
+	}
+
+	TVector<char> texels = {};
+	if (!read_atmosphere_cache(key, size, texels))
+		return 0;
+
+	VkBufferCreateInfo stagingInfo{};
+	stagingInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	stagingInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	stagingInfo.size = size;
+	stagingInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo stagingAlloc{};
+	stagingAlloc.usage = VMA_MEMORY_USAGE_AUTO;
+	stagingAlloc.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+
+	Buffer staging(Scope, stagingInfo, stagingAlloc);
+	staging.Update(texels.data(), size);
 
 	VkCommandBuffer cmd;
 	const Queue& Queue = Scope.GetQueue(VK_QUEUE_COMPUTE_BIT);
+	Queue.AllocateCommandBuffers(1, &cmd);
+	::BeginOneTimeSubmitCmd(cmd);
 
-	VkImageMemoryBarrier barrier{};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_COMPUTE_BIT;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_COMPUTE_BIT;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-	barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	VkDeviceSize offset = 0;
+	for (VulkanImage* lut : luts)
+	{
+		VkBufferImageCopy region{};
+		region.bufferOffset = offset;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = lut->GetExtent();
+		vkCmdCopyBufferToImage(cmd, staging.GetBuffer(), lut->GetImage(), VK_IMAGE_LAYOUT_GENERAL, 1u, &region);
+
+		offset += lut_size(*lut);
+	}
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
 
+	::EndCommandBuffer(cmd);
+	Queue.Wait(Queue.Submit(cmd));
+
+	return 1;
+}
+
+void VulkanBase::store_atmosphere_luts(uint64_t key)
+{
+	const TVector<const VulkanImage*> luts = { Transmittance.get(), IrradianceLUT.get(), ScatteringLUT.get() };
+	TAuto<Buffer> readback = create_lut_readback(Scope, luts);
+
+	VkCommandBuffer cmd;
+	const Queue& Queue = Scope.GetQueue(VK_QUEUE_COMPUTE_BIT);
 	Queue.AllocateCommandBuffers(1, &cmd);
 	::BeginOneTimeSubmitCmd(cmd);
 
-	GenTrLUT->BindPipeline(cmd);
-	TrDSO->BindSet(0, cmd, *GenTrLUT);
-	vkCmdDispatch(cmd, Transmittance->GetExtent().width / 8u + uint32_t(Transmittance->GetExtent().width % 8u > 0)
-		, Transmittance->GetExtent().height / 8u + uint32_t(Transmittance->GetExtent().height % 8u > 0)
-		, 1u);
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
 
-	barrier.image = Transmittance->GetImage();
-	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	record_lut_readback(cmd, luts, *readback);
 
-	GenDeltaELUT->BindPipeline(cmd);
-	DeltaEDSO->BindSet(0, cmd, *GenDeltaELUT);
-	vkCmdDispatch(cmd, DeltaE->GetExtent().width / 8u + uint32_t(DeltaE->GetExtent().width % 8u > 0),
-		DeltaE->GetExtent().height / 8u + uint32_t(DeltaE->GetExtent().height % 8u > 0),
-		1u);
+	::EndCommandBuffer(cmd);
+	Queue.Wait(Queue.Submit(cmd));
 
-	barrier.image = DeltaE->GetImage();
-	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	TVector<char> texels(luts_size(luts));
+	readback->Read(texels.data(), texels.size());
 
-	GenDeltaSRSMLUT->BindPipeline(cmd);
-	DeltaSRSMDSO->BindSet(0, cmd, *GenDeltaSRSMLUT);
-	vkCmdDispatch(cmd, DeltaSR->GetExtent().width / 4u + uint32_t(DeltaSR->GetExtent().width % 4u > 0),
-		DeltaSR->GetExtent().height / 4u + uint32_t(DeltaSR->GetExtent().height % 4u > 0),
-		DeltaSR->GetExtent().depth / 4u + uint32_t(DeltaSR->GetExtent().depth % 4u > 0));
+	write_atmosphere_cache(key, texels);
+}
 
-	barrier.image = DeltaSM->GetImage();
-	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+void VulkanBase::store_atmosphere_readback()
+{
+	if (!atmosphereReadback)
+		return;
 
-	GenSingleScatterLUT->BindPipeline(cmd);
-	SingleScatterDSO->BindSet(0, cmd, *GenSingleScatterLUT);
-	vkCmdDispatch(cmd, ScatteringLUT->GetExtent().width / 4u + uint32_t(ScatteringLUT->GetExtent().width % 4u > 0),
-		ScatteringLUT->GetExtent().height / 4u + uint32_t(ScatteringLUT->GetExtent().height % 4u > 0),
-		ScatteringLUT->GetExtent().depth / 4u + uint32_t(ScatteringLUT->GetExtent().depth % 4u > 0));
+	TVector<char> texels(atmosphere_readback_size);
+	atmosphereReadback->Read(texels.data(), texels.size());
+	atmosphereReadback.reset();
 
-	for (int Sample = 1; Sample <= 5; ++Sample)
-	{
-		GenDeltaJLUT->PushConstants(cmd, &Sample, sizeof(int), 0, VK_SHADER_STAGE_COMPUTE_BIT);
-		GenDeltaJLUT->BindPipeline(cmd);
-		DeltaJDSO->BindSet(0, cmd, *GenDeltaJLUT);
-		vkCmdDispatch(cmd, DeltaJ->GetExtent().width / 4u + uint32_t(DeltaJ->GetExtent().width % 4u > 0),
-			DeltaJ->GetExtent().height / 4u + uint32_t(DeltaJ->GetExtent().height % 4u > 0),
-			DeltaJ->GetExtent().depth / 4u + uint32_t(DeltaJ->GetExtent().depth % 4u > 0));
-
-		GenDeltaEnLUT->PushConstants(cmd, &Sample, sizeof(int), 0, VK_SHADER_STAGE_COMPUTE_BIT);
-		GenDeltaEnLUT->BindPipeline(cmd);
-		DeltaEnDSO->BindSet(0, cmd, *GenDeltaEnLUT);
-		vkCmdDispatch(cmd, DeltaE->GetExtent().width / 8u + uint32_t(DeltaE->GetExtent().width % 8u > 0),
-			DeltaE->GetExtent().height / 8u + uint32_t(DeltaE->GetExtent().height % 8u > 0),
-			1u);
-
-		GenDeltaSLUT->BindPipeline(cmd);
-		DeltaSDSO->BindSet(0, cmd, *GenDeltaSLUT);
-		vkCmdDispatch(cmd, DeltaSR->GetExtent().width / 4u + uint32_t(DeltaSR->GetExtent().width % 4u > 0),
-			DeltaSR->GetExtent().height / 4u + uint32_t(DeltaSR->GetExtent().height % 4u > 0),
-			DeltaSR->GetExtent().depth / 4u + uint32_t(DeltaSR->GetExtent().depth % 4u > 0));
-
-		AddE->BindPipeline(cmd);
-		AddEDSO->BindSet(0, cmd, *AddE);
-		vkCmdDispatch(cmd, IrradianceLUT->GetExtent().width / 8u + uint32_t(IrradianceLUT->GetExtent().width % 8u > 0),
-			IrradianceLUT->GetExtent().height / 8u + uint32_t(IrradianceLUT->GetExtent().height % 8u > 0),
-			1u);
-
-		AddS->BindPipeline(cmd);
-		AddSDSO->BindSet(0, cmd, *AddS);
-		vkCmdDispatch(cmd, DeltaSR->GetExtent().width / 4u + uint32_t(DeltaSR->GetExtent().width % 4u > 0),
-			DeltaSR->GetExtent().height / 4u + uint32_t(DeltaSR->GetExtent().height % 4u > 0),
-			DeltaSR->GetExtent().depth / 4u + uint32_t(DeltaSR->GetExtent().depth % 4u > 0));
-	}
+	// File write stays off the render thread, the pool finishes it before shutdown
+	Scope.GetWorkerPool().Submit([key = atmosphere_readback_key, texels = std::move(texels)]() { write_atmosphere_cache(key, texels); });
+}
 
-	::EndCommandBuffer(cmd);
-	Queue.Submit(cmd)
-		.Wait()
-		.FreeCommandBuffers(1, &cmd);
+VkBool32 VulkanBase::create_sky_luts()
+{
+	VkImageCreateInfo lutInfo{};
+	lutInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	lutInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+	lutInfo.arrayLayers = 1;
+	lutInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	lutInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	lutInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	lutInfo.mipLevels = 1;
+	lutInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	lutInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	Transmittance->CreateSampler(ESamplerType::LinearClamp);
-	ScatteringLUT->CreateSampler(ESamplerType::LinearClamp);
-	IrradianceLUT->CreateSampler(ESamplerType::LinearClamp);
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.format = lutInfo.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
 
-	skybox = std::make_unique<GraphicsObject>();
-	skybox->descriptorSet = DescriptorSetDescriptor()
-		.AddImageSampler(1, VK_SHADER_STAGE_FRAGMENT_BIT, *ScatteringLUT)
+	lutInfo.extent = skyViewExtent;
+	lutInfo.imageType = VK_IMAGE_TYPE_2D;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+
+	// Both LUTs are rebuilt every frame before they are read, the frame graph owns them
+	SkyViewLUT = frameGraph->CreateImage("SkyViewLUT", lutInfo, viewInfo, ESamplerType::LinearClamp);
+
+	lutInfo.extent = aerialPerspectiveExtent;
+	lutInfo.imageType = VK_IMAGE_TYPE_3D;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_3D;
+
+	AerialPerspectiveLUT = frameGraph->CreateImage("AerialPerspectiveLUT", lutInfo, viewInfo, ESamplerType::LinearClamp);
+
+	return 1;
+}
+
+VkBool32 VulkanBase::create_environment_maps(StartupGraph::GpuWork& work)
+{
+	VkImageCreateInfo cubeInfo{};
+	cubeInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	cubeInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+	cubeInfo.imageType = VK_IMAGE_TYPE_2D;
+	cubeInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+	cubeInfo.extent = { environmentCubeSize, environmentCubeSize, 1u };
+	cubeInfo.arrayLayers = 6;
+	cubeInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	cubeInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	cubeInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	cubeInfo.mipLevels = 1;
+	cubeInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	cubeInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo allocCreateInfo{};
+	allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
+	viewInfo.format = cubeInfo.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 6;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+
+	// Only needed while the environment is rebaked, the frame graph owns it
+	SkyCube = frameGraph->CreateImage("SkyCube", cubeInfo, viewInfo, ESamplerType::LinearClamp);
+
+	// Filtered on the compute queue and sampled on the graphics queue
+	cubeInfo.mipLevels = environmentSpecularMips;
+	viewInfo.subresourceRange.levelCount = environmentSpecularMips;
+	Scope.ShareBetweenQueues(cubeInfo);
+
+	SpecularCube = std::make_unique<VulkanImage>(Scope);
+	SpecularCube->CreateImage(cubeInfo, allocCreateInfo)
+		.CreateImageView(viewInfo)
+		.CreateSampler(ESamplerType::LinearClamp)
+		.CreateMipViews()
+		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+
+	VkImageCreateInfo brdfInfo{};
+	brdfInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	brdfInfo.imageType = VK_IMAGE_TYPE_2D;
+	brdfInfo.format = VK_FORMAT_R16G16_SFLOAT;
+	brdfInfo.extent = brdfLutExtent;
+	brdfInfo.arrayLayers = 1;
+	brdfInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	brdfInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	brdfInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	brdfInfo.mipLevels = 1;
+	brdfInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	Scope.ShareBetweenQueues(brdfInfo);
+
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = brdfInfo.format;
+	viewInfo.subresourceRange.layerCount = 1;
+	viewInfo.subresourceRange.levelCount = 1;
+
+	BrdfLUT = std::make_unique<VulkanImage>(Scope);
+	BrdfLUT->CreateImage(brdfInfo, allocCreateInfo)
+		.CreateImageView(viewInfo)
+		.CreateSampler(ESamplerType::LinearClamp)
+		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+
+	// 9 irradiance SH coefficients followed by the sun radiance at the camera
+	VkBufferCreateInfo environmentInfo{};
+	environmentInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	environmentInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	environmentInfo.size = 10 * sizeof(TVec4);
+	Scope.ShareBetweenQueues(environmentInfo);
+	environmentBuffer = std::make_unique<Buffer>(Scope, environmentInfo, allocCreateInfo);
+
+	TAuto<DescriptorSet> brdfSet = DescriptorSetDescriptor()
+		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *BrdfLUT)
 		.Allocate(Scope);
 
-	skybox->pipeline = GraphicsPipelineDescriptor()
-		.SetShaderStage("fullscreen", VK_SHADER_STAGE_VERTEX_BIT)
-		.SetShaderStage("background_frag", VK_SHADER_STAGE_FRAGMENT_BIT)
-		.SetCullMode(VK_CULL_MODE_NONE)
-		.AddDescriptorLayout(UBOSet[0]->GetLayout())
-		.AddDescriptorLayout(skybox->descriptorSet->GetLayout())
+	TAuto<Pipeline> brdfPipeline = ComputePipelineDescriptor()
+		.SetShaderName("brdf_lut_comp")
+		.AddDescriptorLayout(brdfSet->GetLayout())
 		.Construct(Scope);
 
+	if (!IsPipelineValid(brdfPipeline))
+		return 0;
+
+	VkCommandBuffer cmd;
+	const Queue& Queue = Scope.GetQueue(VK_QUEUE_COMPUTE_BIT);
+	Queue.AllocateCommandBuffers(1, &cmd);
+	::BeginOneTimeSubmitCmd(cmd);
+
+	brdfPipeline->BindPipeline(cmd);
+	brdfSet->BindSet(0, cmd, *brdfPipeline);
+	vkCmdDispatch(cmd, (brdfLutExtent.width + 7) / 8, (brdfLutExtent.height + 7) / 8, 1);
+
+	::EndCommandBuffer(cmd);
+	work.signals.push_back(Queue.WaitInfo(Queue.Submit(cmd), VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+	work.keepAlive.emplace_back(std::move(brdfPipeline));
+	work.keepAlive.emplace_back(std::move(brdfSet));
+
+	environment_valid = false;
 	return 1;
 }
 
-VkBool32 VulkanBase::volumetric_precompute()
+VkBool32 VulkanBase::create_cloud_noise(StartupGraph::GpuWork& work)
 {
 	VmaAllocationCreateInfo allocCreateInfo{};
 	allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
@@ -332,37 +729,402 @@ VkBool32 VulkanBase::volumetric_precompute()
 	CloudLayerProfile defaultClouds{};
 	cloud_layer->Update(&defaultClouds, sizeof(CloudLayerProfile));
 
-	CloudShape = GRNoise::GenerateCloudShapeNoise(Scope, { 128u, 128u, 128u }, 4u, 4u);
-	CloudDetail = GRNoise::GenerateCloudDetailNoise(Scope, { 32u, 32u, 32u }, 6u, 3u);
+	GRNoise::NoiseBatch noiseBatch(Scope);
+	CloudShape = GRNoise::GenerateCloudShapeNoise(Scope, { 128u, 128u, 128u }, 4u, 4u, cloudShapeSeed, &noiseBatch);
+	CloudDetail = GRNoise::GenerateCloudDetailNoise(Scope, { 32u, 32u, 32u }, 6u, 3u, cloudDetailSeed, &noiseBatch);
+	noiseBatch.Submit();
+
+#if DEBUG == 1
+	// The batch leaves a GPU readback in the noise cache, the CPU port of noise.glsl should stay within
+	// a couple of 11-bit float steps of it, rounding of the GPU float path is not reproduced exactly
+	const uint32_t detailMismatches = GRNoise::CompareWithCache(Scope, "cloud_detail_comp", VK_FORMAT_B10G11R11_UFLOAT_PACK32, { 32u, 32u, 32u },
+		{ 6u, 3u, cloudDetailSeed }, GRNoise::BakeCloudDetailNoise({ 32u, 32u, 32u }, 6u, 3u, cloudDetailSeed), 64u, 1.f / 32.f);
+	if (detailMismatches != 0u && detailMismatches != UINT32_MAX)
+		std::cerr << "Cloud detail noise: " << detailMismatches << " of 64 CPU texels differ from cloud_detail.comp" << std::endl;
+#endif
+
+	return create_cloud_bounds(work);
+}
+
+VkBool32 VulkanBase::volumetric_precompute()
+{
+	VkBool32 res = create_cloud_lighting();
 
 	volume = std::make_unique<GraphicsObject>();
 	volume->descriptorSet = DescriptorSetDescriptor()
-		.AddUniformBuffer(1, VK_SHADER_STAGE_FRAGMENT_BIT, *cloud_layer)
-		.AddImageSampler(2, VK_SHADER_STAGE_FRAGMENT_BIT, *CloudShape)
-		.AddImageSampler(3, VK_SHADER_STAGE_FRAGMENT_BIT, *CloudDetail)
-		.AddImageSampler(4, VK_SHADER_STAGE_FRAGMENT_BIT, *Transmittance)
-		.AddImageSampler(5, VK_SHADER_STAGE_FRAGMENT_BIT, *IrradianceLUT)
-		.AddImageSampler(6, VK_SHADER_STAGE_FRAGMENT_BIT, *ScatteringLUT)
+		.AddUniformBuffer(1, VK_SHADER_STAGE_COMPUTE_BIT, *cloud_layer)
+		.AddImageSampler(2, VK_SHADER_STAGE_COMPUTE_BIT, *CloudShape)
+		.AddImageSampler(3, VK_SHADER_STAGE_COMPUTE_BIT, *CloudDetail)
+		.AddImageSampler(4, VK_SHADER_STAGE_COMPUTE_BIT, *Transmittance)
+		.AddImageSampler(5, VK_SHADER_STAGE_COMPUTE_BIT, *IrradianceLUT)
+		.AddImageSampler(7, VK_SHADER_STAGE_COMPUTE_BIT, *CloudBounds)
+		.AddImageSampler(8, VK_SHADER_STAGE_COMPUTE_BIT, *CloudLighting)
 		.Allocate(Scope);
 
-	VkPipelineColorBlendAttachmentState blendState{};
-	blendState.blendEnable = true;
-	blendState.colorBlendOp = VK_BLEND_OP_ADD;
-	blendState.alphaBlendOp = VK_BLEND_OP_ADD;
-	blendState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	blendState.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-	blendState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	blendState.dstColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	blendState.dstAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-
-	volume->pipeline = GraphicsPipelineDescriptor()
-		.SetShaderStage("fullscreen", VK_SHADER_STAGE_VERTEX_BIT)
-		.SetShaderStage("volumetric_frag", VK_SHADER_STAGE_FRAGMENT_BIT)
-		.SetBlendAttachments(1, &blendState)
+	cloudLightingPipeline = ComputePipelineDescriptor()
+		.SetShaderName("cloud_lighting_comp")
 		.AddDescriptorLayout(UBOSet[0]->GetLayout())
 		.AddDescriptorLayout(volume->descriptorSet->GetLayout())
-		.SetCullMode(VK_CULL_MODE_FRONT_BIT)
+		.AddDescriptorLayout(CloudLightingSet->GetLayout())
+		.AddPushConstant({ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TVec4) })
+		.Construct(Scope);
+
+	res = IsPipelineValid(cloudLightingPipeline) & res;
+
+	return create_cloud_targets() & res;
+}
+
+VkBool32 VulkanBase::create_cloud_bounds(StartupGraph::GpuWork& work)
+{
+	const VkExtent3D& shapeExtent = CloudShape->GetExtent();
+	const VkExtent3D extent = { glm::max(shapeExtent.width / cloudBoundsCell, 1u), glm::max(shapeExtent.height / cloudBoundsCell, 1u), glm::max(shapeExtent.depth / cloudBoundsCell, 1u) };
+
+	VkImageCreateInfo boundsInfo{};
+	boundsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	boundsInfo.format = VK_FORMAT_R32_SFLOAT;
+	boundsInfo.arrayLayers = 1;
+	boundsInfo.extent = extent;
+	boundsInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	boundsInfo.imageType = VK_IMAGE_TYPE_3D;
+	boundsInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	boundsInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	boundsInfo.mipLevels = 1;
+	boundsInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	boundsInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo boundsAllocCreateInfo{};
+	boundsAllocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_3D;
+	viewInfo.format = boundsInfo.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+
+	CloudBounds = std::make_unique<VulkanImage>(Scope);
+	CloudBounds->CreateImage(boundsInfo, boundsAllocCreateInfo)
+		.CreateImageView(viewInfo)
+		.CreateSampler(ESamplerType::PointRepeat)
+		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+
+	TAuto<DescriptorSet> boundsSet = DescriptorSetDescriptor()
+		.AddImageSampler(0, VK_SHADER_STAGE_COMPUTE_BIT, *CloudShape)
+		.AddStorageImage(1, VK_SHADER_STAGE_COMPUTE_BIT, *CloudBounds)
+		.Allocate(Scope);
+
+	TAuto<Pipeline> boundsPipeline = ComputePipelineDescriptor()
+		.SetShaderName("cloud_bounds_comp")
+		.AddDescriptorLayout(boundsSet->GetLayout())
 		.Construct(Scope);
-	
+
+	if (!IsPipelineValid(boundsPipeline))
+		return 0;
+
+	VkCommandBuffer cmd;
+	const Queue& Queue = Scope.GetQueue(VK_QUEUE_COMPUTE_BIT);
+	Queue.AllocateCommandBuffers(1, &cmd);
+	::BeginOneTimeSubmitCmd(cmd);
+
+	boundsPipeline->BindPipeline(cmd);
+	boundsSet->BindSet(0, cmd, *boundsPipeline);
+	vkCmdDispatch(cmd, (extent.width + 3) / 4, (extent.height + 3) / 4, (extent.depth + 3) / 4);
+
+	::EndCommandBuffer(cmd);
+	work.signals.push_back(Queue.WaitInfo(Queue.Submit(cmd), VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+	work.keepAlive.emplace_back(std::move(boundsPipeline));
+	work.keepAlive.emplace_back(std::move(boundsSet));
+
 	return 1;
-}
\ No newline at end of file
+}
+
+VkBool32 VulkanBase::create_cloud_lighting()
+{
+	VkImageCreateInfo lightingInfo{};
+	lightingInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	lightingInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+	lightingInfo.arrayLayers = 1;
+	lightingInfo.extent = cloudLightingExtent;
+	lightingInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	lightingInfo.imageType = VK_IMAGE_TYPE_3D;
+	lightingInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	lightingInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	lightingInfo.mipLevels = 1;
+	lightingInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	Scope.ShareBetweenQueues(lightingInfo);
+
+	VmaAllocationCreateInfo lightingAllocCreateInfo{};
+	lightingAllocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_3D;
+	viewInfo.format = lightingInfo.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+
+	CloudLighting = std::make_unique<VulkanImage>(Scope);
+	CloudLighting->CreateImage(lightingInfo, lightingAllocCreateInfo)
+		.CreateImageView(viewInfo)
+		.CreateSampler(ESamplerType::LinearClamp)
+		.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+
+	CloudLightingSet = DescriptorSetDescriptor()
+		.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, *CloudLighting)
+		.Allocate(Scope);
+
+	cloud_lighting_valid = false;
+
+	return CloudLightingSet != VK_NULL_HANDLE;
+}
+
+VkBool32 VulkanBase::create_cloud_targets()
+{
+	// Clouds are traced at half width and height, a quarter of the pixels
+	const VkExtent2D extent = { glm::max(Scope.GetSwapchainExtent().width / 2, 1u), glm::max(Scope.GetSwapchainExtent().height / 2, 1u) };
+
+	VkImageCreateInfo targetInfo{};
+	targetInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	targetInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+	targetInfo.arrayLayers = 1;
+	targetInfo.extent = { extent.width, extent.height, 1 };
+	targetInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	targetInfo.imageType = VK_IMAGE_TYPE_2D;
+	targetInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	targetInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	targetInfo.mipLevels = 1;
+	targetInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	Scope.ShareBetweenQueues(targetInfo);
+
+	VmaAllocationCreateInfo targetAllocCreateInfo{};
+	targetAllocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = targetInfo.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+
+	for (TAuto<VulkanImage>& target : cloudTargets)
+	{
+		target = std::make_unique<VulkanImage>(Scope);
+		target->CreateImage(targetInfo, targetAllocCreateInfo)
+			.CreateImageView(viewInfo)
+			.CreateSampler(ESamplerType::LinearClamp)
+			.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+	}
+
+	// View distance of the cloud front per texel, guides the depth aware upsample of the composite
+	targetInfo.format = VK_FORMAT_R32_SFLOAT;
+	viewInfo.format = targetInfo.format;
+	for (TAuto<VulkanImage>& target : cloudDepthTargets)
+	{
+		target = std::make_unique<VulkanImage>(Scope);
+		target->CreateImage(targetInfo, targetAllocCreateInfo)
+			.CreateImageView(viewInfo)
+			.CreateSampler(ESamplerType::PointClamp)
+			.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+	}
+
+	// Each frame writes one target and reprojects from the other, targets swap every frame
+	for (uint32_t i = 0; i < cloudTargets.size(); ++i)
+	{
+		const VulkanImage& target = *cloudTargets[i];
+		const VulkanImage& history = *cloudTargets[(i + 1) % cloudTargets.size()];
+		const VulkanImage& depth = *cloudDepthTargets[i];
+		const VulkanImage& historyDepth = *cloudDepthTargets[(i + 1) % cloudDepthTargets.size()];
+
+		CloudTraceSets[i] = DescriptorSetDescriptor()
+			.AddStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT, { VK_NULL_HANDLE, target.GetImageView(), VK_IMAGE_LAYOUT_GENERAL })
+			.AddImageSampler(1, VK_SHADER_STAGE_COMPUTE_BIT, { Scope.GetSampler(ESamplerType::LinearClamp), history.GetImageView(), VK_IMAGE_LAYOUT_GENERAL })
+			.AddStorageImage(2, VK_SHADER_STAGE_COMPUTE_BIT, { VK_NULL_HANDLE, depth.GetImageView(), VK_IMAGE_LAYOUT_GENERAL })
+			.AddImageSampler(3, VK_SHADER_STAGE_COMPUTE_BIT, { Scope.GetSampler(ESamplerType::PointClamp), historyDepth.GetImageView(), VK_IMAGE_LAYOUT_GENERAL })
+			.Allocate(Scope);
+
+		CloudCompositeSets[i] = DescriptorSetDescriptor()
+			.AddImageSampler(0, VK_SHADER_STAGE_FRAGMENT_BIT, { Scope.GetSampler(ESamplerType::PointClamp), target.GetImageView(), VK_IMAGE_LAYOUT_GENERAL })
+			.AddImageSampler(1, VK_SHADER_STAGE_FRAGMENT_BIT, { Scope.GetSampler(ESamplerType::PointClamp), depth.GetImageView(), VK_IMAGE_LAYOUT_GENERAL })
+			.Allocate(Scope);
+	}
+
+	// Scene depth of every frame slot, read at full resolution by the composite subpass
+	SceneDepthSets.resize(depthAttachments.size());
+	for (uint32_t i = 0; i < SceneDepthSets.size(); ++i)
+	{
+		SceneDepthSets[i] = DescriptorSetDescriptor()
+			.AddSubpassAttachment(0, VK_SHADER_STAGE_FRAGMENT_BIT, { VK_NULL_HANDLE, depthAttachments[i]->GetImageView(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL })
+			.Allocate(Scope);
+	}
+
+	clouds_valid = false;
+
+	if (!cloudTracePipeline)
+	{
+		cloudTracePipeline = ComputePipelineDescriptor()
+			.SetShaderName("volumetric_comp")
+			.AddDescriptorLayout(UBOSet[0]->GetLayout())
+			.AddDescriptorLayout(volume->descriptorSet->GetLayout())
+			.AddDescriptorLayout(CloudTraceSets[0]->GetLayout())
+			.AddPushConstant({ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CloudReprojectionConstants) })
+			.Construct(Scope);
+	}
+
+	if (!volume->pipeline)
+	{
+		VkPipelineColorBlendAttachmentState blendState{};
+		blendState.blendEnable = true;
+		blendState.colorBlendOp = VK_BLEND_OP_ADD;
+		blendState.alphaBlendOp = VK_BLEND_OP_ADD;
+		blendState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		blendState.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendState.dstColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		blendState.dstAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+
+		// Geometry is tested against the cloud depth in the shader, not by the depth test
+		volume->pipeline = GraphicsPipelineDescriptor()
+			.SetShaderStage("fullscreen_far", VK_SHADER_STAGE_VERTEX_BIT)
+			.SetShaderStage("volumetric_frag", VK_SHADER_STAGE_FRAGMENT_BIT)
+			.SetBlendAttachments(1, &blendState)
+			.SetDepthState(VK_FALSE, VK_FALSE)
+			.AddDescriptorLayout(UBOSet[0]->GetLayout())
+			.AddDescriptorLayout(CloudCompositeSets[0]->GetLayout())
+			.AddDescriptorLayout(SceneDepthSets[0]->GetLayout())
+			.SetCullMode(VK_CULL_MODE_FRONT_BIT)
+			.SetSubpass(1)
+			.Construct(Scope);
+	}
+
+	return IsPipelineValid(cloudTracePipeline) && IsPipelineValid(volume->pipeline);
+}
+
+VkBool32 VulkanBase::convert_atmosphere_luts(StartupGraph::GpuWork& work, const TVector<VkSemaphoreSubmitInfo>& waits)
+{
+	// Scattering keeps single Mie scattering in alpha, other LUTs leave it empty
+	const std::pair<TAuto<VulkanImage>*, bool> luts[] = { { &Transmittance, false }, { &IrradianceLUT, false }, { &ScatteringLUT, true } };
+
+	TVector<TAuto<VulkanImage>> converted(std::size(luts));
+
+	VkCommandBuffer cmd;
+	const Queue& Queue = Scope.GetQueue(VK_QUEUE_GRAPHICS_BIT);
+	Queue.AllocateCommandBuffers(1, &cmd);
+	::BeginOneTimeSubmitCmd(cmd);
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+
+	for (uint32_t i = 0; i < std::size(luts); i++)
+	{
+		const VulkanImage& source = **luts[i].first;
+		const VkFormat format = select_lut_format(Scope, lut_precision, luts[i].second);
+
+		if (format == VK_FORMAT_R32G32B32A32_SFLOAT)
+			continue;
+
+		const VkExtent3D& extent = source.GetExtent();
+
+		VkImageCreateInfo imageCI{};
+		imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCI.arrayLayers = 1;
+		imageCI.extent = extent;
+		imageCI.format = format;
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageCI.mipLevels = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCI.imageType = extent.depth > 1 ? VK_IMAGE_TYPE_3D : VK_IMAGE_TYPE_2D;
+		// Copied on the graphics queue, sampled on both queues
+		Scope.ShareBetweenQueues(imageCI);
+
+		VkImageViewCreateInfo imageViewCI{};
+		imageViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		imageViewCI.format = format;
+		imageViewCI.viewType = extent.depth > 1 ? VK_IMAGE_VIEW_TYPE_3D : VK_IMAGE_VIEW_TYPE_2D;
+		imageViewCI.subresourceRange = source.GetSubResourceRange();
+
+		VmaAllocationCreateInfo imageAlloc{};
+		imageAlloc.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+		converted[i] = std::make_unique<VulkanImage>(Scope);
+		converted[i]->CreateImage(imageCI, imageAlloc)
+			.CreateImageView(imageViewCI)
+			.CreateSampler(ESamplerType::PointClamp)
+			.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+
+		VkImageBlit region{};
+		region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.srcSubresource.layerCount = 1;
+		region.srcOffsets[1] = { static_cast<int32_t>(extent.width), static_cast<int32_t>(extent.height), static_cast<int32_t>(extent.depth) };
+		region.dstSubresource = region.srcSubresource;
+		region.dstOffsets[1] = region.srcOffsets[1];
+		vkCmdBlitImage(cmd, source.GetImage(), VK_IMAGE_LAYOUT_GENERAL, converted[i]->GetImage(), VK_IMAGE_LAYOUT_GENERAL, 1u, &region, VK_FILTER_NEAREST);
+	}
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+
+	::EndCommandBuffer(cmd);
+
+	Queue::Batch blit{};
+	blit.commandBuffers = { cmd };
+	blit.waits = waits;
+	work.signals.push_back(Queue.WaitInfo(Queue.Submit({ blit }), VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+
+	// Sources are still read by the blits
+	for (uint32_t i = 0; i < std::size(luts); i++)
+	{
+		if (converted[i]) {
+			work.keepAlive.emplace_back(std::move(*luts[i].first));
+			*luts[i].first = std::move(converted[i]);
+		}
+	}
+
+	return 1;
+}
+
+VkBool32 VulkanBase::MeasureLutQuantizationError(ELutPrecision precision, AtmosphereLutError& outError) const
+{
+	const VulkanImage* luts[] = { Transmittance.get(), IrradianceLUT.get(), ScatteringLUT.get() };
+	LutError* errors[] = { &outError.Transmittance, &outError.Irradiance, &outError.Scattering };
+	const bool alpha[] = { false, false, true };
+
+	VkDeviceSize size = 0;
+	for (const VulkanImage* lut : luts) {
+		size += lut_size(*lut);
+	}
+
+	// Converted LUTs keep their extents, so the key matches the one used to store the cache.
+	// Settings of the LUTs in use only match the cache once a runtime recompute has written its entry
+	const uint64_t key = atmosphere_cache_key(Scope.GetShaderRegistry(), { luts[0], luts[1], luts[2] }, atmosphere);
+
+	TVector<char> texels = {};
+	if (key == 0 || !read_atmosphere_cache(key, size, texels))
+		return 0;
+
+	VkDeviceSize offset = 0;
+	for (uint32_t i = 0; i < std::size(luts); i++)
+	{
+		const VkExtent3D& extent = luts[i]->GetExtent();
+		const size_t texelCount = static_cast<size_t>(extent.width) * extent.height * extent.depth;
+
+		*errors[i] = measure_lut_error(select_lut_format(Scope, precision, alpha[i]), reinterpret_cast<const float*>(texels.data() + offset), texelCount, alpha[i]);
+		offset += lut_size(*luts[i]);
+	}
+
+	return 1;
+}
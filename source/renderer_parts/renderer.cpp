@@ -11,20 +11,38 @@
 #include "imgui/imgui_impl_glfw.h"
 #endif
 
-VulkanBase::VulkanBase(GLFWwindow* window, entt::registry& in_registry)
+extern std::string exec_path;
+
+// Cloud lighting volume is rebaked once the camera leaves its snapped cell, meters
+static const float cloudLightingSnap = 1e3f;
+// or the sun turns by more than about half a degree
+static const float cloudLightingSunCos = 0.99996f;
+// Wind speed multiplier of the cloud shape uv in clouds.glsl
+static const float cloudShapeWindScale = 0.01f;
+
+VulkanBase::VulkanBase(GLFWwindow* window, entt::registry& in_registry, ELutPrecision lutPrecision)
 	: glfwWindow(window), registry(in_registry)
 {
+	lut_precision = lutPrecision;
+
 	VkPhysicalDeviceFeatures deviceFeatures{};
-	TVector<VkDescriptorPoolSize> poolSizes(3);
+	TVector<VkDescriptorPoolSize> poolSizes(6);
 	deviceFeatures.imageCubeArray = VK_TRUE;
 	deviceFeatures.fullDrawIndexUint32 = VK_TRUE;
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.multiDrawIndirect = VK_TRUE;
 	poolSizes[0].descriptorCount = 100u;
 	poolSizes[0].type = VK_DESCRIPTOR_TYPE_SAMPLER;
 	poolSizes[1].descriptorCount = 100u;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 	poolSizes[2].descriptorCount = 100u;
 	poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[3].descriptorCount = 100u;
+	poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[4].descriptorCount = 100u;
+	poolSizes[4].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[5].descriptorCount = 16u;
+	poolSizes[5].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
 
 	VkBool32 res = create_instance();
 	
@@ -35,7 +53,11 @@ VulkanBase::VulkanBase(GLFWwindow* window, entt::registry& in_registry)
 		.CreateMemoryAllocator(instance)
 		.CreateSwapchain(surface)
 		.CreateDefaultRenderPass()
-		.CreateDescriptorPool(100u, poolSizes);
+		.CreateDescriptorAllocator(100u, poolSizes)
+		.CreateShaderRegistry(exec_path + "shaders\\")
+		.CreateWorkerPool(std::max(std::thread::hardware_concurrency(), 2u) - 1u);
+
+	streamer = std::make_unique<TextureStreamer>(Scope);
 	
 	res = create_swapchain_images() & res;
 	res = create_framebuffers() & res;
@@ -63,9 +85,26 @@ VulkanBase::VulkanBase(GLFWwindow* window, entt::registry& in_registry)
 		res = CreateFence(Scope.GetDevice(), &it, VK_TRUE) & res;
 	});
 
-	res = prepare_renderer_resources() & res;
-	res = atmosphere_precompute() & res;
-	res = volumetric_precompute() & res;
+	computeBuffers.resize(swapchainImages.size());
+	Scope.GetQueue(VK_QUEUE_COMPUTE_BIT)
+		.AllocateCommandBuffers(computeBuffers.size(), computeBuffers.data());
+
+	res = CreateTimelineSemaphore(Scope.GetDevice(), &graphicsTimeline) & res;
+	res = CreateTimelineSemaphore(Scope.GetDevice(), &computeTimeline) & res;
+
+	// LUTs, cloud noise and default textures do not depend on each other, their uploads and bakes overlap
+	StartupGraph startup;
+	const StartupGraph::Node resources = startup.AddNode("renderer_resources", {}, [this](StartupGraph::GpuWork& work) { return prepare_renderer_resources(work); });
+	const StartupGraph::Node luts = startup.AddNode("atmosphere_luts", {}, [this](StartupGraph::GpuWork& work) { return create_atmosphere_luts(work); });
+	const StartupGraph::Node noise = startup.AddNode("cloud_noise", {}, [this](StartupGraph::GpuWork& work) { return create_cloud_noise(work); });
+	startup.AddNode("default_textures", {}, [this](StartupGraph::GpuWork&) { return create_default_textures(); });
+	startup.AddNode("atmosphere_resources", { resources, luts }, [this](StartupGraph::GpuWork&) { return atmosphere_precompute(); });
+	startup.AddNode("volumetric_resources", { resources, luts, noise }, [this](StartupGraph::GpuWork&) { return volumetric_precompute(); });
+
+	res = startup.Run(Scope.GetWorkerPool()) & res;
+	// Dependents only create descriptors for the baked resources, frames are the first to read them
+	startup.WaitGpu(Scope.GetDevice());
+	startupTimings = startup.GetTimings();
 	
 #ifdef INCLUDE_GUI
 	std::vector<VkDescriptorPoolSize> pool_sizes =
@@ -96,7 +135,7 @@ VulkanBase::VulkanBase(GLFWwindow* window, entt::registry& in_registry)
 	init_info.ImageCount = 3;
 	init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
 	init_info.RenderPass = Scope.GetRenderPass();
-	init_info.Subpass = 1;
+	init_info.Subpass = 2;
 
 	ImGui_ImplVulkan_Init(&init_info);
 #endif
@@ -107,6 +146,7 @@ VulkanBase::VulkanBase(GLFWwindow* window, entt::registry& in_registry)
 VulkanBase::~VulkanBase() noexcept
 {
 	vkWaitForFences(Scope.GetDevice(), presentFences.size(), presentFences.data(), VK_TRUE, UINT64_MAX);
+	WaitTimelineSemaphore(Scope.GetDevice(), computeTimeline, frame_count);
 
 #ifdef INCLUDE_GUI
 	ImGui_ImplVulkan_Shutdown();
@@ -116,10 +156,35 @@ VulkanBase::~VulkanBase() noexcept
 	skybox.reset();
 	volume.reset();
 	ubo.resize(0);
+	atmosphereUbo.resize(0);
+	atmosphereBaker.reset();
+	store_atmosphere_readback();
+	for (TAuto<VulkanImage>& target : atmosphereTargets) {
+		target.reset();
+	}
 
 	cloud_layer.reset();
 	CloudShape.reset();
 	CloudDetail.reset();
+	CloudBounds.reset();
+	cloudLightingPipeline.reset();
+	CloudLightingSet.reset();
+	CloudLighting.reset();
+
+	skyViewPipeline.reset();
+	aerialPerspectivePipeline.reset();
+	SkyLutSet.reset();
+	frameGraph.reset();
+
+	environmentCubePipeline.reset();
+	environmentPrefilterPipeline.reset();
+	environmentSHPipeline.reset();
+	EnvironmentCubeSet.reset();
+	EnvironmentSHSet.reset();
+	std::for_each(EnvironmentPrefilterSets.begin(), EnvironmentPrefilterSets.end(), [](TAuto<DescriptorSet>& set) { set.reset(); });
+	environmentBuffer.reset();
+	SpecularCube.reset();
+	BrdfLUT.reset();
 
 	Transmittance.reset();
 	ScatteringLUT.reset();
@@ -135,6 +200,9 @@ VulkanBase::~VulkanBase() noexcept
 		GRComponents::NormalDisplacementMap,
 		GRComponents::AORoughnessMetallicMap>();
 
+	retired.clear();
+	streamer.reset();
+
 	std::erase_if(presentFences, [&, this](VkFence& it) {
 			vkDestroyFence(Scope.GetDevice(), it, VK_NULL_HANDLE);
 			return true;
@@ -148,6 +216,9 @@ VulkanBase::~VulkanBase() noexcept
 			return true;
 	});
 	Scope.GetQueue(VK_QUEUE_GRAPHICS_BIT) .FreeCommandBuffers(presentBuffers.size(), presentBuffers.data());
+	Scope.GetQueue(VK_QUEUE_COMPUTE_BIT).FreeCommandBuffers(computeBuffers.size(), computeBuffers.data());
+	vkDestroySemaphore(Scope.GetDevice(), graphicsTimeline, VK_NULL_HANDLE);
+	vkDestroySemaphore(Scope.GetDevice(), computeTimeline, VK_NULL_HANDLE);
 	std::erase_if(framebuffers, [&, this](VkFramebuffer& fb) {
 			vkDestroyFramebuffer(Scope.GetDevice(), fb, VK_NULL_HANDLE);
 			return true;
@@ -160,6 +231,22 @@ VulkanBase::~VulkanBase() noexcept
 	hdrAttachments.clear();
 	HDRPipelines.resize(0);
 	HDRDescriptors.resize(0);
+	meshletCullPipeline.reset();
+	pbrPipeline.reset();
+	DrawCommandSets.resize(0);
+	drawCommands.resize(0);
+	hizReducePipeline.reset();
+	HiZDepthSets.resize(0);
+	HiZReduceSets.resize(0);
+	OcclusionSets.resize(0);
+	occlusionUbo.resize(0);
+	hizPyramid.reset();
+	cloudTracePipeline.reset();
+	std::for_each(CloudTraceSets.begin(), CloudTraceSets.end(), [](TAuto<DescriptorSet>& set) { set.reset(); });
+	std::for_each(CloudCompositeSets.begin(), CloudCompositeSets.end(), [](TAuto<DescriptorSet>& set) { set.reset(); });
+	SceneDepthSets.resize(0);
+	std::for_each(cloudTargets.begin(), cloudTargets.end(), [](TAuto<VulkanImage>& target) { target.reset(); });
+	std::for_each(cloudDepthTargets.begin(), cloudDepthTargets.end(), [](TAuto<VulkanImage>& target) { target.reset(); });
 	UBOSet.resize(0);
 
 	Scope.Destroy();
@@ -176,13 +263,38 @@ void VulkanBase::_step(float DeltaTime)
 	vkWaitForFences(Scope.GetDevice(), 1, &presentFences[swapchain_index], VK_TRUE, UINT64_MAX);
 	vkResetFences(Scope.GetDevice(), 1, &presentFences[swapchain_index]);
 
+	frame_count++;
+	std::erase_if(retired, [&, this](const std::pair<uint64_t, TShared<void>>& it) {
+		return frame_count - it.first > swapchainImages.size();
+	});
+
+	// Evicted resources are freed with the frames in flight, usage only drops once they are done
+	Scope.UpdateMemoryBudget(static_cast<uint32_t>(frame_count));
+	if (frame_count - last_pressure_relief > swapchainImages.size()) {
+		for (const auto& heap : Scope.GetMemoryBudget()) {
+			if (heap.DeviceLocal && heap.Usage > heap.Budget && Scope.RelieveMemoryPressure(heap.Usage - heap.Budget))
+				last_pressure_relief = frame_count;
+		}
+	}
+
+	streamer->Update();
+
 	vkAcquireNextImageKHR(Scope.GetDevice(), Scope.GetSwapchain(), UINT64_MAX, swapchainSemaphores[swapchain_index], VK_NULL_HANDLE, &swapchain_index);
 
 	const VkCommandBuffer& cmd = presentBuffers[swapchain_index];
+	const VkCommandBuffer& asyncCmd = computeBuffers[frame_count % computeBuffers.size()];
+
+	// Async command buffer and attachments of the frame slot are reused once the submissions that used them last are done
+	if (frame_count > computeBuffers.size())
+	{
+		WaitTimelineSemaphore(Scope.GetDevice(), computeTimeline, frame_count - computeBuffers.size());
+		WaitTimelineSemaphore(Scope.GetDevice(), graphicsTimeline, frame_count - computeBuffers.size());
+	}
 
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	vkBeginCommandBuffer(cmd, &beginInfo);
+	vkBeginCommandBuffer(asyncCmd, &beginInfo);
 
 	//UBO
 	{
@@ -206,100 +318,121 @@ void VulkanBase::_step(float DeltaTime)
 		};
 
 		ubo[swapchain_index]->Update(static_cast<void*>(&Uniform), sizeof(Uniform));
+		atmosphereUbo[swapchain_index]->Update(static_cast<void*>(&atmosphere), sizeof(AtmosphereProfile));
+
+		OcclusionUniform Occlusion
+		{
+			previous_view_projection,
+			TVec4(hiz_valid && occlusion_culling ? 1.0 : 0.0, static_cast<float>(hizPyramid->GetSubResourceRange().levelCount), 0.0, 0.0)
+		};
+
+		occlusionUbo[swapchain_index]->Update(static_cast<void*>(&Occlusion), sizeof(Occlusion));
 	}
 
-	//Draw
+	// Atmosphere LUTs are copied by the last graphics pass, new settings apply from the next frame
+	atmosphere_semaphore = VK_NULL_HANDLE;
+	frameGraph->Execute(cmd, asyncCmd);
+
+	vkEndCommandBuffer(cmd);
+	vkEndCommandBuffer(asyncCmd);
+
+	// Async passes may reuse resources graphics passes of the previous frame still access
+	const uint64_t previousFrame = frame_count - 1;
+	const VkPipelineStageFlags graphicsWaitStages = frameGraph->GetGraphicsWaitStages();
+
+	VkTimelineSemaphoreSubmitInfo asyncTimelineInfo{};
+	asyncTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	asyncTimelineInfo.waitSemaphoreValueCount = graphicsWaitStages != 0 ? 1 : 0;
+	asyncTimelineInfo.pWaitSemaphoreValues = &previousFrame;
+	asyncTimelineInfo.signalSemaphoreValueCount = 1;
+	asyncTimelineInfo.pSignalSemaphoreValues = &frame_count;
+
+	VkSubmitInfo asyncSubmitInfo{};
+	asyncSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	asyncSubmitInfo.pNext = &asyncTimelineInfo;
+	asyncSubmitInfo.waitSemaphoreCount = asyncTimelineInfo.waitSemaphoreValueCount;
+	asyncSubmitInfo.pWaitSemaphores = &graphicsTimeline;
+	asyncSubmitInfo.pWaitDstStageMask = &graphicsWaitStages;
+	asyncSubmitInfo.commandBufferCount = 1;
+	asyncSubmitInfo.pCommandBuffers = &asyncCmd;
+	asyncSubmitInfo.signalSemaphoreCount = 1;
+	asyncSubmitInfo.pSignalSemaphores = &computeTimeline;
+
+	VkResult res = VK_SUCCESS;
 	{
-		VkClearValue clearValues[3];
-		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-		clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-		clearValues[2].depthStencil = { 1.0f, 0 };
-
-		VkRenderPassBeginInfo renderPassInfo{};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.framebuffer = framebuffers[swapchain_index];
-		renderPassInfo.renderPass = Scope.GetRenderPass();
-		renderPassInfo.renderArea.offset = { 0, 0 }; 
-		renderPassInfo.renderArea.extent = Scope.GetSwapchainExtent();
-		renderPassInfo.clearValueCount = 3;
-		renderPassInfo.pClearValues = clearValues;
-
-		VkViewport viewport{};
-		viewport.x = 0;
-		viewport.y = 0;
-		viewport.width = (float)Scope.GetSwapchainExtent().width;
-		viewport.height = (float)Scope.GetSwapchainExtent().height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-		vkCmdSetViewport(cmd, 0, 1, &viewport);
-
-		VkRect2D scissor{};
-		scissor.offset = { 0, 0 };
-		scissor.extent = Scope.GetSwapchainExtent();
-		vkCmdSetScissor(cmd, 0, 1, &scissor);
-
-		vkCmdBeginRenderPass(cmd, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-		render_objects(cmd);
-
-		UBOSet[swapchain_index]->BindSet(0, cmd, *skybox->pipeline);
-		skybox->descriptorSet->BindSet(1, cmd, *skybox->pipeline);
-		skybox->pipeline->BindPipeline(cmd);
-		vkCmdDraw(cmd, 36, 1, 0, 0);
-
-		UBOSet[swapchain_index]->BindSet(0, cmd, *volume->pipeline);
-		volume->descriptorSet->BindSet(1, cmd, *volume->pipeline);
-		volume->pipeline->BindPipeline(cmd);
-		vkCmdDraw(cmd, 3, 1, 0, 0);
-
-		vkCmdNextSubpass(cmd, VK_SUBPASS_CONTENTS_INLINE);
-
-		HDRDescriptors[swapchain_index]->BindSet(0, cmd, *HDRPipelines[swapchain_index]);
-		HDRPipelines[swapchain_index]->BindPipeline(cmd);
-		vkCmdDraw(cmd, 3, 1, 0, 0);
+		const Queue& computeQueue = Scope.GetQueue(VK_QUEUE_COMPUTE_BIT);
+		std::lock_guard<std::mutex> guard(computeQueue.GetSubmitLock());
+		res = vkQueueSubmit(computeQueue.GetQueue(), 1, &asyncSubmitInfo, VK_NULL_HANDLE);
+	}
 
-#ifdef INCLUDE_GUI
-		ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
-#endif
+	assert(res != VK_ERROR_DEVICE_LOST);
+
+	VkSubmitInfo submitInfo{};
+	TVector<VkSemaphore> waitSemaphores     = { swapchainSemaphores[swapchain_index] };
+	TArray<VkSemaphore, 2> signalSemaphores = { presentSemaphores[swapchain_index], graphicsTimeline };
+
+	TVector<VkPipelineStageFlags> waitStages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
-		vkCmdEndRenderPass(cmd);
-		vkEndCommandBuffer(cmd);
+	// Values of binary semaphores are ignored
+	TVector<uint64_t> waitValues = { 0 };
+	TArray<uint64_t, 2> signalValues = { 0, frame_count };
+
+	// Freshly baked atmosphere LUTs are copied at the end of the frame
+	if (atmosphere_semaphore != VK_NULL_HANDLE)
+	{
+		waitSemaphores.push_back(atmosphere_semaphore);
+		waitStages.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT);
+		waitValues.push_back(0);
 	}
 
-	VkSubmitInfo submitInfo{};
-	TArray<VkSemaphore, 1> waitSemaphores   = { swapchainSemaphores[swapchain_index] };
-	TArray<VkSemaphore, 1> signalSemaphores = { presentSemaphores[swapchain_index] };
+	if (frameGraph->GetAsyncWaitStages() != 0)
+	{
+		waitSemaphores.push_back(computeTimeline);
+		waitStages.push_back(frameGraph->GetAsyncWaitStages());
+		waitValues.push_back(frame_count);
+	}
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = waitValues.size();
+	timelineInfo.pWaitSemaphoreValues = waitValues.data();
+	timelineInfo.signalSemaphoreValueCount = signalValues.size();
+	timelineInfo.pSignalSemaphoreValues = signalValues.data();
 
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
 	submitInfo.waitSemaphoreCount = waitSemaphores.size();
 	submitInfo.pWaitSemaphores = waitSemaphores.data();
-	submitInfo.pWaitDstStageMask = waitStages;
+	submitInfo.pWaitDstStageMask = waitStages.data();
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &presentBuffers[swapchain_index];
 	submitInfo.signalSemaphoreCount = signalSemaphores.size();
 	submitInfo.pSignalSemaphores = signalSemaphores.data();
 
-	VkResult res = vkQueueSubmit(Scope.GetQueue(VK_QUEUE_GRAPHICS_BIT).GetQueue(), 1, &submitInfo, presentFences[swapchain_index]);
+	const Queue& graphicsQueue = Scope.GetQueue(VK_QUEUE_GRAPHICS_BIT);
+	std::lock_guard<std::mutex> guard(graphicsQueue.GetSubmitLock());
+
+	res = vkQueueSubmit(graphicsQueue.GetQueue(), 1, &submitInfo, presentFences[swapchain_index]);
 
 	assert(res != VK_ERROR_DEVICE_LOST);
 
 	VkPresentInfoKHR presentInfo{};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.waitSemaphoreCount = signalSemaphores.size();
-	presentInfo.pWaitSemaphores = signalSemaphores.data();
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores = &presentSemaphores[swapchain_index];
 	presentInfo.swapchainCount = 1;
 	presentInfo.pSwapchains = &Scope.GetSwapchain();
 	presentInfo.pImageIndices = &swapchain_index;
 	presentInfo.pResults = VK_NULL_HANDLE;
 
-	vkQueuePresentKHR(Scope.GetQueue(VK_QUEUE_GRAPHICS_BIT).GetQueue(), &presentInfo);
+	vkQueuePresentKHR(graphicsQueue.GetQueue(), &presentInfo);
 	swapchain_index = (swapchain_index + 1) % swapchainImages.size();
 }
 
 void VulkanBase::_handleResize()
 {
 	vkWaitForFences(Scope.GetDevice(), presentFences.size(), presentFences.data(), VK_TRUE, UINT64_MAX);
+	WaitTimelineSemaphore(Scope.GetDevice(), computeTimeline, frame_count);
 
 	std::erase_if(framebuffers, [&, this](VkFramebuffer& fb) {
 		vkDestroyFramebuffer(Scope.GetDevice(), fb, VK_NULL_HANDLE);
@@ -323,6 +456,8 @@ void VulkanBase::_handleResize()
 	create_swapchain_images();
 	create_framebuffers();
 	create_hdr_pipeline();
+	create_hiz_pyramid();
+	create_cloud_targets();
 
 	camera.Projection.SetFOV(glm::radians(45.f), static_cast<float>(Scope.GetSwapchainExtent().width) / static_cast<float>(Scope.GetSwapchainExtent().height))
 		.SetDepthRange(1e-2f, 1e4f);
@@ -343,9 +478,9 @@ void VulkanBase::_handleResize()
 	assert(swapchainImages.size() == presentBuffers.size());
 }
 
-TAuto<VulkanImage> VulkanBase::_loadImage(const std::string& path, VkFormat format)
+TShared<VulkanImage> VulkanBase::_loadImage(const std::string& path, VkFormat format)
 {
-	return GRVkFile::_importImage(Scope, path.c_str(), format, 0);
+	return streamer->Load(path, format);
 }
 
 void VulkanBase::Wait() const
@@ -356,6 +491,117 @@ void VulkanBase::Wait() const
 void VulkanBase::SetCloudLayerSettings(CloudLayerProfile settings)
 {
 	cloud_layer->Update(&settings, sizeof(CloudLayerProfile));
+	cloud_settings = settings;
+	cloud_lighting_valid = false;
+	clouds_valid = false;
+}
+
+void VulkanBase::SetTextureMemoryBudget(VkDeviceSize bytes)
+{
+	streamer->SetBudget(bytes);
+}
+
+TVector<HeapBudget> VulkanBase::GetMemoryBudget() const
+{
+	return Scope.GetMemoryBudget();
+}
+
+uint32_t VulkanBase::AddMemoryPressureCallback(uint32_t priority, MemoryPressureCallback callback)
+{
+	return Scope.RegisterEvictable(priority, callback);
+}
+
+void VulkanBase::RemoveMemoryPressureCallback(uint32_t handle)
+{
+	Scope.UnregisterEvictable(handle);
+}
+
+void VulkanBase::SetLodPixelError(float pixels)
+{
+	lod_pixel_error = pixels;
+}
+
+const RenderStats& VulkanBase::GetRenderStats() const
+{
+	return stats;
+}
+
+const TVector<StartupTiming>& VulkanBase::GetStartupTimings() const
+{
+	return startupTimings;
+}
+
+void VulkanBase::SetOcclusionCulling(bool enable)
+{
+	occlusion_culling = enable;
+}
+
+void VulkanBase::cull_objects(VkCommandBuffer cmd)
+{
+	auto view = registry.view<PBRObject, GRComponents::Transform>();
+	const TVec3 CameraPosition = camera.View.GetOffset();
+	const float PixelsPerUnit = glm::abs(camera.get_projection_matrix()[1][1]) * static_cast<float>(Scope.GetSwapchainExtent().height);
+
+	stats = {};
+
+	TVector<std::pair<DescriptorSet*, MeshletCullConstants>> dispatches = {};
+	dispatches.reserve(view.size_hint());
+
+	// Every entity gets one draw command per meshlet of its selected level of detail
+	uint32_t commandCount = 0;
+	for (const auto& [ent, gro, world] : view.each())
+	{
+		// Approximate on-screen diameter of the object, textures are assumed to span it once
+		const TVec4& bounds = gro.mesh->GetBoundingSphere();
+		const TVec3 center = TVec3(world.matrix * TVec4(TVec3(bounds), 1.0));
+		const float scale = glm::max(glm::length(TVec3(world.matrix[0])), glm::max(glm::length(TVec3(world.matrix[1])), glm::length(TVec3(world.matrix[2]))));
+		const float PixelsPerWorldUnit = scale / glm::max(glm::distance(center, CameraPosition), 1e-2f) * PixelsPerUnit;
+		const float ScreenSize = bounds.w * PixelsPerWorldUnit;
+
+		streamer->Request(registry.get<GRComponents::AlbedoMap>(ent).Get().get(), ScreenSize);
+		streamer->Request(registry.get<GRComponents::NormalDisplacementMap>(ent).Get().get(), ScreenSize);
+		streamer->Request(registry.get<GRComponents::AORoughnessMetallicMap>(ent).Get().get(), ScreenSize);
+
+		// Coarsest level whose error stays below the threshold, PixelsPerUnit spans the whole [-1, 1] clip range
+		uint32_t level = 0;
+		while (level + 1 < gro.mesh->GetLodCount()
+			&& gro.mesh->GetLod(level + 1).error * PixelsPerWorldUnit * 0.5f <= lod_pixel_error)
+		{
+			level++;
+		}
+
+		const MeshLod& lod = gro.mesh->GetLod(level);
+		registry.get<GRComponents::LevelOfDetail>(ent) = { level, gro.mesh->GetLodCount(), lod.indexCount / 3 };
+		stats.DrawCalls++;
+		stats.Meshlets += lod.meshletCount;
+		stats.Triangles += lod.indexCount / 3;
+
+		gro.lod = level;
+		gro.firstCommand = commandCount;
+		commandCount += lod.meshletCount;
+
+		dispatches.push_back({ gro.meshletSet.get(), { world.matrix, lod.firstMeshlet, lod.meshletCount, gro.firstCommand, scale, TVec4(center, bounds.w * scale) } });
+	}
+
+	if (commandCount > drawCommandCapacity)
+	{
+		create_draw_commands(glm::max(commandCount, drawCommandCapacity * 2));
+	}
+
+	if (dispatches.empty())
+		return;
+
+	meshletCullPipeline->BindPipeline(cmd);
+	UBOSet[swapchain_index]->BindSet(0, cmd, *meshletCullPipeline);
+	DrawCommandSets[swapchain_index]->BindSet(2, cmd, *meshletCullPipeline);
+	OcclusionSets[swapchain_index]->BindSet(3, cmd, *meshletCullPipeline);
+
+	for (auto& [set, C] : dispatches)
+	{
+		set->BindSet(1, cmd, *meshletCullPipeline);
+		meshletCullPipeline->PushConstants(cmd, &C, sizeof(MeshletCullConstants), 0u, VK_SHADER_STAGE_COMPUTE_BIT);
+		vkCmdDispatch(cmd, (C.MeshletCount + 63) / 64, 1, 1);
+	}
 }
 
 void VulkanBase::render_objects(VkCommandBuffer cmd)
@@ -365,9 +611,9 @@ void VulkanBase::render_objects(VkCommandBuffer cmd)
 	VkDeviceSize offsets[] = { 0 };
 	for (const auto& [ent, gro, world] : view.each())
 	{
-		if (gro.dirty)
+		if (gro.dirty || gro.revision != get_textures_revision(ent))
 		{
-			update_pipeline(ent);
+			update_pbr_set(ent);
 		}
 
 		PBRConstants C{};
@@ -377,14 +623,217 @@ void VulkanBase::render_objects(VkCommandBuffer cmd)
 		C.Metallic = registry.get<GRComponents::MetallicOverride>(ent).M;
 		C.HeightScale = registry.get<GRComponents::DisplacementScale>(ent).H;
 
-		UBOSet[swapchain_index]->BindSet(0, cmd, *gro.pipeline);
-		gro.descriptorSet->BindSet(1, cmd, *gro.pipeline);
-		gro.pipeline->PushConstants(cmd, &C.World, sizeof(PBRConstants::World), 0u, VK_SHADER_STAGE_VERTEX_BIT);
-		gro.pipeline->PushConstants(cmd, &C.Color, sizeof(PBRConstants) - sizeof(PBRConstants::World), offsetof(PBRConstants, Color), VK_SHADER_STAGE_FRAGMENT_BIT);
-		gro.pipeline->BindPipeline(cmd);
+		UBOSet[swapchain_index]->BindSet(0, cmd, *pbrPipeline);
+		gro.descriptorSet->BindSet(1, cmd, *pbrPipeline);
+		pbrPipeline->PushConstants(cmd, &C.World, sizeof(PBRConstants::World), 0u, VK_SHADER_STAGE_VERTEX_BIT);
+		pbrPipeline->PushConstants(cmd, &C.Color, sizeof(PBRConstants) - sizeof(PBRConstants::World), offsetof(PBRConstants, Color), VK_SHADER_STAGE_FRAGMENT_BIT);
+		pbrPipeline->BindPipeline(cmd);
 
 		vkCmdBindVertexBuffers(cmd, 0, 1, &gro.mesh->GetVertexBuffer()->GetBuffer(), offsets);
 		vkCmdBindIndexBuffer(cmd, gro.mesh->GetIndexBuffer()->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(cmd, gro.mesh->GetIndicesCount(), 1, 0, 0, 0);
+		vkCmdDrawIndexedIndirect(cmd, drawCommands[swapchain_index]->GetBuffer(), gro.firstCommand * sizeof(VkDrawIndexedIndirectCommand),
+			gro.mesh->GetLod(gro.lod).meshletCount, sizeof(VkDrawIndexedIndirectCommand));
+	}
+}
+
+void VulkanBase::draw_scene(VkCommandBuffer cmd)
+{
+	VkClearValue clearValues[3];
+	clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+	clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+	clearValues[2].depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.framebuffer = framebuffers[(frame_count % hdrAttachments.size()) * swapchainImages.size() + swapchain_index];
+	renderPassInfo.renderPass = Scope.GetRenderPass();
+	renderPassInfo.renderArea.offset = { 0, 0 }; 
+	renderPassInfo.renderArea.extent = Scope.GetSwapchainExtent();
+	renderPassInfo.clearValueCount = 3;
+	renderPassInfo.pClearValues = clearValues;
+
+	VkViewport viewport{};
+	viewport.x = 0;
+	viewport.y = 0;
+	viewport.width = (float)Scope.GetSwapchainExtent().width;
+	viewport.height = (float)Scope.GetSwapchainExtent().height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = Scope.GetSwapchainExtent();
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+	vkCmdBeginRenderPass(cmd, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	render_objects(cmd);
+
+	UBOSet[swapchain_index]->BindSet(0, cmd, *skybox->pipeline);
+	skybox->pipeline->BindPipeline(cmd);
+	vkCmdDraw(cmd, 3, 1, 0, 0);
+
+	vkCmdNextSubpass(cmd, VK_SUBPASS_CONTENTS_INLINE);
+
+	const size_t attachment = frame_count % hdrAttachments.size();
+	UBOSet[swapchain_index]->BindSet(0, cmd, *volume->pipeline);
+	CloudCompositeSets[cloud_target]->BindSet(1, cmd, *volume->pipeline);
+	SceneDepthSets[attachment]->BindSet(2, cmd, *volume->pipeline);
+	volume->pipeline->BindPipeline(cmd);
+	vkCmdDraw(cmd, 3, 1, 0, 0);
+
+	vkCmdNextSubpass(cmd, VK_SUBPASS_CONTENTS_INLINE);
+
+	HDRDescriptors[attachment]->BindSet(0, cmd, *HDRPipelines[attachment]);
+	HDRPipelines[attachment]->BindPipeline(cmd);
+	vkCmdDraw(cmd, 3, 1, 0, 0);
+
+#ifdef INCLUDE_GUI
+	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+#endif
+
+	vkCmdEndRenderPass(cmd);
+}
+
+void VulkanBase::build_hiz_pyramid(VkCommandBuffer cmd)
+{
+	// Each mip reduces the one written right before it
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	hizReducePipeline->BindPipeline(cmd);
+	for (uint32_t mip = 0; mip < hizPyramid->GetSubResourceRange().levelCount; mip++)
+	{
+		const uint32_t width = glm::max(hizPyramid->GetExtent().width >> mip, 1u);
+		const uint32_t height = glm::max(hizPyramid->GetExtent().height >> mip, 1u);
+
+		(mip == 0 ? HiZDepthSets[frame_count % HiZDepthSets.size()] : HiZReduceSets[mip - 1])->BindSet(0, cmd, *hizReducePipeline);
+		vkCmdDispatch(cmd, (width + 7) / 8, (height + 7) / 8, 1);
+
+		if (mip + 1 < hizPyramid->GetSubResourceRange().levelCount)
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+	}
+
+	previous_view_projection = camera.get_projection_matrix() * camera.get_view_matrix();
+	hiz_valid = true;
+}
+
+void VulkanBase::update_sky(VkCommandBuffer cmd)
+{
+	const VkExtent3D& skyExtent = frameGraph->GetImage(SkyViewLUT).GetExtent();
+	const VkExtent3D& aerialExtent = frameGraph->GetImage(AerialPerspectiveLUT).GetExtent();
+
+	skyViewPipeline->BindPipeline(cmd);
+	UBOSet[swapchain_index]->BindSet(0, cmd, *skyViewPipeline);
+	SkyLutSet->BindSet(1, cmd, *skyViewPipeline);
+	vkCmdDispatch(cmd, (skyExtent.width + 7) / 8, (skyExtent.height + 7) / 8, 1);
+
+	aerialPerspectivePipeline->BindPipeline(cmd);
+	UBOSet[swapchain_index]->BindSet(0, cmd, *aerialPerspectivePipeline);
+	SkyLutSet->BindSet(1, cmd, *aerialPerspectivePipeline);
+	vkCmdDispatch(cmd, (aerialExtent.width + 3) / 4, (aerialExtent.height + 3) / 4, (aerialExtent.depth + 3) / 4);
+}
+
+void VulkanBase::update_environment(VkCommandBuffer cmd)
+{
+	// Sky radiance barely changes while the sun holds still, reuse the same threshold as the cloud lighting
+	const TVec3 sun = glm::normalize(SunDirection);
+	if (environment_valid && glm::dot(sun, environment_sun) > cloudLightingSunCos)
+		return;
+
+	const uint32_t size = frameGraph->GetImage(SkyCube).GetExtent().width;
+
+	environmentCubePipeline->BindPipeline(cmd);
+	UBOSet[swapchain_index]->BindSet(0, cmd, *environmentCubePipeline);
+	EnvironmentCubeSet->BindSet(1, cmd, *environmentCubePipeline);
+	vkCmdDispatch(cmd, (size + 7) / 8, (size + 7) / 8, 6);
+
+	// Filtering reads the cube captured right above within the same pass
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+
+	const uint32_t mips = static_cast<uint32_t>(EnvironmentPrefilterSets.size());
+
+	environmentPrefilterPipeline->BindPipeline(cmd);
+	UBOSet[swapchain_index]->BindSet(0, cmd, *environmentPrefilterPipeline);
+	for (uint32_t mip = 0; mip < mips; mip++)
+	{
+		const float roughness = static_cast<float>(mip) / static_cast<float>(mips - 1);
+		const uint32_t mipSize = std::max(size >> mip, 1u);
+
+		EnvironmentPrefilterSets[mip]->BindSet(1, cmd, *environmentPrefilterPipeline);
+		environmentPrefilterPipeline->PushConstants(cmd, &roughness, sizeof(float), 0u, VK_SHADER_STAGE_COMPUTE_BIT);
+		vkCmdDispatch(cmd, (mipSize + 7) / 8, (mipSize + 7) / 8, 6);
 	}
-}
\ No newline at end of file
+
+	environmentSHPipeline->BindPipeline(cmd);
+	UBOSet[swapchain_index]->BindSet(0, cmd, *environmentSHPipeline);
+	EnvironmentSHSet->BindSet(1, cmd, *environmentSHPipeline);
+	vkCmdDispatch(cmd, 1, 1, 1);
+
+	environment_sun = sun;
+	environment_valid = true;
+}
+
+void VulkanBase::update_cloud_lighting(VkCommandBuffer cmd)
+{
+	// Camera is snapped so small moves keep the baked volume
+	const TVec4 origin = TVec4(glm::round(camera.View.GetOffset() / cloudLightingSnap) * cloudLightingSnap, 0.0);
+	const TVec3 sun = glm::normalize(SunDirection);
+	const double time = glfwGetTime();
+
+	// Detail noise is finer than the volume texels, only drift of the shape noise is tracked
+	const float drift = static_cast<float>(time - cloud_lighting_time) * cloud_settings.WindSpeed * cloudShapeWindScale * static_cast<float>(CloudShape->GetExtent().width);
+
+	if (cloud_lighting_valid && origin == cloud_lighting_origin && glm::dot(sun, cloud_lighting_sun) > cloudLightingSunCos && glm::abs(drift) < 0.5f)
+		return;
+
+	const VkExtent3D& extent = CloudLighting->GetExtent();
+
+	cloudLightingPipeline->BindPipeline(cmd);
+	UBOSet[swapchain_index]->BindSet(0, cmd, *cloudLightingPipeline);
+	volume->descriptorSet->BindSet(1, cmd, *cloudLightingPipeline);
+	CloudLightingSet->BindSet(2, cmd, *cloudLightingPipeline);
+	cloudLightingPipeline->PushConstants(cmd, &origin, sizeof(TVec4), 0u, VK_SHADER_STAGE_COMPUTE_BIT);
+	vkCmdDispatch(cmd, (extent.width + 3) / 4, (extent.height + 3) / 4, (extent.depth + 3) / 4);
+
+	cloud_lighting_origin = origin;
+	cloud_lighting_sun = sun;
+	cloud_lighting_time = time;
+	cloud_lighting_valid = true;
+}
+
+void VulkanBase::trace_clouds(VkCommandBuffer cmd)
+{
+	cloud_target = static_cast<uint32_t>(frame_count % cloudTargets.size());
+
+	// Traced texel walks a 2x2 Bayer pattern, every texel is refreshed once per 4 frames
+	const TArray<glm::uvec2, 4> pattern = { glm::uvec2(0, 0), glm::uvec2(1, 1), glm::uvec2(1, 0), glm::uvec2(0, 1) };
+
+	CloudReprojectionConstants C
+	{
+		cloud_view_projection,
+		pattern[frame_count % pattern.size()],
+		clouds_valid ? 1u : 0u,
+		static_cast<uint32_t>(frame_count),
+		cloud_lighting_origin
+	};
+
+	const VkExtent3D extent = cloudTargets[cloud_target]->GetExtent();
+
+	cloudTracePipeline->BindPipeline(cmd);
+	UBOSet[swapchain_index]->BindSet(0, cmd, *cloudTracePipeline);
+	volume->descriptorSet->BindSet(1, cmd, *cloudTracePipeline);
+	CloudTraceSets[cloud_target]->BindSet(2, cmd, *cloudTracePipeline);
+	cloudTracePipeline->PushConstants(cmd, &C, sizeof(CloudReprojectionConstants), 0u, VK_SHADER_STAGE_COMPUTE_BIT);
+	vkCmdDispatch(cmd, (extent.width + 7) / 8, (extent.height + 7) / 8, 1);
+
+	cloud_view_projection = camera.get_projection_matrix() * camera.get_view_matrix();
+	clouds_valid = true;
+}
@@ -13,12 +13,22 @@ RenderScope& RenderScope::CreateLogicalDevice(const VkPhysicalDeviceFeatures& fe
 {
 	assert(physicalDevice != VK_NULL_HANDLE && logicalDevice == VK_NULL_HANDLE);
 
-	::CreateLogicalDevice(physicalDevice, features, device_extensions, FindDeviceQueues(physicalDevice, queues), &logicalDevice);
+	TVector<const char*> enabled_extensions = device_extensions;
+	memoryBudgetSupported = ::EnumerateDeviceExtensions(physicalDevice, { VK_EXT_MEMORY_BUDGET_EXTENSION_NAME });
+
+	if (memoryBudgetSupported)
+		enabled_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+	::CreateLogicalDevice(physicalDevice, features, enabled_extensions, FindDeviceQueues(physicalDevice, queues), &logicalDevice);
 
 	for (const auto& queue : queues) {
 		uint32_t queueFamilies = FindDeviceQueues(physicalDevice, { queue })[0];
-		available_queues.emplace(std::piecewise_construct, std::forward_as_tuple(queue), std::forward_as_tuple(logicalDevice, queueFamilies));
+		available_queues.emplace(std::piecewise_construct, std::forward_as_tuple(queue), std::forward_as_tuple(logicalDevice, queueFamilies, queueLocks[queueFamilies]));
 	}
+
+	if (available_queues.contains(VK_QUEUE_GRAPHICS_BIT) && available_queues.contains(VK_QUEUE_COMPUTE_BIT))
+		sharedFamilies = { GetQueue(VK_QUEUE_GRAPHICS_BIT).GetFamilyIndex(), GetQueue(VK_QUEUE_COMPUTE_BIT).GetFamilyIndex() };
+
 	return *this;
 }
 
@@ -26,7 +36,7 @@ RenderScope& RenderScope::CreateMemoryAllocator(const VkInstance& instance)
 {
 	assert(physicalDevice != VK_NULL_HANDLE && logicalDevice != VK_NULL_HANDLE && allocator == VK_NULL_HANDLE);
 
-	::CreateAllocator(instance, physicalDevice, logicalDevice, &allocator);
+	::CreateAllocator(instance, physicalDevice, logicalDevice, &allocator, memoryBudgetSupported ? VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0);
 
 	return *this;
 }
@@ -57,7 +67,7 @@ RenderScope& RenderScope::CreateDefaultRenderPass()
 	attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 	attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
 	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachments[0].flags = 0;
@@ -74,10 +84,10 @@ RenderScope& RenderScope::CreateDefaultRenderPass()
 	// Depth attachment
 	attachments[2].format = depthFormat;
 	attachments[2].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachments[2].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	attachments[2].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	attachments[2].samples = VK_SAMPLE_COUNT_1_BIT;
 	attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	attachments[2].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[2].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	attachments[2].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachments[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachments[2].flags = 0;
@@ -85,45 +95,63 @@ RenderScope& RenderScope::CreateDefaultRenderPass()
 	VkAttachmentReference hdr_ref{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
 	VkAttachmentReference color_ref{ 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
 	VkAttachmentReference depth_ref{ 2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+	VkAttachmentReference depth_read_ref{ 2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
 	VkAttachmentReference input_ref{ 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
 
-	TArray<VkSubpassDescription, 2> subpassDescriptions{};
+	// Scene, then composition of half resolution effects that read full resolution depth, then tonemapping
+	TArray<VkSubpassDescription, 3> subpassDescriptions{};
 	subpassDescriptions[0].colorAttachmentCount = 1;
 	subpassDescriptions[0].pColorAttachments = &hdr_ref;
 	subpassDescriptions[0].pDepthStencilAttachment = &depth_ref;
 	subpassDescriptions[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 	subpassDescriptions[1].colorAttachmentCount = 1;
-	subpassDescriptions[1].pColorAttachments = &color_ref;
-	subpassDescriptions[1].pDepthStencilAttachment = &depth_ref;
+	subpassDescriptions[1].pColorAttachments = &hdr_ref;
+	subpassDescriptions[1].pDepthStencilAttachment = &depth_read_ref;
 	subpassDescriptions[1].inputAttachmentCount = 1;
-	subpassDescriptions[1].pInputAttachments = &input_ref;
+	subpassDescriptions[1].pInputAttachments = &depth_read_ref;
 	subpassDescriptions[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-
-	TArray<VkSubpassDependency, 3> dependencies{};
+	subpassDescriptions[2].colorAttachmentCount = 1;
+	subpassDescriptions[2].pColorAttachments = &color_ref;
+	subpassDescriptions[2].pDepthStencilAttachment = &depth_ref;
+	subpassDescriptions[2].inputAttachmentCount = 1;
+	subpassDescriptions[2].pInputAttachments = &input_ref;
+	subpassDescriptions[2].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+
+	TArray<VkSubpassDependency, 4> dependencies{};
+	// HDR and depth are shared between frames, the previous frame has to be done writing them
 	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 	dependencies[0].dstSubpass = 0;
-	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+	// Composition blends into the scene and reads its depth as an input attachment
 	dependencies[1].srcSubpass = 0;
 	dependencies[1].dstSubpass = 1;
-	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
 	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 	dependencies[2].srcSubpass = 1;
-	dependencies[2].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[2].dstSubpass = 2;
 	dependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[2].dstStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	dependencies[2].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	dependencies[2].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	dependencies[2].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
 	dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+	dependencies[3].srcSubpass = 2;
+	dependencies[3].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[3].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[3].dstStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[3].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[3].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	dependencies[3].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
 	createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	createInfo.attachmentCount = attachments.size();
 	createInfo.pAttachments = attachments.data();
@@ -137,13 +165,23 @@ RenderScope& RenderScope::CreateDefaultRenderPass()
 	return *this;
 }
 
-RenderScope& RenderScope::CreateDescriptorPool(uint32_t setsCount, const TVector<VkDescriptorPoolSize>& poolSizes)
+RenderScope& RenderScope::CreateDescriptorAllocator(uint32_t setsPerPool, const TVector<VkDescriptorPoolSize>& poolSizes)
 {
-	if (descriptorPool != VK_NULL_HANDLE) {
-		vkDestroyDescriptorPool(logicalDevice, descriptorPool, VK_NULL_HANDLE);
-	}
+	descriptorAllocator = std::make_unique<DescriptorAllocator>(logicalDevice, setsPerPool, poolSizes);
 
-	::CreateDescriptorPool(logicalDevice, poolSizes.data(), poolSizes.size(), setsCount, &descriptorPool);
+	return *this;
+}
+
+RenderScope& RenderScope::CreateShaderRegistry(const std::string& directory)
+{
+	shaderRegistry = std::make_unique<ShaderRegistry>(logicalDevice, directory);
+
+	return *this;
+}
+
+RenderScope& RenderScope::CreateWorkerPool(uint32_t threadCount)
+{
+	workerPool = std::make_unique<WorkerPool>(threadCount);
 
 	return *this;
 }
@@ -158,14 +196,17 @@ void RenderScope::RecreateSwapchain(const VkSurfaceKHR& surface)
 
 void RenderScope::Destroy()
 {
+	// Queued jobs may still create objects on the device
+	workerPool.reset();
 	available_queues.clear();
+	evictables.clear();
 
 	for (auto pair : samplers)
 		vkDestroySampler(logicalDevice, pair.second, VK_NULL_HANDLE);
 	samplers.clear();
 
-	if (descriptorPool != VK_NULL_HANDLE)
-		vkDestroyDescriptorPool(logicalDevice, descriptorPool, VK_NULL_HANDLE);
+	descriptorAllocator.reset();
+	shaderRegistry.reset();
 	if (renderPass != VK_NULL_HANDLE)
 		vkDestroyRenderPass(logicalDevice, renderPass, VK_NULL_HANDLE);
 	if (swapchain != VK_NULL_HANDLE)
@@ -175,7 +216,6 @@ void RenderScope::Destroy()
 	if (logicalDevice != VK_NULL_HANDLE)
 		vkDestroyDevice(logicalDevice, VK_NULL_HANDLE);
 
-	descriptorPool = VK_NULL_HANDLE;
 	renderPass = VK_NULL_HANDLE;
 	swapchain = VK_NULL_HANDLE;
 	allocator = VK_NULL_HANDLE;
@@ -189,11 +229,14 @@ VkBool32 RenderScope::IsReadyToUse() const
 		&& allocator != VK_NULL_HANDLE
 		&& swapchain != VK_NULL_HANDLE
 		&& renderPass != VK_NULL_HANDLE
-		&& descriptorPool != VK_NULL_HANDLE;
+		&& descriptorAllocator != VK_NULL_HANDLE
+		&& shaderRegistry != VK_NULL_HANDLE
+		&& workerPool != VK_NULL_HANDLE;
 }
 
 const VkSampler& RenderScope::GetSampler(ESamplerType Type) const
 {
+	std::lock_guard<std::mutex> guard(samplerLock);
 	if (samplers.count(Type) == 0)
 	{
 		const bool Point = Type == ESamplerType::PointClamp || Type == ESamplerType::PointMirror || Type == ESamplerType::PointRepeat;
@@ -225,9 +268,99 @@ const VkSampler& RenderScope::GetSampler(ESamplerType Type) const
 		samplerInfo.mipmapMode = Point ? VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR;
 		samplerInfo.mipLodBias = 0.0;
 		samplerInfo.minLod = 0.0;
-		samplerInfo.maxLod = 1.0;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 		vkCreateSampler(logicalDevice, &samplerInfo, VK_NULL_HANDLE, &samplers[Type]);
 	}
 
 	return samplers[Type];
+}
+
+TVector<HeapBudget> RenderScope::GetMemoryBudget() const
+{
+	const VkPhysicalDeviceMemoryProperties* memoryProperties = VK_NULL_HANDLE;
+	vmaGetMemoryProperties(allocator, &memoryProperties);
+
+	TArray<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+	vmaGetHeapBudgets(allocator, budgets.data());
+
+	TVector<HeapBudget> output(memoryProperties->memoryHeapCount);
+	for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++) {
+		output[i].Usage = budgets[i].usage;
+		output[i].Budget = budgets[i].budget;
+		output[i].DeviceLocal = (memoryProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+	}
+
+	return output;
+}
+
+void RenderScope::UpdateMemoryBudget(uint32_t frameIndex) const
+{
+	vmaSetCurrentFrameIndex(allocator, frameIndex);
+}
+
+uint32_t RenderScope::RegisterEvictable(uint32_t priority, MemoryPressureCallback callback) const
+{
+	std::lock_guard<std::mutex> guard(evictableLock);
+
+	Evictable evictable{ ++evictableHandles, priority, callback };
+	evictables.insert(std::upper_bound(evictables.begin(), evictables.end(), evictable, [](const Evictable& a, const Evictable& b) {
+		return a.priority < b.priority;
+	}), evictable);
+
+	return evictable.handle;
+}
+
+void RenderScope::UnregisterEvictable(uint32_t handle) const
+{
+	std::lock_guard<std::mutex> guard(evictableLock);
+
+	std::erase_if(evictables, [&](const Evictable& it) {
+		return it.handle == handle;
+	});
+}
+
+VkBool32 RenderScope::RelieveMemoryPressure(VkDeviceSize bytes) const
+{
+	// Other threads wait for the running relief, the thread running it reenters when releasing
+	// resources allocates on its own and is not allowed to evict recursively
+	std::lock_guard<std::recursive_mutex> guard(relieveLock);
+	if (relievingPressure)
+		return VK_FALSE;
+
+	relievingPressure = true;
+
+	// Callbacks may register or unregister evictables, they run on a copy without the list locked
+	TVector<Evictable> candidates = {};
+	{
+		std::lock_guard<std::mutex> evictableGuard(evictableLock);
+		candidates = evictables;
+	}
+
+	VkDeviceSize freed = 0;
+	for (const auto& evictable : candidates) {
+		if (freed >= bytes)
+			break;
+
+		freed += evictable.callback(bytes - freed);
+	}
+
+	relievingPressure = false;
+
+	return freed > 0;
+}
+
+VkResult RenderScope::AllocateWithinBudget(const VmaAllocationCreateInfo& allocCreateInfo, VkDeviceSize size, const std::function<VkResult(const VmaAllocationCreateInfo&)>& allocate) const
+{
+	VmaAllocationCreateInfo withinBudget = allocCreateInfo;
+	withinBudget.flags |= VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT;
+
+	VkResult result = allocate(withinBudget);
+	while ((result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY) && RelieveMemoryPressure(size)) {
+		result = allocate(withinBudget);
+	}
+
+	if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY)
+		result = allocate(allocCreateInfo);
+
+	return result;
 }
\ No newline at end of file
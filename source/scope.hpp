@@ -1,6 +1,10 @@
 #pragma once
 #include "vulkan_objects/queue.hpp"
+#include "vulkan_objects/descriptor_allocator.hpp"
+#include "vulkan_objects/shader_registry.hpp"
+#include "worker_pool.hpp"
 #include "vulkan_api.hpp"
+#include "structs.hpp"
 
 enum class ESamplerType
 {
@@ -15,6 +19,15 @@ enum class ESamplerType
 	BillinearMirror
 };
 
+/*
+* !@brief Releases memory of an evictable resource
+*
+* @param[in] bytes - amount of memory that has to be freed
+*
+* @return Amount of memory actually freed
+*/
+using MemoryPressureCallback = std::function<VkDeviceSize(VkDeviceSize bytes)>;
+
 class RenderScope
 {
 public:
@@ -32,7 +45,21 @@ public:
 
 	RenderScope& CreateDefaultRenderPass();
 
-	RenderScope& CreateDescriptorPool(uint32_t setsCount, const TVector<VkDescriptorPoolSize>& poolSizes);
+	/*
+	* !@brief Create descriptor allocator shared by every descriptor set of the scope
+	*
+	* @param[in] setsPerPool - sets of every pool in the chain
+	* @param[in] poolSizes - descriptors of every pool in the chain
+	*/
+	RenderScope& CreateDescriptorAllocator(uint32_t setsPerPool, const TVector<VkDescriptorPoolSize>& poolSizes);
+	/*
+	* !@brief Read every shader binary of the directory, pipelines take their modules from the registry
+	*/
+	RenderScope& CreateShaderRegistry(const std::string& directory);
+	/*
+	* !@brief Create threads compiling pipelines and running other background jobs
+	*/
+	RenderScope& CreateWorkerPool(uint32_t threadCount);
 
 	void RecreateSwapchain(const VkSurfaceKHR& surface);
 
@@ -52,7 +79,11 @@ public:
 
 	inline const VkExtent2D& GetSwapchainExtent() const { return swapchainExtent; };
 
-	inline const VkDescriptorPool& GetDescriptorPool() const { return descriptorPool; };
+	inline DescriptorAllocator& GetDescriptorAllocator() const { return *descriptorAllocator; };
+
+	inline ShaderRegistry& GetShaderRegistry() const { return *shaderRegistry; };
+
+	inline WorkerPool& GetWorkerPool() const { return *workerPool; };
 
 	inline const VkFormat& GetColorFormat() const { return swapchainFormat; };
 
@@ -61,6 +92,47 @@ public:
 	inline const uint32_t& GetMaxFramesInFlight() const { return framesInFlight; };
 
 	const VkSampler& GetSampler(ESamplerType Type) const;
+	/*
+	* !@brief Query memory usage and budget of every memory heap. Budgets are precise
+	* if VK_EXT_memory_budget is supported, estimated by VMA otherwise
+	*/
+	TVector<HeapBudget> GetMemoryBudget() const;
+	/*
+	* !@brief Refresh cached budget values, should be called once per frame
+	*
+	* @param[in] frameIndex - index of the current frame
+	*/
+	void UpdateMemoryBudget(uint32_t frameIndex) const;
+	/*
+	* !@brief Register resource that can be released when the device runs out of memory
+	*
+	* @param[in] priority - resources with lower priority are released first
+	* @param[in] callback - function releasing the memory
+	*
+	* @return Handle to unregister the resource with
+	*/
+	uint32_t RegisterEvictable(uint32_t priority, MemoryPressureCallback callback) const;
+
+	void UnregisterEvictable(uint32_t handle) const;
+	/*
+	* !@brief Ask evictable resources to release memory, ordered by priority
+	*
+	* @param[in] bytes - amount of memory to free
+	*
+	* @return VK_TRUE if any memory was released, VK_FALSE otherwise
+	*/
+	VkBool32 RelieveMemoryPressure(VkDeviceSize bytes) const;
+	/*
+	* !@brief Run allocation within memory budget. Evictable resources are released
+	* while it fails, as the last resort allocation is retried over the budget
+	*
+	* @param[in] allocCreateInfo - allocation parameters
+	* @param[in] size - expected size of allocation
+	* @param[in] allocate - function performing the allocation with given parameters
+	*
+	* @return Result of the last allocation attempt
+	*/
+	VkResult AllocateWithinBudget(const VmaAllocationCreateInfo& allocCreateInfo, VkDeviceSize size, const std::function<VkResult(const VmaAllocationCreateInfo&)>& allocate) const;
 
 	inline const Queue& GetQueue(VkQueueFlagBits Type) const 
 	{
@@ -68,18 +140,52 @@ public:
 		return available_queues.at(Type);
 	}
 
+	/*
+	* !@brief Fill sharing mode of image or buffer accessed from both the graphics and the compute queue.
+	* Sharing is concurrent when the queues belong to different families, so no ownership transfer is needed
+	*/
+	template<typename CreateInfo>
+	void ShareBetweenQueues(CreateInfo& createInfo) const
+	{
+		const bool concurrent = sharedFamilies[0] != sharedFamilies[1];
+		createInfo.sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+		createInfo.queueFamilyIndexCount = concurrent ? 2u : 0u;
+		createInfo.pQueueFamilyIndices = sharedFamilies.data();
+	}
+
 private:
+	struct Evictable
+	{
+		uint32_t handle;
+		uint32_t priority;
+		MemoryPressureCallback callback;
+	};
+
+	// Submission locks of device queues by family, queues of different types may share one
+	std::map<uint32_t, std::mutex> queueLocks;
 	std::unordered_map<VkQueueFlagBits, Queue> available_queues;
 	mutable std::unordered_map<ESamplerType, VkSampler> samplers;
+	mutable std::mutex samplerLock;
+	// Guards evictables and evictableHandles
+	mutable std::mutex evictableLock;
+	mutable TVector<Evictable> evictables;
+	mutable uint32_t evictableHandles = 0;
+	// Guards relievingPressure and serializes relief
+	mutable std::recursive_mutex relieveLock;
+	mutable bool relievingPressure = false;
+	bool memoryBudgetSupported = false;
 
 	uint32_t framesInFlight = 1u;
+	TArray<uint32_t, 2> sharedFamilies = { 0u, 0u };
 
 	VkDevice logicalDevice = VK_NULL_HANDLE;
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 	VmaAllocator allocator = VK_NULL_HANDLE;
 	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
 	VkRenderPass renderPass = VK_NULL_HANDLE;
-	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	TAuto<DescriptorAllocator> descriptorAllocator = VK_NULL_HANDLE;
+	TAuto<ShaderRegistry> shaderRegistry = VK_NULL_HANDLE;
+	TAuto<WorkerPool> workerPool = VK_NULL_HANDLE;
 
 	const VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
 	VkFormat swapchainFormat = VK_FORMAT_B8G8R8A8_SRGB;
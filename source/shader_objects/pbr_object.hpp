@@ -12,6 +12,16 @@ struct PBRConstants
 	float HeightScale = 1.0;
 };
 
+struct MeshletCullConstants
+{
+	glm::mat4 World;
+	uint32_t FirstMeshlet = 0;
+	uint32_t MeshletCount = 0;
+	uint32_t FirstCommand = 0;
+	float Scale = 1.0;
+	glm::vec4 Bounds = glm::vec4(0.0);
+};
+
 struct PBRObject : public GraphicsObject
 {
 	PBRObject() 
@@ -23,5 +33,9 @@ private:
 	friend class VulkanBase;
 
 	TAuto<Mesh> mesh;
+	TAuto<DescriptorSet> meshletSet;
 	bool dirty = false;
+	uint32_t revision = 0;
+	uint32_t lod = 0;
+	uint32_t firstCommand = 0;
 };
\ No newline at end of file
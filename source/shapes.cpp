@@ -1,5 +1,7 @@
 #include "pch.hpp"
 #include "shapes.hpp"
+#include "mesh_lod.hpp"
+#include "meshlet.hpp"
 
 extern void calculate_normals(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
 
@@ -150,7 +152,11 @@ TAuto<Mesh> GRShape::Cube::Generate(const RenderScope& Scope) const
 	calculate_normals(vertices, indices);
 	calculate_tangents(vertices, indices, 1.f, 1.f);
 
-	return std::make_unique<Mesh>(Scope, vertices.data(), vertices.size(), indices.data(), indices.size());
+	TVector<MeshLod> lods = GRMeshLod::GenerateLods(vertices, indices, lod_levels);
+
+	TVector<Meshlet> meshlets = GRMeshlet::Build(vertices, indices, lods);
+
+	return std::make_unique<Mesh>(Scope, vertices.data(), vertices.size(), indices.data(), indices.size(), lods, meshlets);
 }
 
 TAuto<Mesh> GRShape::Plane::Generate(const RenderScope& Scope) const
@@ -187,7 +193,11 @@ TAuto<Mesh> GRShape::Plane::Generate(const RenderScope& Scope) const
 	calculate_normals(vertices, indices);
 	calculate_tangents(vertices, indices, 1.f, 1.f);
 
-	return std::make_unique<Mesh>(Scope, vertices.data(), vertices.size(), indices.data(), indices.size());
+	TVector<MeshLod> lods = GRMeshLod::GenerateLods(vertices, indices, lod_levels);
+
+	TVector<Meshlet> meshlets = GRMeshlet::Build(vertices, indices, lods);
+
+	return std::make_unique<Mesh>(Scope, vertices.data(), vertices.size(), indices.data(), indices.size(), lods, meshlets);
 }
 
 TAuto<Mesh> GRShape::Sphere::Generate(const RenderScope& Scope) const
@@ -257,5 +267,9 @@ TAuto<Mesh> GRShape::Sphere::Generate(const RenderScope& Scope) const
 	calculate_normals(vertices, indices);
 	calculate_tangents(vertices, indices, 1.0, 1.0);
 
-	return std::make_unique<Mesh>(Scope, vertices.data(), vertices.size(), indices.data(), indices.size());
+	TVector<MeshLod> lods = GRMeshLod::GenerateLods(vertices, indices, lod_levels);
+
+	TVector<Meshlet> meshlets = GRMeshlet::Build(vertices, indices, lods);
+
+	return std::make_unique<Mesh>(Scope, vertices.data(), vertices.size(), indices.data(), indices.size(), lods, meshlets);
 }
\ No newline at end of file
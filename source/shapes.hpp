@@ -13,6 +13,12 @@ namespace GRShape
 	protected:
 		friend class VulkanBase;
 		virtual TAuto<Mesh> Generate(const RenderScope& Scope) const = 0;
+
+	public:
+		/*
+		* !@brief Maximum amount of levels of detail to generate, including the full detail one
+		*/
+		uint32_t lod_levels = 1u;
 	};
 
 	class Cube : public Shape
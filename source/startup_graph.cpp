@@ -0,0 +1,93 @@
+#include "pch.hpp"
+#include "startup_graph.hpp"
+#include <atomic>
+
+StartupGraph::Node StartupGraph::AddNode(const std::string& name, const TVector<Node>& dependencies, std::function<VkBool32(GpuWork&)> job)
+{
+	const Node node = static_cast<Node>(jobs.size());
+	for (Node dependency : dependencies)
+		assert(dependency < node && "Dependencies have to be added first");
+
+	jobs.push_back({ name, dependencies, std::move(job) });
+
+	return node;
+}
+
+VkBool32 StartupGraph::Run(WorkerPool& pool)
+{
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point start = Clock::now();
+
+	timings.assign(jobs.size(), {});
+	gpuWork.assign(jobs.size(), {});
+
+	TVector<VkBool32> results(jobs.size(), VK_FALSE);
+	TVector<std::promise<void>> finished(jobs.size());
+	TVector<std::atomic<uint32_t>> blocking(jobs.size());
+	TVector<TVector<Node>> dependents(jobs.size());
+	for (Node i = 0; i < jobs.size(); i++)
+	{
+		blocking[i] = static_cast<uint32_t>(jobs[i].dependencies.size());
+		for (Node dependency : jobs[i].dependencies)
+			dependents[dependency].push_back(i);
+	}
+
+	// Jobs are queued once their last dependency finishes, so a queued job never waits on another job
+	std::function<void(Node)> launch = [&](Node i) {
+		pool.Submit([&, i]() {
+			VkBool32 ready = VK_TRUE;
+			for (Node dependency : jobs[i].dependencies)
+			{
+				ready = results[dependency] & ready;
+				gpuWork[i].waits.insert(gpuWork[i].waits.end(), gpuWork[dependency].signals.begin(), gpuWork[dependency].signals.end());
+			}
+
+			const Clock::time_point begin = Clock::now();
+			results[i] = ready ? jobs[i].work(gpuWork[i]) : VK_FALSE;
+			const Clock::time_point end = Clock::now();
+
+			timings[i].Name = jobs[i].name;
+			timings[i].StartMs = std::chrono::duration<double, std::milli>(begin - start).count();
+			timings[i].DurationMs = std::chrono::duration<double, std::milli>(end - begin).count();
+			timings[i].Succeeded = results[i] != VK_FALSE;
+
+			for (Node dependent : dependents[i])
+			{
+				if (--blocking[dependent] == 0)
+					launch(dependent);
+			}
+
+			finished[i].set_value();
+		});
+	};
+
+	TVector<std::future<void>> done(jobs.size());
+	for (Node i = 0; i < jobs.size(); i++)
+		done[i] = finished[i].get_future();
+
+	for (Node i = 0; i < jobs.size(); i++)
+	{
+		if (jobs[i].dependencies.empty())
+			launch(i);
+	}
+
+	VkBool32 res = VK_TRUE;
+	for (Node i = 0; i < jobs.size(); i++)
+	{
+		done[i].wait();
+		res = results[i] & res;
+	}
+
+	return res;
+}
+
+void StartupGraph::WaitGpu(VkDevice device)
+{
+	for (GpuWork& work : gpuWork)
+	{
+		for (const VkSemaphoreSubmitInfo& signal : work.signals)
+			::WaitTimelineSemaphore(device, signal.semaphore, signal.value);
+
+		work = {};
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "vulkan_api.hpp"
+#include <future>
+#include "structs.hpp"
+#include "math.hpp"
+#include "worker_pool.hpp"
+
+/*
+* !@brief Startup jobs with the jobs they depend on. Jobs are queued on the worker pool as soon as
+* their dependencies finish, jobs depending on a failed one are skipped. GPU work a job leaves in
+* flight is handed to its dependents as semaphore waits instead of being waited for on the host
+*/
+class StartupGraph
+{
+public:
+	using Node = uint32_t;
+	/*
+	* !@brief GPU work of a job. Waits are the work its dependencies left in flight, to be added to
+	* submissions reading their results. Signals are timeline values of the job's own work, e.g.
+	* Queue::WaitInfo, objects it uses stay alive until WaitGpu
+	*/
+	struct GpuWork
+	{
+		TVector<VkSemaphoreSubmitInfo> waits = {};
+		TVector<VkSemaphoreSubmitInfo> signals = {};
+		TVector<TShared<void>> keepAlive = {};
+	};
+	/*
+	* !@brief Add job, dependencies have to be added before the jobs depending on them
+	*
+	* @param[in] name - name shown in the timing report
+	* @param[in] dependencies - jobs that have to succeed before this one starts
+	* @param[in] job - work of the node, returns VK_FALSE on failure
+	*/
+	Node AddNode(const std::string& name, const TVector<Node>& dependencies, std::function<VkBool32(GpuWork&)> job);
+	/*
+	* !@brief Run every job on the pool and block until all of them finish, their GPU work may
+	* still be in flight
+	*
+	* @return VK_TRUE if every job succeeded
+	*/
+	VkBool32 Run(WorkerPool& pool);
+	/*
+	* !@brief Block until the GPU work left by the jobs completes and release the objects it uses
+	*/
+	void WaitGpu(VkDevice device);
+
+	const TVector<StartupTiming>& GetTimings() const { return timings; };
+
+private:
+	struct Job
+	{
+		std::string name = "";
+		TVector<Node> dependencies = {};
+		std::function<VkBool32(GpuWork&)> work = {};
+	};
+
+	TVector<Job> jobs = {};
+	TVector<GpuWork> gpuWork = {};
+	TVector<StartupTiming> timings = {};
+};
@@ -1,12 +1,22 @@
 #pragma once
 #include "glm/glm.hpp"
 /*
+* !@brief Storage precision of the precomputed atmosphere LUTs sampled while rendering
+*/
+enum class ELutPrecision
+{
+	Full,	// 32 bit float RGBA
+	Half,	// 16 bit float RGBA
+	Packed	// B10G11R11 for LUTs without alpha, 16 bit float RGBA otherwise
+};
+/*
 * !@brief Struct describing settings for initial application launch
 */
 struct ApplicationSettings
 {
 	std::string ApplicationName;
 	glm::ivec2 WindowExtents;
+	ELutPrecision LutPrecision = ELutPrecision::Full;
 };
 /*
 * !@brief General per-frame values for rendering
@@ -22,6 +32,44 @@ struct UniformBuffer
 	glm::vec2 Resolution;
 };
 /*
+* !@brief Data used to test bounds against the depth pyramid of the previous frame
+*/
+struct OcclusionUniform
+{
+	glm::mat4 PreviousViewProjection;
+	glm::vec4 Params;
+};
+/*
+* !@brief Push constants of the cloud trace pass, TracedPixel selects the texel of every 2x2 block traced this frame
+*/
+struct CloudReprojectionConstants
+{
+	glm::mat4 PreviousViewProjection;
+	glm::uvec2 TracedPixel;
+	uint32_t HistoryValid;
+	uint32_t FrameIndex;
+	glm::vec4 LightingOrigin;
+};
+/*
+* !@brief Struct describing the planet and its atmosphere, lengths are in kilometers
+* and coefficients per kilometer. Defaults describe a partly cloudy sky,
+* for a clear sky use Mie scattering of 4e-3 with scale height of 1.2.
+* Cloud layer heights are measured from BottomRadius and do not affect the LUTs
+*/
+struct AtmosphereProfile
+{
+	glm::vec3 RayleighScattering = glm::vec3(5.8e-3, 1.35e-2, 3.31e-2);
+	float BottomRadius = 6360.0;
+	glm::vec3 MieScattering = glm::vec3(3e-3);
+	float TopRadius = 6420.0;
+	glm::vec3 MieExtinction = glm::vec3(3e-3 / 0.9);
+	float RayleighScaleHeight = 8.0;
+	float MieScaleHeight = 3.0;
+	float MieAnisotropy = 0.65;
+	float CloudBottomHeight = 10.0;
+	float CloudTopHeight = 25.0;
+};
+/*
 * !@brief Struct describing the coverage of volumetric clouds
 */
 struct CloudLayerProfile
@@ -40,9 +88,54 @@ struct CloudLayerProfile
 	float WindSpeed = 0.25;
 };
 /*
+* !@brief Memory usage of a single device memory heap
+*/
+struct HeapBudget
+{
+	uint64_t Usage = 0;
+	uint64_t Budget = 0;
+	bool DeviceLocal = false;
+};
+/*
+* !@brief Time spent on a single startup job, measured from the start of the startup graph
+*/
+struct StartupTiming
+{
+	std::string Name = "";
+	double StartMs = 0.0;
+	double DurationMs = 0.0;
+	bool Succeeded = false;
+};
+/*
+* !@brief Counters of the last rendered frame
+*/
+struct RenderStats
+{
+	uint32_t DrawCalls = 0;
+	uint32_t Meshlets = 0;
+	uint64_t Triangles = 0;
+};
+/*
 * !@brief Dummy to inherit from
 */
 struct Image
 {
 
-};
\ No newline at end of file
+};
+/*
+* !@brief Relative quantization error of a reduced precision LUT against its cached 32 bit float texels
+*/
+struct LutError
+{
+	float MaxError = 0.0;
+	float MeanError = 0.0;
+};
+/*
+* !@brief Errors of every atmosphere LUT for one storage precision
+*/
+struct AtmosphereLutError
+{
+	LutError Transmittance;
+	LutError Irradiance;
+	LutError Scattering;
+};
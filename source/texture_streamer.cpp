@@ -0,0 +1,442 @@
+#include "pch.hpp"
+#include "texture_streamer.hpp"
+#include "file_manager.hpp"
+#include <stb/stb_image.h>
+#include <cstring>
+
+extern std::string exec_path;
+
+static TVector<unsigned char> downsample(const TVector<unsigned char>& src, uint32_t w, uint32_t h, bool srgb)
+{
+	static const TArray<float, 256> toLinear = []() {
+		TArray<float, 256> table{};
+		for (uint32_t i = 0; i < 256; i++) {
+			float c = static_cast<float>(i) / 255.f;
+			table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		return table;
+	}();
+
+	const uint32_t dw = std::max(w / 2, 1u);
+	const uint32_t dh = std::max(h / 2, 1u);
+	TVector<unsigned char> dst(static_cast<size_t>(dw) * dh * 4);
+
+	for (uint32_t y = 0; y < dh; y++) {
+		const uint32_t y0 = std::min(y * 2, h - 1);
+		const uint32_t y1 = std::min(y * 2 + 1, h - 1);
+
+		for (uint32_t x = 0; x < dw; x++) {
+			const uint32_t x0 = std::min(x * 2, w - 1);
+			const uint32_t x1 = std::min(x * 2 + 1, w - 1);
+			const TArray<size_t, 4> taps = { (y0 * w + x0) * 4, (y0 * w + x1) * 4, (y1 * w + x0) * 4, (y1 * w + x1) * 4 };
+
+			for (uint32_t c = 0; c < 4; c++) {
+				unsigned char& out = dst[(static_cast<size_t>(y) * dw + x) * 4 + c];
+
+				if (srgb && c < 3) {
+					float v = 0.25f * (toLinear[src[taps[0] + c]] + toLinear[src[taps[1] + c]] + toLinear[src[taps[2] + c]] + toLinear[src[taps[3] + c]]);
+					v = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.f / 2.4f) - 0.055f;
+					out = static_cast<unsigned char>(std::clamp(v * 255.f + 0.5f, 0.f, 255.f));
+				}
+				else {
+					out = static_cast<unsigned char>((src[taps[0] + c] + src[taps[1] + c] + src[taps[2] + c] + src[taps[3] + c] + 2) / 4);
+				}
+			}
+		}
+	}
+
+	return dst;
+}
+
+static TVector<TVector<unsigned char>> generate_mips(const unsigned char* pixels, uint32_t w, uint32_t h, uint32_t mipLevels, uint32_t firstMip, bool srgb)
+{
+	TVector<TVector<unsigned char>> levels;
+	TVector<unsigned char> current(pixels, pixels + static_cast<size_t>(w) * h * 4);
+
+	for (uint32_t mip = 0; mip < mipLevels; mip++) {
+		if (mip >= firstMip)
+			levels.push_back(current);
+
+		if (mip + 1 < mipLevels) {
+			current = downsample(current, w, h, srgb);
+			w = std::max(w / 2, 1u);
+			h = std::max(h / 2, 1u);
+		}
+	}
+
+	return levels;
+}
+
+TextureStreamer::TextureStreamer(const RenderScope& InScope)
+	: Scope(&InScope)
+{
+	// Streamed mips can always be loaded again, so they go first
+	evictableHandle = Scope->RegisterEvictable(0u, [this](VkDeviceSize bytes) {
+		return release(bytes);
+	});
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	Scope->UnregisterEvictable(evictableHandle);
+
+	for (auto& [key, texture] : textures) {
+		if (texture.pending.valid())
+			texture.pending.wait();
+	}
+
+	textures.clear();
+	retired.clear();
+
+	Scope->GetQueue(VK_QUEUE_GRAPHICS_BIT).Wait();
+	staging.clear();
+}
+
+TShared<VulkanImage> TextureStreamer::Load(const std::string& path, VkFormat format)
+{
+	if (format != VK_FORMAT_R8G8B8A8_SRGB && format != VK_FORMAT_R8G8B8A8_UNORM)
+		return GRVkFile::_importImage(*Scope, path.c_str(), format);
+
+	int w, h, c;
+	unsigned char* pixels = stbi_load((exec_path + path).c_str(), &w, &h, &c, 4);
+
+	assert(pixels != nullptr);
+
+	if (!pixels)
+		return VK_NULL_HANDLE;
+
+	StreamedTexture texture{};
+	texture.path = path;
+	texture.format = format;
+	texture.width = static_cast<uint32_t>(w);
+	texture.height = static_cast<uint32_t>(h);
+	texture.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(w, h)))) + 1;
+	texture.lastUsed = frame;
+
+	while (texture.lowestMip + 1 < texture.mipLevels && std::max(texture.width >> texture.lowestMip, texture.height >> texture.lowestMip) > initialResidentSize)
+		texture.lowestMip++;
+
+	texture.residentMip = texture.lowestMip;
+	texture.targetMip = texture.lowestMip;
+
+	TShared<VulkanImage> image = std::make_shared<VulkanImage>(*Scope);
+	rebuild(texture, *image, texture.lowestMip, generate_mips(pixels, texture.width, texture.height, texture.mipLevels, texture.lowestMip, format == VK_FORMAT_R8G8B8A8_SRGB), texture.lowestMip);
+	stbi_image_free(pixels);
+
+	texture.image = image;
+	textures[image.get()] = std::move(texture);
+
+	return image;
+}
+
+void TextureStreamer::Request(const Image* image, float pixels)
+{
+	auto it = textures.find(image);
+
+	if (it == textures.end())
+		return;
+
+	StreamedTexture& texture = it->second;
+	const float texels = static_cast<float>(std::max(texture.width, texture.height));
+	const uint32_t mip = pixels > 0.f ? static_cast<uint32_t>(std::floor(std::log2(std::max(texels / pixels, 1.f)))) : texture.lowestMip;
+
+	texture.requestedMip = std::min(texture.requestedMip, std::min(mip, texture.lowestMip));
+	texture.lastUsed = frame;
+}
+
+void TextureStreamer::Update()
+{
+	frame++;
+
+	std::erase_if(retired, [&, this](const RetiredImage& it) {
+		return frame - it.frame > Scope->GetMaxFramesInFlight();
+	});
+
+	std::erase_if(staging, [&, this](const std::pair<Queue::Ticket, TAuto<Buffer>>& it) {
+		return Scope->GetQueue(VK_QUEUE_GRAPHICS_BIT).IsComplete(it.first);
+	});
+
+	std::erase_if(textures, [](const std::pair<const Image* const, StreamedTexture>& it) {
+		return it.second.image.expired() && !it.second.pending.valid();
+	});
+
+	uint32_t pendingLoads = 0;
+	for (auto& [key, texture] : textures) {
+		if (texture.requestedMip != UINT32_MAX) {
+			texture.targetMip = texture.requestedMip;
+			texture.requestedMip = UINT32_MAX;
+		}
+
+		if (!texture.pending.valid())
+			continue;
+
+		if (texture.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			pendingLoads++;
+			continue;
+		}
+
+		MipChain levels = texture.pending.get();
+		TShared<VulkanImage> image = texture.image.lock();
+		const uint32_t mip = texture.pendingMip;
+		texture.pendingMip = UINT32_MAX;
+
+		if (!image || levels.empty() || mip >= texture.residentMip)
+			continue;
+
+		if (!is_over_budget(mip_chain_size(texture, mip) - mip_chain_size(texture, texture.residentMip)))
+			rebuild(texture, *image, mip, levels, mip);
+	}
+
+	// Device budget is enforced through memory pressure callbacks, only the user limit is handled here
+	for (uint32_t i = 0; i < maxEvictionsPerFrame && textureBudget != 0 && GetResidentSize() > textureBudget; i++) {
+		if (evict_one(GetResidentSize() - textureBudget) == 0)
+			break;
+	}
+
+	TVector<StreamedTexture*> candidates;
+	for (auto& [key, texture] : textures) {
+		if (!texture.pending.valid() && texture.targetMip < texture.residentMip && !texture.image.expired())
+			candidates.push_back(&texture);
+	}
+
+	// most recently used and most blurry images go first
+	std::sort(candidates.begin(), candidates.end(), [](const StreamedTexture* a, const StreamedTexture* b) {
+		return a->lastUsed != b->lastUsed ? a->lastUsed > b->lastUsed : (a->residentMip - a->targetMip) > (b->residentMip - b->targetMip);
+	});
+
+	for (StreamedTexture* texture : candidates) {
+		if (pendingLoads >= maxPendingLoads)
+			break;
+
+		if (is_over_budget(mip_chain_size(*texture, texture->targetMip) - mip_chain_size(*texture, texture->residentMip)))
+			continue;
+
+		texture->pendingMip = texture->targetMip;
+		texture->pending = std::async(std::launch::async, [path = exec_path + texture->path, mipLevels = texture->mipLevels, firstMip = texture->targetMip, srgb = texture->format == VK_FORMAT_R8G8B8A8_SRGB]() {
+			int w, h, c;
+			unsigned char* pixels = stbi_load(path.c_str(), &w, &h, &c, 4);
+
+			if (!pixels)
+				return MipChain();
+
+			MipChain levels = generate_mips(pixels, static_cast<uint32_t>(w), static_cast<uint32_t>(h), mipLevels, firstMip, srgb);
+			stbi_image_free(pixels);
+
+			return levels;
+		});
+
+		pendingLoads++;
+	}
+}
+
+VkDeviceSize TextureStreamer::GetResidentSize() const
+{
+	VkDeviceSize size = 0;
+
+	for (const auto& [key, texture] : textures) {
+		if (!texture.image.expired())
+			size += mip_chain_size(texture, texture.residentMip);
+	}
+
+	return size;
+}
+
+VkDeviceSize TextureStreamer::mip_chain_size(const StreamedTexture& texture, uint32_t baseMip) const
+{
+	VkDeviceSize size = 0;
+
+	for (uint32_t mip = baseMip; mip < texture.mipLevels; mip++) {
+		size += static_cast<VkDeviceSize>(std::max(texture.width >> mip, 1u)) * std::max(texture.height >> mip, 1u) * 4;
+	}
+
+	return size;
+}
+
+void TextureStreamer::rebuild(StreamedTexture& texture, VulkanImage& target, uint32_t baseMip, const MipChain& levels, uint32_t levelsBase)
+{
+	const bool hasResident = target.GetImage() != VK_NULL_HANDLE;
+	const uint32_t residentMip = texture.residentMip;
+
+	VkImageCreateInfo imageCI{};
+	imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCI.arrayLayers = 1u;
+	imageCI.extent = { std::max(texture.width >> baseMip, 1u), std::max(texture.height >> baseMip, 1u), 1u };
+	imageCI.format = texture.format;
+	imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCI.mipLevels = texture.mipLevels - baseMip;
+	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	imageCI.imageType = VK_IMAGE_TYPE_2D;
+	VmaAllocationCreateInfo allocCI{};
+	allocCI.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+	VkImageViewCreateInfo viewCI{};
+	viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCI.format = texture.format;
+	viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, imageCI.mipLevels, 0u, 1u };
+
+	VulkanImage fresh(*Scope);
+	fresh.CreateImage(imageCI, allocCI)
+		.CreateImageView(viewCI)
+		.CreateSampler(ESamplerType::BillinearRepeat);
+
+	// Mips that are already resident are copied on GPU, the rest comes from decoded levels
+	TVector<VkImageCopy> copies;
+	TVector<VkBufferImageCopy> uploads;
+	VkDeviceSize stagingSize = 0;
+	for (uint32_t mip = baseMip; mip < texture.mipLevels; mip++) {
+		const VkExtent3D extent = { std::max(texture.width >> mip, 1u), std::max(texture.height >> mip, 1u), 1u };
+
+		if (hasResident && mip >= residentMip) {
+			VkImageCopy copy{};
+			copy.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - residentMip, 0u, 1u };
+			copy.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - baseMip, 0u, 1u };
+			copy.extent = extent;
+			copies.push_back(copy);
+		}
+		else {
+			assert(mip >= levelsBase && mip - levelsBase < levels.size());
+
+			VkBufferImageCopy region{};
+			region.bufferOffset = stagingSize;
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - baseMip, 0u, 1u };
+			region.imageExtent = extent;
+			uploads.push_back(region);
+			stagingSize += levels[mip - levelsBase].size();
+		}
+	}
+
+	TAuto<Buffer> stagingBuffer = VK_NULL_HANDLE;
+	if (stagingSize > 0) {
+		TVector<unsigned char> packed(stagingSize);
+		for (const auto& region : uploads) {
+			const auto& level = levels[region.imageSubresource.mipLevel + baseMip - levelsBase];
+			memcpy(packed.data() + region.bufferOffset, level.data(), level.size());
+		}
+
+		VkBufferCreateInfo sbInfo{};
+		sbInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		sbInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		sbInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		sbInfo.size = stagingSize;
+		VmaAllocationCreateInfo sbAlloc{};
+		sbAlloc.usage = VMA_MEMORY_USAGE_AUTO;
+		sbAlloc.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+		stagingBuffer = std::make_unique<Buffer>(*Scope, sbInfo, sbAlloc);
+		stagingBuffer->Update(packed.data(), stagingSize);
+	}
+
+	VkCommandBuffer cmd;
+	const Queue& Queue = Scope->GetQueue(VK_QUEUE_GRAPHICS_BIT);
+	Queue.AllocateCommandBuffers(1, &cmd);
+
+	::BeginOneTimeSubmitCmd(cmd);
+	fresh.TransitionLayout(cmd, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+	if (!copies.empty()) {
+		target.TransitionLayout(cmd, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		vkCmdCopyImage(cmd, target.GetImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, fresh.GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copies.size(), copies.data());
+	}
+
+	if (!uploads.empty())
+		vkCmdCopyBufferToImage(cmd, stagingBuffer->GetBuffer(), fresh.GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uploads.size(), uploads.data());
+
+	fresh.TransitionLayout(cmd, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	::EndCommandBuffer(cmd);
+
+	// Frames are submitted to the same queue later, only the staging buffer has to outlive the copy
+	const Queue::Ticket ticket = Queue.Submit(cmd);
+	if (stagingBuffer)
+		staging.emplace_back(ticket, std::move(stagingBuffer));
+
+	// Keep the object users hold, swap only its contents. Previous image may still be referenced by frames in flight
+	std::swap(target.image, fresh.image);
+	std::swap(target.view, fresh.view);
+	std::swap(target.sampler, fresh.sampler);
+	std::swap(target.memory, fresh.memory);
+	std::swap(target.allocInfo, fresh.allocInfo);
+	std::swap(target.descriptorInfo, fresh.descriptorInfo);
+	std::swap(target.subRange, fresh.subRange);
+	std::swap(target.imageSize, fresh.imageSize);
+	target.revision++;
+
+	if (hasResident)
+		retired.push_back({ frame, baseMip > residentMip ? mip_chain_size(texture, residentMip) - mip_chain_size(texture, baseMip) : 0, std::make_unique<VulkanImage>(std::move(fresh)) });
+
+	texture.residentMip = baseMip;
+}
+
+VkBool32 TextureStreamer::is_over_budget(VkDeviceSize extraBytes) const
+{
+	if (textureBudget != 0 && GetResidentSize() + extraBytes > textureBudget)
+		return VK_TRUE;
+
+	VkDeviceSize usage = 0;
+	VkDeviceSize budget = 0;
+	for (const auto& heap : Scope->GetMemoryBudget()) {
+		if (heap.DeviceLocal) {
+			usage += heap.Usage;
+			budget += heap.Budget;
+		}
+	}
+
+	return usage + extraBytes > static_cast<VkDeviceSize>(static_cast<double>(budget) * budgetFraction);
+}
+
+VkDeviceSize TextureStreamer::evict_one(VkDeviceSize bytes)
+{
+	StreamedTexture* victim = VK_NULL_HANDLE;
+	TShared<VulkanImage> victimImage = VK_NULL_HANDLE;
+
+	for (auto& [key, texture] : textures) {
+		if (texture.residentMip >= texture.lowestMip || texture.pending.valid())
+			continue;
+
+		TShared<VulkanImage> image = texture.image.lock();
+
+		if (!image)
+			continue;
+
+		// least recently used first, the biggest one among equally old
+		if (!victim || texture.lastUsed < victim->lastUsed
+			|| (texture.lastUsed == victim->lastUsed && mip_chain_size(texture, texture.residentMip) > mip_chain_size(*victim, victim->residentMip))) {
+			victim = &texture;
+			victimImage = image;
+		}
+	}
+
+	if (!victim)
+		return 0;
+
+	const VkDeviceSize resident = mip_chain_size(*victim, victim->residentMip);
+
+	uint32_t baseMip = victim->residentMip + 1;
+	while (baseMip < victim->lowestMip && resident - mip_chain_size(*victim, baseMip) < bytes)
+		baseMip++;
+
+	rebuild(*victim, *victimImage, baseMip, {}, 0);
+
+	return resident - mip_chain_size(*victim, baseMip);
+}
+
+VkDeviceSize TextureStreamer::release(VkDeviceSize bytes)
+{
+	VkDeviceSize retiring = 0;
+	for (const RetiredImage& it : retired)
+		retiring += it.size;
+
+	// Replaced images are destroyed with the frames still using them instead of waiting for the device
+	VkDeviceSize freed = 0;
+	for (uint32_t i = 0; i < maxEvictionsPerFrame && retiring + freed < bytes; i++) {
+		VkDeviceSize evicted = evict_one(bytes - retiring - freed);
+
+		if (evicted == 0)
+			break;
+
+		freed += evicted;
+	}
+
+	return freed;
+}
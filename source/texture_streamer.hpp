@@ -0,0 +1,115 @@
+#pragma once
+#include "pch.hpp"
+#include "scope.hpp"
+#include "vulkan_objects/image.hpp"
+#include "vulkan_objects/buffer.hpp"
+#include "vulkan_api.hpp"
+/*
+* !@brief Keeps resident only the mip levels that images actually need on screen.
+* Images are loaded with their smallest mips, higher mips are decoded on background threads
+* and uploaded once ready. Least recently used mips are evicted when memory usage exceeds the budget
+* or when the device runs out of memory.
+*/
+class TextureStreamer
+{
+public:
+	TextureStreamer(const RenderScope& Scope);
+
+	~TextureStreamer();
+	/*
+	* !@brief Load image file, only mips not bigger than initial resident size are uploaded right away
+	*
+	* @param[in] path - local path to the image file
+	* @param[in] format - format to store image in, formats other than 8 bit RGBA are loaded fully resident
+	*
+	* @return Image with a low resident mip range
+	*/
+	TShared<VulkanImage> Load(const std::string& path, VkFormat format);
+	/*
+	* !@brief Report the on-screen size of the image for the current frame
+	*
+	* @param[in] image - image to stream, ignored if it was not loaded by the streamer
+	* @param[in] pixels - approximate size of the image on screen in pixels
+	*/
+	void Request(const Image* image, float pixels);
+	/*
+	* !@brief Apply finished loads, evict mips over the budget and schedule new loads. Call once per frame
+	*/
+	void Update();
+	/*
+	* !@brief Limit memory used by streamed images, zero means only the device budget reported by VMA is respected
+	*
+	* @param[in] bytes - maximum amount of memory for streamed mips
+	*/
+	void SetBudget(VkDeviceSize bytes) { textureBudget = bytes; };
+	/*
+	* !@brief Get the amount of memory used by resident mips of streamed images
+	*
+	* @return Size in bytes
+	*/
+	VkDeviceSize GetResidentSize() const;
+
+private:
+	using MipChain = TVector<TVector<unsigned char>>;
+
+	struct StreamedTexture
+	{
+		TWeak<VulkanImage> image = {};
+		std::string path = "";
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t mipLevels = 1;
+		uint32_t lowestMip = 0;
+		uint32_t residentMip = 0;
+		uint32_t targetMip = 0;
+		uint32_t requestedMip = UINT32_MAX;
+		uint64_t lastUsed = 0;
+		uint32_t pendingMip = UINT32_MAX;
+		std::future<MipChain> pending = {};
+	};
+	/*
+	* !@brief Replaced image kept until frames that might sample it are done, its memory is freed then
+	*/
+	struct RetiredImage
+	{
+		uint64_t frame = 0;
+		// Memory returned by the swap, zero when the image was replaced by a bigger one
+		VkDeviceSize size = 0;
+		TAuto<VulkanImage> image = VK_NULL_HANDLE;
+	};
+
+	VkDeviceSize mip_chain_size(const StreamedTexture& texture, uint32_t baseMip) const;
+
+	void rebuild(StreamedTexture& texture, VulkanImage& target, uint32_t baseMip, const MipChain& levels, uint32_t levelsBase);
+
+	VkBool32 is_over_budget(VkDeviceSize extraBytes) const;
+
+	/*
+	* !@brief Drop mips of the least recently used image until bytes are covered, with a single rebuild
+	*
+	* @return Size of dropped mips, freed once the replaced image retires
+	*/
+	VkDeviceSize evict_one(VkDeviceSize bytes);
+	/*
+	* !@brief Memory pressure callback, evicts at most maxEvictionsPerFrame images. Memory that retired
+	* images give back once their frames are done counts towards the request
+	*/
+	VkDeviceSize release(VkDeviceSize bytes);
+
+	std::unordered_map<const Image*, StreamedTexture> textures = {};
+	TVector<RetiredImage> retired = {};
+	// Staging buffers of uploads, released once the queue reaches their ticket
+	TVector<std::pair<Queue::Ticket, TAuto<Buffer>>> staging = {};
+
+	VkDeviceSize textureBudget = 0;
+	uint64_t frame = 0;
+	uint32_t evictableHandle = 0;
+
+	const uint32_t initialResidentSize = 128u;
+	const uint32_t maxPendingLoads = 2u;
+	const uint32_t maxEvictionsPerFrame = 4u;
+	const float budgetFraction = 0.9f;
+
+	const RenderScope* Scope = VK_NULL_HANDLE;
+};
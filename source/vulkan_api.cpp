@@ -31,6 +31,29 @@ VkBool32 CreateSemaphore(const VkDevice& device, VkSemaphore* outSemaphore)
 	return vkCreateSemaphore(device, &createInfo, VK_NULL_HANDLE, outSemaphore) == VK_SUCCESS;
 }
 
+VkBool32 CreateTimelineSemaphore(const VkDevice& device, VkSemaphore* outSemaphore, uint64_t initialValue)
+{
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = initialValue;
+
+	VkSemaphoreCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	createInfo.pNext = &typeInfo;
+	return vkCreateSemaphore(device, &createInfo, VK_NULL_HANDLE, outSemaphore) == VK_SUCCESS;
+}
+
+VkBool32 WaitTimelineSemaphore(const VkDevice& device, const VkSemaphore& semaphore, uint64_t value)
+{
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &semaphore;
+	waitInfo.pValues = &value;
+	return vkWaitSemaphores(device, &waitInfo, UINT64_MAX) == VK_SUCCESS;
+}
+
 VkBool32 AllocateCommandBuffers(const VkDevice& device, const VkCommandPool& pool, const uint32_t count, VkCommandBuffer* outBuffers)
 {
 	VkCommandBufferAllocateInfo allocInfo{};
@@ -221,9 +244,10 @@ VkBool32 CreateFramebuffer(const VkDevice& device, const VkRenderPass& renderPas
 	return vkCreateFramebuffer(device, &createInfo, VK_NULL_HANDLE, outFramebuffer) == VK_SUCCESS;
 }
 
-VkBool32 CreateAllocator(const VkInstance& instance, const VkPhysicalDevice& physicalDevice, const VkDevice& device, VmaAllocator* outAllocator)
+VkBool32 CreateAllocator(const VkInstance& instance, const VkPhysicalDevice& physicalDevice, const VkDevice& device, VmaAllocator* outAllocator, VmaAllocatorCreateFlags flags)
 {
 	VmaAllocatorCreateInfo createInfo{};
+	createInfo.flags = flags;
 	createInfo.device = device;
 	createInfo.instance = instance;
 	createInfo.physicalDevice = physicalDevice;
@@ -269,8 +293,20 @@ VkBool32 CreateLogicalDevice(const VkPhysicalDevice& physicalDevice, const VkPhy
 		queueInfos.push_back(queueCreateInfo);
 	}
 
+	// Queues submit through vkQueueSubmit2
+	VkPhysicalDeviceVulkan13Features vulkan13Features{};
+	vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	vulkan13Features.synchronization2 = VK_TRUE;
+
+	// Queue submissions and frame work on the graphics and compute queues are ordered with timeline semaphores
+	VkPhysicalDeviceVulkan12Features vulkan12Features{};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan12Features.pNext = &vulkan13Features;
+	vulkan12Features.timelineSemaphore = VK_TRUE;
+
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	createInfo.pNext = &vulkan12Features;
 	createInfo.pEnabledFeatures = &device_features;
 	createInfo.ppEnabledExtensionNames = device_extensions.data();
 	createInfo.enabledExtensionCount = device_extensions.size();
@@ -322,4 +358,15 @@ TVector<unsigned char> AnyTypeToBytes(std::any target)
 	}
 
 	return buf;
+}
+
+uint64_t Fnv1a(uint64_t hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+
+	return hash;
 }
\ No newline at end of file
@@ -24,6 +24,26 @@ VkBool32 CreateFence(const VkDevice& device, VkFence* outFence, VkBool32 signale
 */
 VkBool32 CreateSemaphore(const VkDevice& device, VkSemaphore* outSemaphore);
 /*
+* !@brief Creates timeline semaphore, its counter only grows and can be waited on from host and queues
+*
+* @param[in] device - logical device to create object on
+* @param[out] outSemaphore - pointer to store semaphore at
+* @param[in] initialValue - counter value right after creation
+*
+* @return VK_TRUE if creation was successful, VK_FALSE otherwise
+*/
+VkBool32 CreateTimelineSemaphore(const VkDevice& device, VkSemaphore* outSemaphore, uint64_t initialValue = 0);
+/*
+* !@brief Blocks until counter of timeline semaphore reaches the value
+*
+* @param[in] device - logical device semaphore was created on
+* @param[in] semaphore - timeline semaphore to wait on
+* @param[in] value - counter value to wait for
+*
+* @return VK_TRUE if the value was reached, VK_FALSE otherwise
+*/
+VkBool32 WaitTimelineSemaphore(const VkDevice& device, const VkSemaphore& semaphore, uint64_t value);
+/*
 * !@brief Allocates specified number of command buffers from the pool
 *
 * @param[in] device - logical device to allocate on
@@ -100,9 +120,11 @@ VkBool32 CreateFramebuffer(const VkDevice& device, const VkRenderPass& renderPas
 /*
 * !@brief Initialize Vulkan Memmory Allocator to handle allocations
 *
+* @param[in] flags - allocator flags, e.g. to enable VK_EXT_memory_budget usage
+*
 * @return VK_TRUE if creation is successful, VK_FALSE otherwise
 */
-VkBool32 CreateAllocator(const VkInstance& instance, const VkPhysicalDevice& physicalDevice, const VkDevice& device, VmaAllocator* outAllocator);
+VkBool32 CreateAllocator(const VkInstance& instance, const VkPhysicalDevice& physicalDevice, const VkDevice& device, VmaAllocator* outAllocator, VmaAllocatorCreateFlags flags = 0);
 /*
 * !@brief Find suitable physical device
 * compatable with required extensions
@@ -125,4 +147,16 @@ VkBool32 BeginOneTimeSubmitCmd(VkCommandBuffer& cmd);
 
 VkBool32 EndCommandBuffer(VkCommandBuffer& cmd);
 
-TVector<unsigned char> AnyTypeToBytes(std::any target);
\ No newline at end of file
+TVector<unsigned char> AnyTypeToBytes(std::any target);
+
+#define FNV1A_OFFSET 0xcbf29ce484222325ull
+/*
+* !@brief 64 bit FNV-1a hash, used to key on-disk caches
+*
+* @param[in] hash - running hash, start with FNV1A_OFFSET
+* @param[in] data - bytes to accumulate
+* @param[in] size - count of bytes
+*
+* @return Updated hash
+*/
+uint64_t Fnv1a(uint64_t hash, const void* data, size_t size);
\ No newline at end of file
@@ -4,7 +4,9 @@
 Buffer::Buffer(const RenderScope& InScope, const VkBufferCreateInfo& createInfo, const VmaAllocationCreateInfo& allocCreateInfo)
 	: Scope(&InScope)
 {
-	VkBool32 res = vmaCreateBuffer(Scope->GetAllocator(), &createInfo, &allocCreateInfo, &buffer, &memory, &allocInfo) == VK_SUCCESS;
+	VkBool32 res = Scope->AllocateWithinBudget(allocCreateInfo, createInfo.size, [&, this](const VmaAllocationCreateInfo& Info) {
+		return vmaCreateBuffer(Scope->GetAllocator(), &createInfo, &Info, &buffer, &memory, &allocInfo);
+	}) == VK_SUCCESS;
 	descriptorInfo.buffer = buffer;
 	descriptorInfo.offset = 0;
 	descriptorInfo.range = createInfo.size;
@@ -78,3 +80,24 @@ Buffer& Buffer::Update(VkCommandBuffer cmd, void* data, size_t data_size)
 
 	return *this;
 }
+
+Buffer& Buffer::Read(void* data, size_t data_size)
+{
+	if (data_size == VK_WHOLE_SIZE)
+		data_size = allocInfo.size;
+
+	vmaInvalidateAllocation(Scope->GetAllocator(), memory, 0, data_size);
+
+	if (!mappedMemory)
+	{
+		Map();
+		memcpy(data, mappedMemory, data_size);
+		UnMap();
+	}
+	else
+	{
+		memcpy(data, mappedMemory, data_size);
+	}
+
+	return *this;
+}
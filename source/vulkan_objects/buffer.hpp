@@ -49,6 +49,8 @@ struct Buffer
 
 	Buffer& Update(VkCommandBuffer cmd, void* data, size_t data_size = VK_WHOLE_SIZE);
 
+	Buffer& Read(void* data, size_t data_size = VK_WHOLE_SIZE);
+
 	uint32_t GetSize() { return allocInfo.size; };
 
 private:
@@ -0,0 +1,109 @@
+#include "pch.hpp"
+#include "descriptor_allocator.hpp"
+#include "vulkan_api.hpp"
+#include <algorithm>
+
+DescriptorAllocator::DescriptorAllocator(const VkDevice& inDevice, uint32_t inSetsPerPool, const TVector<VkDescriptorPoolSize>& inPoolSizes)
+	: poolSizes(inPoolSizes), setsPerPool(inSetsPerPool), device(inDevice)
+{
+
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+	for (VkDescriptorPool pool : persistent.pools)
+		vkDestroyDescriptorPool(device, pool, VK_NULL_HANDLE);
+
+	for (auto& [key, layout] : layouts)
+		vkDestroyDescriptorSetLayout(device, layout, VK_NULL_HANDLE);
+}
+
+VkDescriptorSetLayout DescriptorAllocator::GetLayout(const TVector<VkDescriptorSetLayoutBinding>& bindings)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	LayoutKey key = {};
+	for (const VkDescriptorSetLayoutBinding& binding : bindings)
+		key.push_back({ binding.binding, static_cast<uint32_t>(binding.descriptorType), binding.descriptorCount, binding.stageFlags });
+
+	// Order of the bindings does not change the layout
+	std::sort(key.begin(), key.end());
+
+	auto it = layouts.find(key);
+	if (it != layouts.end())
+		return it->second;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, VK_NULL_HANDLE, &layout) != VK_SUCCESS)
+		return VK_NULL_HANDLE;
+
+	layouts.emplace(std::move(key), layout);
+	return layout;
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout layout, VkDescriptorPool* outPool)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return allocate_from(persistent, layout, outPool);
+}
+
+void DescriptorAllocator::Free(VkDescriptorPool pool, VkDescriptorSet set)
+{
+	if (set == VK_NULL_HANDLE)
+		return;
+
+	std::lock_guard<std::mutex> guard(lock);
+	vkFreeDescriptorSets(device, pool, 1, &set);
+
+	// Freed space might be enough for the next set, try the earliest pools again
+	persistent.current = 0;
+}
+
+uint32_t DescriptorAllocator::GetPoolCount() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return static_cast<uint32_t>(persistent.pools.size());
+}
+
+VkDescriptorSet DescriptorAllocator::allocate_from(PoolChain& chain, VkDescriptorSetLayout layout, VkDescriptorPool* outPool)
+{
+	VkDescriptorSetAllocateInfo setAlloc{};
+	setAlloc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAlloc.descriptorSetCount = 1;
+	setAlloc.pSetLayouts = &layout;
+
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	for (; chain.current < chain.pools.size(); chain.current++)
+	{
+		setAlloc.descriptorPool = chain.pools[chain.current];
+		VkResult res = vkAllocateDescriptorSets(device, &setAlloc, &set);
+
+		if (res == VK_SUCCESS)
+		{
+			*outPool = setAlloc.descriptorPool;
+			return set;
+		}
+
+		// Any other error would repeat with a new pool as well
+		if (res != VK_ERROR_OUT_OF_POOL_MEMORY && res != VK_ERROR_FRAGMENTED_POOL)
+			return VK_NULL_HANDLE;
+	}
+
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	if (!::CreateDescriptorPool(device, poolSizes.data(), poolSizes.size(), setsPerPool, &pool))
+		return VK_NULL_HANDLE;
+
+	chain.pools.push_back(pool);
+	chain.current = static_cast<uint32_t>(chain.pools.size() - 1);
+
+	setAlloc.descriptorPool = pool;
+	if (vkAllocateDescriptorSets(device, &setAlloc, &set) != VK_SUCCESS)
+		return VK_NULL_HANDLE;
+
+	*outPool = pool;
+	return set;
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+#include <glfw/glfw3.h>
+#include <vma/vk_mem_alloc.h>
+#include <map>
+#include <mutex>
+#include "math.hpp"
+
+/*
+* !@brief Hands out descriptor sets from a chain of pools that grows when the pools run out.
+* Layouts are cached by their bindings so identical layouts are created once. Safe to use from several threads
+*/
+class DescriptorAllocator
+{
+public:
+	DescriptorAllocator(const VkDevice& device, uint32_t setsPerPool, const TVector<VkDescriptorPoolSize>& poolSizes);
+
+	DescriptorAllocator(const DescriptorAllocator& other) = delete;
+
+	void operator=(const DescriptorAllocator& other) = delete;
+
+	~DescriptorAllocator();
+	/*
+	* !@brief Layout with the given bindings, owned by the allocator and shared by every set using the same bindings
+	*/
+	VkDescriptorSetLayout GetLayout(const TVector<VkDescriptorSetLayoutBinding>& bindings);
+	/*
+	* !@brief Allocate set kept until Free
+	*
+	* @param[in] layout - layout of the set
+	* @param[out] outPool - pool the set was allocated from, has to be passed to Free
+	*
+	* @return Allocated set, VK_NULL_HANDLE if a new pool could not be created
+	*/
+	VkDescriptorSet Allocate(VkDescriptorSetLayout layout, VkDescriptorPool* outPool);
+
+	void Free(VkDescriptorPool pool, VkDescriptorSet set);
+
+	uint32_t GetPoolCount() const;
+
+private:
+	struct PoolChain
+	{
+		TVector<VkDescriptorPool> pools = {};
+		// Pools before it are exhausted until sets are freed
+		uint32_t current = 0;
+	};
+
+	using LayoutKey = TVector<TArray<uint32_t, 4>>;
+
+	VkDescriptorSet allocate_from(PoolChain& chain, VkDescriptorSetLayout layout, VkDescriptorPool* outPool);
+
+	PoolChain persistent = {};
+	std::map<LayoutKey, VkDescriptorSetLayout> layouts = {};
+	TVector<VkDescriptorPoolSize> poolSizes = {};
+	uint32_t setsPerPool = 0;
+	mutable std::mutex lock;
+
+	const VkDevice device = VK_NULL_HANDLE;
+};
\ No newline at end of file
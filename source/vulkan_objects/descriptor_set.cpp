@@ -8,8 +8,7 @@ DescriptorSet::DescriptorSet(const RenderScope& InScope)
 
 DescriptorSet::~DescriptorSet()
 {
-	vkDestroyDescriptorSetLayout(Scope.GetDevice(), descriptorSetLayout, VK_NULL_HANDLE);
-	vkFreeDescriptorSets(Scope.GetDevice(), Scope.GetDescriptorPool(), 1, &descriptorSet);
+	Scope.GetDescriptorAllocator().Free(descriptorPool, descriptorSet);
 }
 
 void DescriptorSet::BindSet(uint32_t set, VkCommandBuffer cmd, const Pipeline& pipeline)
@@ -122,22 +121,79 @@ DescriptorSetDescriptor& DescriptorSetDescriptor::AddStorageImage(uint32_t bindi
 	return *this;
 }
 
+DescriptorSetDescriptor& DescriptorSetDescriptor::AddImageSampler(uint32_t binding, VkShaderStageFlags stages, const VkDescriptorImageInfo& info)
+{
+	VkDescriptorSetLayoutBinding DSBinding{};
+	DSBinding.binding = binding;
+	DSBinding.descriptorCount = 1;
+	DSBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	DSBinding.stageFlags = stages;
+
+	VkWriteDescriptorSet DSWrites{};
+	DSWrites.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	DSWrites.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	DSWrites.descriptorCount = 1;
+	DSWrites.dstBinding = binding;
+	DSWrites.pImageInfo = &imageInfos.emplace_back(info);
+
+	bindings.push_back(DSBinding);
+	writes.push_back(DSWrites);
+
+	return *this;
+}
+
+DescriptorSetDescriptor& DescriptorSetDescriptor::AddStorageImage(uint32_t binding, VkShaderStageFlags stages, const VkDescriptorImageInfo& info)
+{
+	VkDescriptorSetLayoutBinding DSBinding{};
+	DSBinding.binding = binding;
+	DSBinding.descriptorCount = 1;
+	DSBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	DSBinding.stageFlags = stages;
+
+	VkWriteDescriptorSet DSWrites{};
+	DSWrites.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	DSWrites.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	DSWrites.descriptorCount = 1;
+	DSWrites.dstBinding = binding;
+	DSWrites.pImageInfo = &imageInfos.emplace_back(info);
+
+	bindings.push_back(DSBinding);
+	writes.push_back(DSWrites);
+
+	return *this;
+}
+
+DescriptorSetDescriptor& DescriptorSetDescriptor::AddSubpassAttachment(uint32_t binding, VkShaderStageFlags stages, const VkDescriptorImageInfo& info)
+{
+	VkDescriptorSetLayoutBinding DSBinding{};
+	DSBinding.binding = binding;
+	DSBinding.descriptorCount = 1;
+	DSBinding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	DSBinding.stageFlags = stages;
+
+	VkWriteDescriptorSet DSWrites{};
+	DSWrites.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	DSWrites.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	DSWrites.descriptorCount = 1;
+	DSWrites.dstBinding = binding;
+	DSWrites.pImageInfo = &imageInfos.emplace_back(info);
+
+	bindings.push_back(DSBinding);
+	writes.push_back(DSWrites);
+
+	return *this;
+}
+
 TAuto<DescriptorSet> DescriptorSetDescriptor::Allocate(const RenderScope& Scope)
 {
 	TAuto<DescriptorSet> out = std::make_unique<DescriptorSet>(Scope);
 
-	VkDescriptorSetLayoutCreateInfo dsetInfo{};
-	dsetInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	dsetInfo.bindingCount = bindings.size();
-	dsetInfo.pBindings = bindings.data();
-	vkCreateDescriptorSetLayout(Scope.GetDevice(), &dsetInfo, VK_NULL_HANDLE, &out->descriptorSetLayout);
-
-	VkDescriptorSetAllocateInfo setAlloc{};
-	setAlloc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	setAlloc.descriptorPool = Scope.GetDescriptorPool();
-	setAlloc.descriptorSetCount = 1;
-	setAlloc.pSetLayouts = &out->descriptorSetLayout;
-	vkAllocateDescriptorSets(Scope.GetDevice(), &setAlloc, &out->descriptorSet);
+	DescriptorAllocator& allocator = Scope.GetDescriptorAllocator();
+	out->descriptorSetLayout = allocator.GetLayout(bindings);
+	out->descriptorSet = allocator.Allocate(out->descriptorSetLayout, &out->descriptorPool);
+
+	if (out->descriptorSet == VK_NULL_HANDLE)
+		return VK_NULL_HANDLE;
 
 	for (auto& write : writes)
 		write.dstSet = out->descriptorSet;
@@ -4,6 +4,7 @@
 #include "buffer.hpp"
 #include "image.hpp"
 #include "scope.hpp"
+#include <list>
 
 class DescriptorSet
 {
@@ -22,6 +23,8 @@ private:
 	const RenderScope& Scope;
 
 	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	// Owned by the layout cache of the descriptor allocator
 	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
 };
 
@@ -39,12 +42,21 @@ public:
 	DescriptorSetDescriptor& AddSubpassAttachment(uint32_t binding, VkShaderStageFlags stages, const VulkanImage& image);
 
 	DescriptorSetDescriptor& AddStorageImage(uint32_t binding, VkShaderStageFlags stages, const VulkanImage& image);
+	/*
+	* !@brief Bind explicit view and layout, e.g. a single mip level or an attachment outside of its render pass
+	*/
+	DescriptorSetDescriptor& AddImageSampler(uint32_t binding, VkShaderStageFlags stages, const VkDescriptorImageInfo& info);
+
+	DescriptorSetDescriptor& AddStorageImage(uint32_t binding, VkShaderStageFlags stages, const VkDescriptorImageInfo& info);
+
+	DescriptorSetDescriptor& AddSubpassAttachment(uint32_t binding, VkShaderStageFlags stages, const VkDescriptorImageInfo& info);
 
 	TAuto<DescriptorSet> Allocate(const RenderScope& Scope);
 
 private:
 	TVector<VkDescriptorSetLayoutBinding> bindings;
 	TVector<VkWriteDescriptorSet> writes;
+	std::list<VkDescriptorImageInfo> imageInfos;
 
 	const RenderScope* Scope;
 };
\ No newline at end of file
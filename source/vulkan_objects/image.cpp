@@ -15,6 +15,8 @@ VulkanImage::VulkanImage(const RenderScope& InScope, const VkImageCreateInfo& im
 
 VulkanImage::~VulkanImage()
 {
+	for (VkImageView& mipView : mipViews)
+		vkDestroyImageView(Scope->GetDevice(), mipView, VK_NULL_HANDLE);
 	if (view != VK_NULL_HANDLE)
 		vkDestroyImageView(Scope->GetDevice(), view, VK_NULL_HANDLE);
 	if (image != VK_NULL_HANDLE)
@@ -31,7 +33,36 @@ VulkanImage& VulkanImage::CreateImage(const VkImageCreateInfo& imgInfo, const Vm
 	if (image != VK_NULL_HANDLE)
 		vmaDestroyImage(Scope->GetAllocator(), image, memory);
 
-	VkBool32 res = vmaCreateImage(Scope->GetAllocator(), &imgInfo, &allocCreateInfo, &image, &memory, &allocInfo) == VK_SUCCESS;
+	VkDeviceImageMemoryRequirements requirementsInfo{};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+	requirementsInfo.pCreateInfo = &imgInfo;
+	VkMemoryRequirements2 requirements{};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	vkGetDeviceImageMemoryRequirements(Scope->GetDevice(), &requirementsInfo, &requirements);
+
+	VkBool32 res = Scope->AllocateWithinBudget(allocCreateInfo, requirements.memoryRequirements.size, [&, this](const VmaAllocationCreateInfo& Info) {
+		return vmaCreateImage(Scope->GetAllocator(), &imgInfo, &Info, &image, &memory, &allocInfo);
+	}) == VK_SUCCESS;
+	descriptorInfo.imageLayout = imgInfo.initialLayout;
+	subRange.levelCount = imgInfo.arrayLayers;
+	subRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageSize = imgInfo.extent;
+
+	assert(res);
+	return *this;
+}
+
+VulkanImage& VulkanImage::CreateImage(const VkImageCreateInfo& imgInfo, VmaAllocation sharedMemory)
+{
+	if (image != VK_NULL_HANDLE)
+		vmaDestroyImage(Scope->GetAllocator(), image, memory);
+
+	// Memory stays with its owner, destruction only releases the image
+	memory = VK_NULL_HANDLE;
+	allocInfo = {};
+
+	VkBool32 res = vkCreateImage(Scope->GetDevice(), &imgInfo, VK_NULL_HANDLE, &image) == VK_SUCCESS;
+	res = (vmaBindImageMemory(Scope->GetAllocator(), sharedMemory, image) == VK_SUCCESS) & res;
 	descriptorInfo.imageLayout = imgInfo.initialLayout;
 	subRange.levelCount = imgInfo.arrayLayers;
 	subRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -46,11 +77,17 @@ VulkanImage& VulkanImage::CreateImageView(const VkImageViewCreateInfo& viewInfo)
 	if (view != VK_NULL_HANDLE)
 		vkDestroyImageView(Scope->GetDevice(), view, VK_NULL_HANDLE);
 
+	for (VkImageView& mipView : mipViews)
+		vkDestroyImageView(Scope->GetDevice(), mipView, VK_NULL_HANDLE);
+	mipViews.clear();
+
 	VkImageViewCreateInfo Info = viewInfo;
 	Info.image = image;
+	viewCreateInfo = Info;
 	VkBool32 res = vkCreateImageView(Scope->GetDevice(), &Info, VK_NULL_HANDLE, &view) == VK_SUCCESS;
 	descriptorInfo.imageView = view;
 	subRange = viewInfo.subresourceRange;
+	revision++;
 
 	assert(res);
 	return *this;
@@ -63,20 +100,35 @@ VulkanImage& VulkanImage::CreateSampler(ESamplerType Type)
 	return *this;
 }
 
+VulkanImage& VulkanImage::CreateMipViews()
+{
+	assert(view != VK_NULL_HANDLE);
+
+	VkBool32 res = 1;
+	mipViews.resize(subRange.levelCount, VK_NULL_HANDLE);
+	for (uint32_t mip = 0; mip < subRange.levelCount; mip++)
+	{
+		VkImageViewCreateInfo Info = viewCreateInfo;
+		Info.subresourceRange.baseMipLevel = subRange.baseMipLevel + mip;
+		Info.subresourceRange.levelCount = 1;
+		res = (vkCreateImageView(Scope->GetDevice(), &Info, VK_NULL_HANDLE, &mipViews[mip]) == VK_SUCCESS) & res;
+	}
+
+	assert(res);
+	return *this;
+}
+
 VulkanImage& VulkanImage::TransitionLayout(VkImageLayout newLayout)
 {
 	VkCommandBuffer cmd;
-	Scope->GetQueue(VK_QUEUE_GRAPHICS_BIT)
-		.AllocateCommandBuffers(1, &cmd);
+	const Queue& Queue = Scope->GetQueue(VK_QUEUE_GRAPHICS_BIT);
+	Queue.AllocateCommandBuffers(1, &cmd);
 
 	::BeginOneTimeSubmitCmd(cmd);
 	TransitionLayout(cmd, newLayout);
 	::EndCommandBuffer(cmd);
 
-	Scope->GetQueue(VK_QUEUE_GRAPHICS_BIT)
-		.Submit(cmd)
-		.Wait()
-		.FreeCommandBuffers(1, &cmd);
+	Queue.Wait(Queue.Submit(cmd));
 
 	return *this;
 }
@@ -85,7 +137,7 @@ VulkanImage& VulkanImage::TransitionLayout(VkCommandBuffer& cmd, VkImageLayout n
 {
 	const std::unordered_map<VkImageLayout, VkPipelineStageFlags> stageTable = {
 		{VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT},
-		{VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT},
+		{VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT},
 		{VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT},
 		{VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT},
 		{VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT},
@@ -96,7 +148,7 @@ VulkanImage& VulkanImage::TransitionLayout(VkCommandBuffer& cmd, VkImageLayout n
 
 	const std::unordered_map<VkImageLayout, VkAccessFlags> accessTable = {
 		{VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_NONE_KHR},
-		{VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_NONE_KHR},
+		{VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT},
 		{VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT},
 		{VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT},
 		{VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT},
@@ -127,17 +179,14 @@ VulkanImage& VulkanImage::TransitionLayout(VkCommandBuffer& cmd, VkImageLayout n
 VulkanImage& VulkanImage::GenerateMipMaps()
 {
 	VkCommandBuffer cmd;
-	Scope->GetQueue(VK_QUEUE_GRAPHICS_BIT)
-		.AllocateCommandBuffers(1, &cmd);
+	const Queue& Queue = Scope->GetQueue(VK_QUEUE_GRAPHICS_BIT);
+	Queue.AllocateCommandBuffers(1, &cmd);
 
 	::BeginOneTimeSubmitCmd(cmd);
 	GenerateMipMaps(cmd);
 	::EndCommandBuffer(cmd);
 
-	Scope->GetQueue(VK_QUEUE_GRAPHICS_BIT)
-		.Submit(cmd)
-		.Wait()
-		.FreeCommandBuffers(1, &cmd);
+	Queue.Wait(Queue.Submit(cmd));
 
 	return *this;
 }
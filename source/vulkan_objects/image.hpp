@@ -17,8 +17,8 @@ struct VulkanImage : Image
 	void operator=(const VulkanImage& other) = delete;
 
 	VulkanImage(VulkanImage&& other) noexcept
-		: Scope(other.Scope), image(std::move(other.image)), view(std::move(other.view)), sampler(std::move(other.sampler)), memory(std::move(other.memory)),
-		allocInfo(std::move(other.allocInfo)), descriptorInfo(std::move(other.descriptorInfo))
+		: Scope(other.Scope), image(std::move(other.image)), view(std::move(other.view)), viewCreateInfo(other.viewCreateInfo), mipViews(std::move(other.mipViews)), sampler(std::move(other.sampler)), memory(std::move(other.memory)),
+		allocInfo(std::move(other.allocInfo)), descriptorInfo(std::move(other.descriptorInfo)), subRange(other.subRange), imageSize(other.imageSize), revision(other.revision)
 	{
 		other.image = VK_NULL_HANDLE;
 		other.view = VK_NULL_HANDLE;
@@ -32,10 +32,15 @@ struct VulkanImage : Image
 		Scope = other.Scope;
 		image = std::move(other.image);
 		view = std::move(other.view);
+		viewCreateInfo = other.viewCreateInfo;
 		sampler = std::move(other.sampler);
 		memory = std::move(other.memory);
 		allocInfo = std::move(other.allocInfo);
 		descriptorInfo = std::move(other.descriptorInfo);
+		subRange = other.subRange;
+		imageSize = other.imageSize;
+		revision = other.revision;
+		mipViews = std::move(other.mipViews);
 
 		other.image = VK_NULL_HANDLE;
 		other.view = VK_NULL_HANDLE;
@@ -48,10 +53,18 @@ struct VulkanImage : Image
 	~VulkanImage();
 
 	VulkanImage& CreateImage(const VkImageCreateInfo& imgInfo, const VmaAllocationCreateInfo& allocCreateInfo);
+	/*
+	* !@brief Bind the image to memory owned by someone else, e.g. transient memory aliased by the render graph
+	*/
+	VulkanImage& CreateImage(const VkImageCreateInfo& imgInfo, VmaAllocation sharedMemory);
 
 	VulkanImage& CreateImageView(const VkImageViewCreateInfo& viewInfo);
 
 	VulkanImage& CreateSampler(ESamplerType Type);
+	/*
+	* !@brief Create an additional view for every mip level of the current view, needed to write mips from shaders
+	*/
+	VulkanImage& CreateMipViews();
 
 	VulkanImage& TransitionLayout(VkImageLayout newLayout);
 
@@ -65,6 +78,8 @@ struct VulkanImage : Image
 
 	const VkImageView& GetImageView() const { return view; };
 
+	const VkImageView& GetMipView(uint32_t mip) const { return mipViews[mip]; };
+
 	const VkSampler& GetSampler() const { return sampler; };
 
 	const VkDescriptorImageInfo& GetDescriptor() const { return descriptorInfo; };
@@ -72,16 +87,26 @@ struct VulkanImage : Image
 	const VkImageSubresourceRange& GetSubResourceRange() const { return subRange; };
 
 	const VkExtent3D& GetExtent() const { return imageSize; };
+	/*
+	* !@brief Changes every time the image view is recreated, descriptor sets referencing
+	* older revision of the image have to be updated
+	*/
+	uint32_t GetRevision() const { return revision; };
 
 private:
+	friend class TextureStreamer;
+
 	VkImage image = VK_NULL_HANDLE;
 	VkImageView view = VK_NULL_HANDLE;
+	VkImageViewCreateInfo viewCreateInfo = {};
+	TVector<VkImageView> mipViews = {};
 	VkSampler sampler = VK_NULL_HANDLE;
 	VmaAllocation memory = VK_NULL_HANDLE;
 	VmaAllocationInfo allocInfo = {};
 	VkDescriptorImageInfo descriptorInfo = {};
 	VkImageSubresourceRange subRange = {};
 	VkExtent3D imageSize = {};
+	uint32_t revision = 0;
 
 	const RenderScope* Scope = VK_NULL_HANDLE;
 };
\ No newline at end of file
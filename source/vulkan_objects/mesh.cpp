@@ -1,8 +1,8 @@
 #include "pch.hpp"
 #include "mesh.hpp"
 
-Mesh::Mesh(const RenderScope& InScope, Vertex* vertices, size_t numVertices, uint32_t* indices, size_t numIndices)
-	: Scope(&InScope)
+Mesh::Mesh(const RenderScope& InScope, Vertex* vertices, size_t numVertices, uint32_t* indices, size_t numIndices, const TVector<MeshLod>& InLods, const TVector<Meshlet>& InMeshlets)
+	: lods(InLods), Scope(&InScope)
 {
 	VkBufferCreateInfo sbInfo{};
 	sbInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -24,4 +24,42 @@ Mesh::Mesh(const RenderScope& InScope, Vertex* vertices, size_t numVertices, uin
 
 	verticesCount = numVertices;
 	indicesCount = numIndices;
+
+	if (lods.empty())
+		lods.push_back({ 0u, static_cast<uint32_t>(numIndices), 0.0f });
+
+	TVec3 minBound = TVec3(std::numeric_limits<float>::max());
+	TVec3 maxBound = TVec3(std::numeric_limits<float>::lowest());
+	for (size_t i = 0; i < numVertices; i++) {
+		minBound = glm::min(minBound, vertices[i].position);
+		maxBound = glm::max(maxBound, vertices[i].position);
+	}
+
+	float radius = 0.0;
+	TVec3 center = numVertices > 0 ? (minBound + maxBound) * 0.5f : TVec3(0.0);
+	for (size_t i = 0; i < numVertices; i++) {
+		radius = glm::max(radius, glm::distance(center, vertices[i].position));
+	}
+	boundingSphere = TVec4(center, radius);
+
+	TVector<Meshlet> meshlets = InMeshlets;
+	if (meshlets.empty())
+	{
+		for (MeshLod& lod : lods)
+		{
+			Meshlet whole{};
+			whole.sphere = boundingSphere;
+			whole.firstIndex = lod.firstIndex;
+			whole.indexCount = lod.indexCount;
+
+			lod.firstMeshlet = static_cast<uint32_t>(meshlets.size());
+			lod.meshletCount = 1u;
+			meshlets.push_back(whole);
+		}
+	}
+
+	sbInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	sbInfo.size = sizeof(Meshlet) * meshlets.size();
+	meshletBuffer = std::make_unique<Buffer>(*Scope, sbInfo, sbAlloc);
+	meshletBuffer->Map().Update(meshlets.data()).UnMap();
 }
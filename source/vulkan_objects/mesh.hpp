@@ -7,17 +7,44 @@
 #include "vertex.hpp"
 #include "scope.hpp"
 
+/*
+* !@brief Range of the index buffer holding a single level of detail
+*/
+struct MeshLod
+{
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	float error = 0.0;
+	uint32_t firstMeshlet = 0;
+	uint32_t meshletCount = 0;
+};
+/*
+* !@brief Cluster of triangles culled on GPU as a whole, layout matches meshlet_cull.comp
+*/
+struct Meshlet
+{
+	TVec4 sphere = TVec4(0.0);
+	TVec4 cone = TVec4(0.0, 0.0, 0.0, 1.0);
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	uint32_t padding[2] = { 0u, 0u };
+};
+
 struct Mesh
 {
-	Mesh(const RenderScope& Scope, Vertex* vertices, size_t numVertices, uint32_t* indices, size_t numIndices);
+	/*
+	* @param[in] lods - index ranges of levels of detail, whole index buffer is a single level if empty
+	* @param[in] meshlets - clusters referenced by lods, every level is a single unculled cluster if empty
+	*/
+	Mesh(const RenderScope& Scope, Vertex* vertices, size_t numVertices, uint32_t* indices, size_t numIndices, const TVector<MeshLod>& lods = {}, const TVector<Meshlet>& meshlets = {});
 
 	Mesh(const Mesh& other) = delete;
 
 	void operator=(const Mesh& other) = delete;
 
 	Mesh(Mesh&& other) noexcept
-		: Scope(other.Scope), vertexBuffer(std::move(other.vertexBuffer)), indexBuffer(std::move(other.indexBuffer)),
-		indicesCount(other.indicesCount), verticesCount(other.verticesCount)
+		: vertexBuffer(std::move(other.vertexBuffer)), indexBuffer(std::move(other.indexBuffer)), meshletBuffer(std::move(other.meshletBuffer)),
+		indicesCount(other.indicesCount), verticesCount(other.verticesCount), boundingSphere(other.boundingSphere), lods(std::move(other.lods)), Scope(other.Scope)
 	{
 		other.indicesCount = 0;
 		other.verticesCount = 0;
@@ -27,8 +54,11 @@ struct Mesh
 		Scope = other.Scope;
 		vertexBuffer = std::move(other.vertexBuffer);
 		indexBuffer = std::move(other.indexBuffer);
+		meshletBuffer = std::move(other.meshletBuffer);
 		indicesCount = other.indicesCount;
 		verticesCount = other.indicesCount;
+		boundingSphere = other.boundingSphere;
+		lods = std::move(other.lods);
 
 		other.indicesCount = 0;
 		other.verticesCount = 0;
@@ -39,16 +69,39 @@ struct Mesh
 	TShared<const Buffer> GetVertexBuffer() const { return vertexBuffer; };
 
 	TShared<const Buffer> GetIndexBuffer() const { return indexBuffer; };
+	/*
+	* !@brief Storage buffer of Meshlet structures of all levels of detail
+	*/
+	TShared<const Buffer> GetMeshletBuffer() const { return meshletBuffer; };
 
 	uint32_t GetIndicesCount() const { return indicesCount; };
 
 	uint32_t GetVerticesCount() const { return verticesCount; };
+	/*
+	* !@brief Sphere enclosing all vertices of the mesh in object space
+	*
+	* @return Center of the sphere (xyz) and its radius (w)
+	*/
+	const TVec4& GetBoundingSphere() const { return boundingSphere; };
+
+	uint32_t GetLodCount() const { return static_cast<uint32_t>(lods.size()); };
+	/*
+	* !@brief Get index range of a level of detail, zero is the full detail mesh
+	*
+	* @param[in] level - level of detail, clamped to the coarsest available one
+	*
+	* @return Index range and object space error of the level
+	*/
+	const MeshLod& GetLod(uint32_t level) const { return lods[glm::min(level, GetLodCount() - 1)]; };
 
 private:
 	TShared<Buffer> vertexBuffer = {};
 	TShared<Buffer> indexBuffer = {};
+	TShared<Buffer> meshletBuffer = {};
 	uint32_t indicesCount = 0;
 	uint32_t verticesCount = 0;
+	TVec4 boundingSphere = TVec4(0.0);
+	TVector<MeshLod> lods = {};
 
 	const RenderScope* Scope = VK_NULL_HANDLE;
 };
\ No newline at end of file
@@ -1,21 +1,96 @@
 #include "pch.hpp"
 #include "pipeline.hpp"
 
-extern std::string exec_path;
+/*
+* !@brief Specialization of a shader stage, kept alive until the pipeline is compiled
+*/
+struct StageSpecialization
+{
+	TVector<unsigned char> data = {};
+	TVector<VkSpecializationMapEntry> entries = {};
+	VkSpecializationInfo info = {};
+};
+
+struct ComputeBuild
+{
+	StageSpecialization specialization = {};
+	VkComputePipelineCreateInfo pipelineCI = {};
+};
+/*
+* !@brief Copy of the descriptor state, the descriptor may be gone before the job runs
+*/
+struct GraphicsBuild
+{
+	TArray<StageSpecialization, 5> specializations = {};
+	TVector<VkPipelineShaderStageCreateInfo> stages = {};
+	TVector<VkVertexInputBindingDescription> bindings = {};
+	TVector<VkVertexInputAttributeDescription> attributes = {};
+	TVector<VkPipelineColorBlendAttachmentState> blendAttachments = {};
+	TVector<VkDynamicState> dynamics = {};
+	VkPipelineVertexInputStateCreateInfo vertexInput = {};
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	VkPipelineRasterizationStateCreateInfo rasterizationState = {};
+	VkPipelineColorBlendStateCreateInfo blendState = {};
+	VkPipelineDepthStencilStateCreateInfo depthStencilState = {};
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	VkPipelineMultisampleStateCreateInfo multisampleState = {};
+	VkGraphicsPipelineCreateInfo pipelineCI = {};
+};
+
+static void fill_specialization(const std::map<uint32_t, std::any>& constants, StageSpecialization& out)
+{
+	size_t specialization_entry = 0ull, specialization_offset = 0ull;
+	out.entries.resize(constants.size());
+	for (auto [id, val] : constants) {
+		TVector<unsigned char> specialization_bytes(std::move(AnyTypeToBytes(val)));
+
+		out.data.resize(out.data.size() + specialization_bytes.size());
+		out.entries[specialization_entry].constantID = id;
+		out.entries[specialization_entry].offset = specialization_offset;
+		out.entries[specialization_entry].size = specialization_bytes.size();
+		memcpy(&out.data[specialization_offset], specialization_bytes.data(), specialization_bytes.size());
+
+		specialization_entry++;
+		specialization_offset += specialization_bytes.size();
+	}
+
+	out.info.mapEntryCount = out.entries.size();
+	out.info.pMapEntries = out.entries.data();
+	out.info.dataSize = out.data.size();
+	out.info.pData = out.data.data();
+}
 
 Pipeline::~Pipeline()
 {
+	Wait();
 	vkDestroyPipelineLayout(scope.GetDevice(), pipelineLayout, VK_NULL_HANDLE);
 	vkDestroyPipeline(scope.GetDevice(), pipeline, VK_NULL_HANDLE);
 }
 
 Pipeline& Pipeline::BindPipeline(VkCommandBuffer cmd)
 {
+	assert(GetResult() == VK_SUCCESS && "Pipeline failed to compile");
 	vkCmdBindPipeline(cmd, bindPoint, pipeline);
 
 	return *this;
 }
 
+const Pipeline& Pipeline::Wait() const
+{
+	// The pool is gone only once every compile has run
+	if (pending.valid() && pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		scope.GetWorkerPool().Wait(pending);
+
+	return *this;
+}
+
+VkResult Pipeline::GetResult() const
+{
+	Wait();
+	return result;
+}
+
 Pipeline& Pipeline::PushConstants(VkCommandBuffer cmd, const void* data, size_t dataSize, size_t offset, VkShaderStageFlagBits stages)
 {
 	vkCmdPushConstants(cmd, pipelineLayout, stages, offset, dataSize, data);
@@ -70,6 +145,10 @@ TAuto<Pipeline> ComputePipelineDescriptor::Construct(const RenderScope& Scope)
 {
 	//assert(pipeline == VK_NULL_HANDLE && pipelineLayout == VK_NULL_HANDLE && shaderNames[VK_SHADER_STAGE_COMPUTE_BIT] != "");
 
+	VkShaderModule shader = Scope.GetShaderRegistry().GetModule(shaderNames[VK_SHADER_STAGE_COMPUTE_BIT]);
+	if (shader == VK_NULL_HANDLE)
+		return nullptr;
+
 	TAuto<Pipeline> out = std::make_unique<Pipeline>(Scope);
 	out->bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE;
 	out->type = EPipelineType::Compute;
@@ -82,60 +161,24 @@ TAuto<Pipeline> ComputePipelineDescriptor::Construct(const RenderScope& Scope)
 	pipelineLayoutCI.pPushConstantRanges = pushConstants.data();
 	vkCreatePipelineLayout(Scope.GetDevice(), &pipelineLayoutCI, VK_NULL_HANDLE, &out->pipelineLayout);
 
-	VkShaderModule shader = VK_NULL_HANDLE;
-
-	std::ifstream shaderFile(exec_path + "shaders\\" + shaderNames[VK_SHADER_STAGE_COMPUTE_BIT] + ".spv", std::ios::ate | std::ios::binary);
-	std::size_t fileSize = (std::size_t)shaderFile.tellg();
-	shaderFile.seekg(0);
-	TVector<char> shaderCode(fileSize);
-	shaderFile.read(shaderCode.data(), fileSize);
-	shaderFile.close();
-
-	VkShaderModuleCreateInfo shaderModuleCI{};
-	shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	shaderModuleCI.codeSize = shaderCode.size();
-	shaderModuleCI.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
-	vkCreateShaderModule(Scope.GetDevice(), &shaderModuleCI, VK_NULL_HANDLE, &shader);
-
-	TVector<unsigned char> specialization_data;
-	size_t specialization_entry = 0ull, specialization_offset = 0ull;
-	TVector<VkSpecializationMapEntry> specialization_entries(specializationConstants[VK_SHADER_STAGE_COMPUTE_BIT].size());
-	for (auto [id, val] : specializationConstants[VK_SHADER_STAGE_COMPUTE_BIT]) {
-		TVector<unsigned char> specialization_bytes(std::move(AnyTypeToBytes(val)));
-
-		specialization_data.resize(specialization_data.size() + specialization_bytes.size());
-		specialization_entries[specialization_entry].constantID = id;
-		specialization_entries[specialization_entry].offset = specialization_offset;
-		specialization_entries[specialization_entry].size = specialization_bytes.size();
-		memcpy(&specialization_data[specialization_offset], specialization_bytes.data(), specialization_bytes.size());
+	std::shared_ptr<ComputeBuild> build = std::make_shared<ComputeBuild>();
+	fill_specialization(specializationConstants[VK_SHADER_STAGE_COMPUTE_BIT], build->specialization);
 
-		specialization_entry++;
-		specialization_offset += specialization_bytes.size();
-	}
-
-	VkSpecializationInfo specializationInfo;
-	specializationInfo.mapEntryCount = specialization_entries.size();
-	specializationInfo.pMapEntries = specialization_entries.data();
-	specializationInfo.dataSize = specialization_data.size();
-	specializationInfo.pData = specialization_data.data();
-
-	VkPipelineShaderStageCreateInfo pipelineStageCI = {
+	build->pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	build->pipelineCI.layout = out->pipelineLayout;
+	build->pipelineCI.stage = {
 		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
 		VK_NULL_HANDLE,
 		0,
 		VK_SHADER_STAGE_COMPUTE_BIT,
 		shader,
 		"main",
-		&specializationInfo
+		&build->specialization.info
 	};
 
-	VkComputePipelineCreateInfo pipelineCI{};
-	pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-	pipelineCI.layout = out->pipelineLayout;
-	pipelineCI.stage = pipelineStageCI;
-	vkCreateComputePipelines(Scope.GetDevice(), VK_NULL_HANDLE, 1, &pipelineCI, VK_NULL_HANDLE, &out->pipeline);
-
-	vkDestroyShaderModule(Scope.GetDevice(), shader, VK_NULL_HANDLE);
+	out->pending = Scope.GetWorkerPool().Submit([device = Scope.GetDevice(), build, target = out.get()]() {
+		target->result = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &build->pipelineCI, VK_NULL_HANDLE, &target->pipeline);
+	});
 
 	return out;
 }
@@ -263,6 +306,23 @@ TAuto<Pipeline> GraphicsPipelineDescriptor::Construct(const RenderScope& Scope)
 {
 	//assert(pipeline == VK_NULL_HANDLE && pipelineLayout == VK_NULL_HANDLE && shaderNames.size() > 0);
 
+	std::shared_ptr<GraphicsBuild> build = std::make_shared<GraphicsBuild>();
+	const TArray<const VkShaderStageFlagBits, 5> stages = { VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, VK_SHADER_STAGE_GEOMETRY_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+
+	for (size_t i = 0; i < stages.size(); i++)
+	{
+		if (shaderNames.count(stages[i]) > 0)
+		{
+			VkShaderModule shaderModule = Scope.GetShaderRegistry().GetModule(shaderNames[stages[i]]);
+			if (shaderModule == VK_NULL_HANDLE)
+				return nullptr;
+
+			fill_specialization(specializationConstants[stages[i]], build->specializations[i]);
+
+			build->stages.emplace_back(VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, VK_NULL_HANDLE, 0, stages[i], shaderModule, "main", &build->specializations[i].info);
+		}
+	}
+
 	TAuto<Pipeline> out = std::make_unique<Pipeline>(Scope);
 	out->bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 	out->type = EPipelineType::Graphics;
@@ -275,77 +335,45 @@ TAuto<Pipeline> GraphicsPipelineDescriptor::Construct(const RenderScope& Scope)
 	pipelineLayoutCI.pPushConstantRanges = pushConstants.data();
 	vkCreatePipelineLayout(Scope.GetDevice(), &pipelineLayoutCI, VK_NULL_HANDLE, &out->pipelineLayout);
 
-	TVector<VkShaderModule> shaders;
-	TVector<VkPipelineShaderStageCreateInfo> pipelineStagesCI{};
-	const TArray<const VkShaderStageFlagBits, 5> stages = { VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, VK_SHADER_STAGE_GEOMETRY_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+	build->bindings.assign(vertexInput.pVertexBindingDescriptions, vertexInput.pVertexBindingDescriptions + vertexInput.vertexBindingDescriptionCount);
+	build->attributes.assign(vertexInput.pVertexAttributeDescriptions, vertexInput.pVertexAttributeDescriptions + vertexInput.vertexAttributeDescriptionCount);
+	build->vertexInput = vertexInput;
+	build->vertexInput.pVertexBindingDescriptions = build->bindings.data();
+	build->vertexInput.pVertexAttributeDescriptions = build->attributes.data();
 
-	for (size_t i = 0; i < stages.size(); i++)
-	{
-		if (shaderNames.count(stages[i]) > 0)
-		{
-			std::ifstream shaderFile(exec_path + "shaders\\" + shaderNames[stages[i]] + ".spv", std::ios::ate | std::ios::binary);
-			std::size_t fileSize = (std::size_t)shaderFile.tellg();
-			shaderFile.seekg(0);
-			TVector<char> shaderCode(fileSize);
-			shaderFile.read(shaderCode.data(), fileSize);
-			shaderFile.close();
-
-			VkShaderModuleCreateInfo shaderModuleCI{};
-			shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-			shaderModuleCI.codeSize = shaderCode.size();
-			shaderModuleCI.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
-
-			VkShaderModule shaderModule;
-			vkCreateShaderModule(Scope.GetDevice(), &shaderModuleCI, VK_NULL_HANDLE, &shaderModule);
-
-			shaders.push_back(shaderModule);
-
-			TVector<unsigned char> specialization_data;
-			size_t specialization_entry = 0ull, specialization_offset = 0ull;
-			TVector<VkSpecializationMapEntry> specialization_entries(specializationConstants[stages[i]].size());
-			for (auto [id, val] : specializationConstants[stages[i]]) {
-				TVector<unsigned char> specialization_bytes(std::move(AnyTypeToBytes(val)));
-
-				specialization_data.resize(specialization_data.size() + specialization_bytes.size());
-				specialization_entries[specialization_entry].constantID = id;
-				specialization_entries[specialization_entry].offset = specialization_offset;
-				specialization_entries[specialization_entry].size = specialization_bytes.size();
-				memcpy(&specialization_data[specialization_offset], specialization_bytes.data(), specialization_bytes.size());
-
-				specialization_entry++;
-				specialization_offset += specialization_bytes.size();
-			}
-
-			VkSpecializationInfo specializationInfo;
-			specializationInfo.mapEntryCount = specialization_entries.size();
-			specializationInfo.pMapEntries = specialization_entries.data();
-			specializationInfo.dataSize = specialization_data.size();
-			specializationInfo.pData = specialization_data.data();
-
-			pipelineStagesCI.emplace_back(VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, VK_NULL_HANDLE, 0, stages[i], shaderModule, "main", &specializationInfo);
-		}
-	}
+	build->blendAttachments = blendAttachments;
+	build->blendState = blendState;
+	build->blendState.pAttachments = build->blendAttachments.data();
 
-	VkGraphicsPipelineCreateInfo pipelineCI{};
+	build->dynamics.assign(dynamics.begin(), dynamics.end());
+	build->dynamicState = dynamicState;
+	build->dynamicState.pDynamicStates = build->dynamics.data();
+
+	build->inputAssembly = inputAssembly;
+	build->rasterizationState = rasterizationState;
+	build->depthStencilState = depthStencilState;
+	build->viewportState = viewportState;
+	build->multisampleState = multisampleState;
+
+	VkGraphicsPipelineCreateInfo& pipelineCI = build->pipelineCI;
 	pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	pipelineCI.subpass = subpass;
 	pipelineCI.renderPass = Scope.GetRenderPass();
-	pipelineCI.pInputAssemblyState = &inputAssembly;
-	pipelineCI.pVertexInputState = &vertexInput;
-	pipelineCI.pRasterizationState = &rasterizationState;
-	pipelineCI.pDepthStencilState = &depthStencilState;
-	pipelineCI.pColorBlendState = &blendState;
-	pipelineCI.pViewportState = &viewportState;
-	pipelineCI.pDynamicState = &dynamicState;
-	pipelineCI.pMultisampleState = &multisampleState;
-	pipelineCI.stageCount = pipelineStagesCI.size();
-	pipelineCI.pStages = pipelineStagesCI.data();
+	pipelineCI.pInputAssemblyState = &build->inputAssembly;
+	pipelineCI.pVertexInputState = &build->vertexInput;
+	pipelineCI.pRasterizationState = &build->rasterizationState;
+	pipelineCI.pDepthStencilState = &build->depthStencilState;
+	pipelineCI.pColorBlendState = &build->blendState;
+	pipelineCI.pViewportState = &build->viewportState;
+	pipelineCI.pDynamicState = &build->dynamicState;
+	pipelineCI.pMultisampleState = &build->multisampleState;
+	pipelineCI.stageCount = build->stages.size();
+	pipelineCI.pStages = build->stages.data();
 	pipelineCI.layout = out->pipelineLayout;
-	vkCreateGraphicsPipelines(Scope.GetDevice(), VK_NULL_HANDLE, 1, &pipelineCI, VK_NULL_HANDLE, &out->pipeline);
 
-	for (auto& shader : shaders) {
-		vkDestroyShaderModule(Scope.GetDevice(), shader, VK_NULL_HANDLE);
-	}
+	out->pending = Scope.GetWorkerPool().Submit([device = Scope.GetDevice(), build, target = out.get()]() {
+		target->result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &build->pipelineCI, VK_NULL_HANDLE, &target->pipeline);
+	});
 
 	return out;
 }
\ No newline at end of file
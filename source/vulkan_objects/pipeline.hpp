@@ -29,10 +29,21 @@ public:
 	EPipelineType GetPipelineType() const { return EPipelineType::None; };
 
 	const VkPipelineLayout& GetLayout() const { return pipelineLayout; };
+	/*
+	* !@brief Block until the pipeline is compiled by the worker pool, binding waits on its own
+	*/
+	const Pipeline& Wait() const;
+	/*
+	* !@brief Result of vkCreate*Pipelines, waits for the compilation
+	*/
+	VkResult GetResult() const;
 
 private:
 	VkPipeline pipeline = VK_NULL_HANDLE;
 	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	// Compilation job, the layout is available right away. The job stores its result next to the pipeline
+	std::shared_future<void> pending = {};
+	VkResult result = VK_NOT_READY;
 
 	const RenderScope& scope;
 
@@ -40,6 +51,14 @@ private:
 	EPipelineType type = EPipelineType::None;
 };
 
+/*
+* !@brief Pipeline was constructed and compiled successfully, waits for the compilation
+*/
+inline VkBool32 IsPipelineValid(const TAuto<Pipeline>& pipeline)
+{
+	return pipeline && pipeline->GetResult() == VK_SUCCESS;
+}
+
 class PipelineDescriptor
 {
 public:
@@ -1,52 +1,219 @@
 #include "queue.hpp"
 #include "vulkan_api.hpp"
 
-Queue::Queue(const VkDevice& inDevice, uint32_t inFamily)
-	: device(inDevice), family(inFamily)
+/*
+* !@brief Runs the release of every queue the thread recorded for when the thread exits
+*/
+struct ThreadExit
 {
-	vkGetDeviceQueue(device, family, 0, &queue);
+	~ThreadExit()
+	{
+		for (const std::function<void()>& release : releases)
+			release();
+	}
+
+	TVector<std::function<void()>> releases = {};
+};
+
+static thread_local ThreadExit threadExit;
 
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	//fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-	vkCreateFence(device, &fenceInfo, VK_NULL_HANDLE, &fence);
+Queue::Queue(const VkDevice& inDevice, uint32_t inFamily, std::mutex& inSubmitLock)
+	: device(inDevice), family(inFamily), submitLock(inSubmitLock)
+{
+	vkGetDeviceQueue(device, family, 0, &queue);
 
-	VkCommandPoolCreateInfo poolInfo{};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.queueFamilyIndex = family;
-	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	vkCreateCommandPool(device, &poolInfo, VK_NULL_HANDLE, &pool);
+	::CreateTimelineSemaphore(device, &timeline);
 }
 
 Queue::~Queue()
 {
-	vkDestroyFence(device, fence, VK_NULL_HANDLE);
-	vkDestroyCommandPool(device, pool, VK_NULL_HANDLE);
+	Wait();
+	vkDestroySemaphore(device, timeline, VK_NULL_HANDLE);
+
+	std::lock_guard<std::mutex> guard(pools->lock);
+	for (auto& [thread, pool] : pools->active)
+		vkDestroyCommandPool(device, pool.pool, VK_NULL_HANDLE);
+	for (CommandPool& pool : pools->orphaned)
+		vkDestroyCommandPool(device, pool.pool, VK_NULL_HANDLE);
+
+	pools->active.clear();
+	pools->orphaned.clear();
 }
 
 const Queue& Queue::Wait() const
 {
-	vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
-	return *this;
+	Ticket ticket = 0;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		ticket = lastTicket;
+	}
+
+	return Wait(ticket);
 }
 
-const Queue& Queue::Submit(const VkCommandBuffer& cmd) const
+const Queue& Queue::Wait(Ticket ticket) const
 {
-	vkResetFences(device, 1, &fence);
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &cmd;
-	vkQueueSubmit(queue, 1, &submitInfo, fence);
+	::WaitTimelineSemaphore(device, timeline, ticket);
 	return *this;
 }
 
+VkBool32 Queue::IsComplete(Ticket ticket) const
+{
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(device, timeline, &value);
+	return value >= ticket;
+}
+
+Queue::Ticket Queue::Submit(const VkCommandBuffer& cmd) const
+{
+	Batch batch{};
+	batch.commandBuffers.push_back(cmd);
+	return Submit({ batch });
+}
+
+Queue::Ticket Queue::Submit(const TVector<Batch>& batches) const
+{
+	CommandPool& pool = thread_pool();
+	std::lock_guard<std::mutex> guard(lock);
+	const Ticket ticket = lastTicket + 1;
+
+	TVector<TVector<VkCommandBufferSubmitInfo>> commandBuffers(batches.size());
+	TVector<VkSemaphoreSubmitInfo> signals = {};
+	TVector<VkSubmitInfo2> submits(batches.size());
+	for (uint32_t i = 0; i < batches.size(); i++)
+	{
+		for (const VkCommandBuffer& cmd : batches[i].commandBuffers)
+		{
+			VkCommandBufferSubmitInfo cmdInfo{};
+			cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+			cmdInfo.commandBuffer = cmd;
+			commandBuffers[i].push_back(cmdInfo);
+			pool.inFlight.emplace_back(ticket, cmd);
+		}
+
+		submits[i].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+		submits[i].waitSemaphoreInfoCount = static_cast<uint32_t>(batches[i].waits.size());
+		submits[i].pWaitSemaphoreInfos = batches[i].waits.data();
+		submits[i].commandBufferInfoCount = static_cast<uint32_t>(commandBuffers[i].size());
+		submits[i].pCommandBufferInfos = commandBuffers[i].data();
+		submits[i].signalSemaphoreInfoCount = static_cast<uint32_t>(batches[i].signals.size());
+		submits[i].pSignalSemaphoreInfos = batches[i].signals.data();
+	}
+
+	// Batches complete in submission order, the last one moves the timeline
+	if (!submits.empty())
+	{
+		VkSemaphoreSubmitInfo timelineSignal{};
+		timelineSignal.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+		timelineSignal.semaphore = timeline;
+		timelineSignal.value = ticket;
+		timelineSignal.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+		signals = batches.back().signals;
+		signals.push_back(timelineSignal);
+		submits.back().signalSemaphoreInfoCount = static_cast<uint32_t>(signals.size());
+		submits.back().pSignalSemaphoreInfos = signals.data();
+	}
+
+	std::lock_guard<std::mutex> queueGuard(submitLock);
+	VkResult res = vkQueueSubmit2(queue, static_cast<uint32_t>(submits.size()), submits.data(), VK_NULL_HANDLE);
+	assert(res != VK_ERROR_DEVICE_LOST);
+
+	lastTicket = ticket;
+	return ticket;
+}
+
+Queue::CommandPool& Queue::thread_pool() const
+{
+	std::lock_guard<std::mutex> guard(pools->lock);
+
+	// References to map values survive rehashing, the owning thread keeps using it unlocked
+	CommandPool& pool = pools->active[std::this_thread::get_id()];
+	if (pool.pool == VK_NULL_HANDLE)
+	{
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = family;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		vkCreateCommandPool(device, &poolInfo, VK_NULL_HANDLE, &pool.pool);
+
+		// Buffers still in flight when the thread exits are freed with the pool by another thread
+		threadExit.releases.push_back([owner = TWeak<ThreadPools>(pools), thread = std::this_thread::get_id()]() {
+			const TShared<ThreadPools> shared = owner.lock();
+			if (!shared)
+				return;
+
+			std::lock_guard<std::mutex> guard(shared->lock);
+			auto it = shared->active.find(thread);
+			if (it != shared->active.end())
+			{
+				shared->orphaned.push_back(std::move(it->second));
+				shared->active.erase(it);
+			}
+		});
+	}
+
+	return pool;
+}
+
+void Queue::release_orphans() const
+{
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(device, timeline, &value);
+
+	std::lock_guard<std::mutex> guard(pools->lock);
+	std::erase_if(pools->orphaned, [&, this](const CommandPool& pool) {
+		const bool done = std::all_of(pool.inFlight.begin(), pool.inFlight.end(), [value](const std::pair<Ticket, VkCommandBuffer>& it) { return it.first <= value; });
+		if (done)
+			vkDestroyCommandPool(device, pool.pool, VK_NULL_HANDLE);
+
+		return done;
+	});
+}
+
+void Queue::recycle(CommandPool& pool) const
+{
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(device, timeline, &value);
+
+	std::erase_if(pool.inFlight, [&, this](const std::pair<Ticket, VkCommandBuffer>& it) {
+		if (it.first > value)
+			return false;
+
+		vkResetCommandBuffer(it.second, 0);
+		pool.recycled.push_back(it.second);
+		return true;
+	});
+}
+
 void Queue::AllocateCommandBuffers(uint32_t count, VkCommandBuffer* outBuffers) const
 {
-	::AllocateCommandBuffers(device, pool, count, outBuffers);
+	CommandPool& pool = thread_pool();
+	recycle(pool);
+	release_orphans();
+
+	const uint32_t reused = glm::min(count, static_cast<uint32_t>(pool.recycled.size()));
+	for (uint32_t i = 0; i < reused; i++)
+	{
+		outBuffers[i] = pool.recycled.back();
+		pool.recycled.pop_back();
+	}
+
+	if (reused < count)
+		::AllocateCommandBuffers(device, pool.pool, count - reused, outBuffers + reused);
 }
 
 void Queue::FreeCommandBuffers(uint32_t count, VkCommandBuffer* buffers) const
 {
-	vkFreeCommandBuffers(device, pool, count, buffers);
+	vkFreeCommandBuffers(device, thread_pool().pool, count, buffers);
+}
+
+VkSemaphoreSubmitInfo Queue::WaitInfo(Ticket ticket, VkPipelineStageFlags2 stages) const
+{
+	VkSemaphoreSubmitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	waitInfo.semaphore = timeline;
+	waitInfo.value = ticket;
+	waitInfo.stageMask = stages;
+	return waitInfo;
 }
\ No newline at end of file
@@ -1,32 +1,116 @@
 #pragma once
 #include <glfw/glfw3.h>
 #include <vma/vk_mem_alloc.h>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <functional>
+#include "math.hpp"
 
+/*
+* !@brief Device queue with a timeline semaphore counting its submissions. Submissions return
+* tickets to poll or wait on, command buffers submitted with them are reused once they complete.
+* Every thread records into command buffers of its own pool, so threads may record and submit
+* concurrently. Command buffers have to be submitted from the thread that allocated them.
+* Pools of exited threads are destroyed once their submissions complete.
+* Queues of one family share the device queue, they are created with the same submission lock
+*/
 class Queue
 {
 public:
+	/*
+	* !@brief Timeline value the queue reaches once the submission completes
+	*/
+	using Ticket = uint64_t;
+
+	/*
+	* !@brief Command buffers submitted together, waits and signals apply to the whole batch
+	*/
+	struct Batch
+	{
+		TVector<VkCommandBuffer> commandBuffers = {};
+		TVector<VkSemaphoreSubmitInfo> waits = {};
+		TVector<VkSemaphoreSubmitInfo> signals = {};
+	};
+
 	Queue() = delete;
 
-	Queue(const VkDevice& device, uint32_t family);
+	Queue(const VkDevice& device, uint32_t family, std::mutex& submitLock);
 
 	~Queue();
-
+	/*
+	* !@brief Block until every submission made through Submit so far completes
+	*/
 	const Queue& Wait() const;
 
-	const Queue& Submit(const VkCommandBuffer& cmd) const;
+	const Queue& Wait(Ticket ticket) const;
 
+	VkBool32 IsComplete(Ticket ticket) const;
+	/*
+	* !@brief Submit ended command buffer, the queue takes it over and recycles it once the ticket completes
+	*/
+	Ticket Submit(const VkCommandBuffer& cmd) const;
+	/*
+	* !@brief Submit batches with a single vkQueueSubmit2 call, the ticket completes with the last one
+	*/
+	Ticket Submit(const TVector<Batch>& batches) const;
+	/*
+	* !@brief Allocate primary command buffers, buffers of completed tickets are reset and handed out first
+	*/
 	void AllocateCommandBuffers(uint32_t count, VkCommandBuffer* outBuffers) const;
-
+	/*
+	* !@brief Free command buffers that were never submitted through Submit
+	*/
 	void FreeCommandBuffers(uint32_t count, VkCommandBuffer* buffers) const;
+	/*
+	* !@brief Wait info for another queue to wait on the ticket
+	*/
+	VkSemaphoreSubmitInfo WaitInfo(Ticket ticket, VkPipelineStageFlags2 stages) const;
 
 	const VkQueue& GetQueue() const { return queue; };
 
 	const uint32_t& GetFamilyIndex() const { return family; };
+	/*
+	* !@brief Lock to hold when accessing the device queue outside of Submit, e.g. to present
+	*/
+	std::mutex& GetSubmitLock() const { return submitLock; };
 
 private:
+	struct CommandPool
+	{
+		VkCommandPool pool = VK_NULL_HANDLE;
+		TVector<std::pair<Ticket, VkCommandBuffer>> inFlight = {};
+		TVector<VkCommandBuffer> recycled = {};
+	};
+	/*
+	* !@brief Pools of the threads using the queue, shared with those threads so they can hand
+	* their pool back when they exit, even when the queue is gone by then
+	*/
+	struct ThreadPools
+	{
+		std::mutex lock;
+		std::unordered_map<std::thread::id, CommandPool> active = {};
+		TVector<CommandPool> orphaned = {};
+	};
+	/*
+	* !@brief Pool of the calling thread, created on first use. Only the owning thread touches its contents
+	*/
+	CommandPool& thread_pool() const;
+
+	void recycle(CommandPool& pool) const;
+	/*
+	* !@brief Destroy pools of exited threads whose command buffers completed
+	*/
+	void release_orphans() const;
+
 	uint32_t family = 0;
 	VkQueue queue = VK_NULL_HANDLE;
-	VkFence fence = VK_NULL_HANDLE;
-	VkCommandPool pool = VK_NULL_HANDLE;
+	VkSemaphore timeline = VK_NULL_HANDLE;
+	// Guards the ticket counter
+	mutable std::mutex lock;
+	// Guards the device queue, shared by every Queue of the family
+	std::mutex& submitLock;
+	TShared<ThreadPools> pools = std::make_shared<ThreadPools>();
+	mutable Ticket lastTicket = 0;
 	const VkDevice device = VK_NULL_HANDLE;
 };
\ No newline at end of file
@@ -0,0 +1,408 @@
+#include "pch.hpp"
+#include "render_graph.hpp"
+#include <algorithm>
+
+RenderGraph::Pass& RenderGraph::Pass::Read(Handle resource, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+	reads.push_back({ resource, stages, access });
+	return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::Write(Handle resource, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+	writes.push_back({ resource, stages, access });
+	return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::KeepAlive()
+{
+	keepAlive = true;
+	return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::Async()
+{
+	async = true;
+	return *this;
+}
+
+RenderGraph::RenderGraph(const RenderScope& InScope)
+	: Scope(&InScope)
+{
+
+}
+
+RenderGraph::~RenderGraph()
+{
+	for (Resource& resource : resources)
+		resource.image.reset();
+
+	for (VmaAllocation& block : memoryBlocks)
+		vmaFreeMemory(Scope->GetAllocator(), block);
+}
+
+RenderGraph::Handle RenderGraph::ImportResource(const std::string& name)
+{
+	Resource resource{};
+	resource.name = name;
+	resource.slot = slotCount++;
+	resources.push_back(std::move(resource));
+
+	return static_cast<Handle>(resources.size() - 1);
+}
+
+RenderGraph::Handle RenderGraph::CreateImage(const std::string& name, const VkImageCreateInfo& imgInfo, const VkImageViewCreateInfo& viewInfo, ESamplerType sampler)
+{
+	Resource resource{};
+	resource.name = name;
+	resource.transient = true;
+	resource.imgInfo = imgInfo;
+	resource.viewInfo = viewInfo;
+	resource.sampler = sampler;
+	resources.push_back(std::move(resource));
+
+	return static_cast<Handle>(resources.size() - 1);
+}
+
+RenderGraph::Pass& RenderGraph::AddPass(const std::string& name, const std::function<void(VkCommandBuffer)>& record)
+{
+	Pass pass{};
+	pass.name = name;
+	pass.record = record;
+	passes.push_back(std::move(pass));
+
+	return passes.back();
+}
+
+VkBool32 RenderGraph::Compile()
+{
+	// Walk back from the resources that outlive the frame, passes that feed none of them are dropped
+	TVector<bool> needed(resources.size(), false);
+	for (uint32_t i = 0; i < resources.size(); i++)
+		needed[i] = !resources[i].transient;
+
+	TVector<bool> alive(passes.size(), false);
+	for (uint32_t p = static_cast<uint32_t>(passes.size()); p-- > 0;)
+	{
+		const Pass& pass = passes[p];
+		alive[p] = pass.keepAlive || std::any_of(pass.writes.begin(), pass.writes.end(), [&](const Access& write) { return needed[write.resource]; });
+
+		if (!alive[p])
+			continue;
+
+		for (const Access& read : pass.reads)
+			needed[read.resource] = true;
+	}
+
+	order.clear();
+	for (uint32_t p = 0; p < passes.size(); p++)
+	{
+		if (alive[p])
+			order.push_back(p);
+	}
+
+	// Lifetime of every transient in recorded passes, unused ones get an empty range
+	TVector<uint32_t> first(resources.size(), UINT32_MAX);
+	TVector<uint32_t> last(resources.size(), 0u);
+	for (uint32_t i = 0; i < order.size(); i++)
+	{
+		const Pass& pass = passes[order[i]];
+		for (const TVector<Access>* accesses : { &pass.reads, &pass.writes })
+		{
+			for (const Access& access : *accesses)
+			{
+				first[access.resource] = glm::min(first[access.resource], i);
+				last[access.resource] = glm::max(last[access.resource], i);
+			}
+		}
+	}
+
+	// Transients touched by both queues are shared between their families
+	for (Handle i = 0; i < resources.size(); i++)
+	{
+		bool graphics = false;
+		bool async = false;
+		for (uint32_t p : order)
+		{
+			const Pass& pass = passes[p];
+			const auto uses = [&](const Access& access) { return access.resource == i; };
+			if (std::any_of(pass.reads.begin(), pass.reads.end(), uses) || std::any_of(pass.writes.begin(), pass.writes.end(), uses))
+				(pass.async ? async : graphics) = true;
+		}
+
+		if (resources[i].transient && graphics && async)
+			Scope->ShareBetweenQueues(resources[i].imgInfo);
+
+		// Pass order says nothing about when async work runs against graphics work of the frame,
+		// transients used by async passes are kept alive for the whole frame and alias nothing
+		if (resources[i].transient && async)
+		{
+			first[i] = 0u;
+			last[i] = static_cast<uint32_t>(order.size()) - 1u;
+		}
+	}
+
+	place_transients(first, last);
+	compute_barriers();
+
+	return std::all_of(resources.begin(), resources.end(), [](const Resource& resource) { return !resource.transient || resource.image; });
+}
+
+void RenderGraph::place_transients(const TVector<uint32_t>& first, const TVector<uint32_t>& last)
+{
+	for (Resource& resource : resources)
+		resource.image.reset();
+
+	for (VmaAllocation& block : memoryBlocks)
+		vmaFreeMemory(Scope->GetAllocator(), block);
+	memoryBlocks.clear();
+	transientMemorySize = 0;
+
+	TVector<Handle> transients = {};
+	TVector<VkMemoryRequirements> requirements(resources.size());
+	for (Handle i = 0; i < resources.size(); i++)
+	{
+		if (!resources[i].transient)
+			continue;
+
+		VkDeviceImageMemoryRequirements requirementsInfo{};
+		requirementsInfo.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+		requirementsInfo.pCreateInfo = &resources[i].imgInfo;
+		VkMemoryRequirements2 imageRequirements{};
+		imageRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+		vkGetDeviceImageMemoryRequirements(Scope->GetDevice(), &requirementsInfo, &imageRequirements);
+
+		requirements[i] = imageRequirements.memoryRequirements;
+		transients.push_back(i);
+	}
+
+	// Largest images claim blocks first, smaller ones fill in blocks whose users are done by then
+	std::sort(transients.begin(), transients.end(), [&](Handle a, Handle b) { return requirements[a].size > requirements[b].size; });
+
+	const auto overlaps = [&](Handle a, Handle b) {
+		return first[a] <= last[a] && first[b] <= last[b] && first[a] <= last[b] && first[b] <= last[a];
+	};
+
+	TVector<VkMemoryRequirements> blocks = {};
+	TVector<TVector<Handle>> blockUsers = {};
+	for (Handle transient : transients)
+	{
+		const VkMemoryRequirements& request = requirements[transient];
+
+		uint32_t block = 0;
+		for (; block < blocks.size(); block++)
+		{
+			if ((blocks[block].memoryTypeBits & request.memoryTypeBits) == 0)
+				continue;
+
+			if (std::none_of(blockUsers[block].begin(), blockUsers[block].end(), [&](Handle user) { return overlaps(user, transient); }))
+				break;
+		}
+
+		if (block == blocks.size())
+		{
+			blocks.push_back(request);
+			blockUsers.push_back({});
+		}
+
+		blocks[block].size = glm::max(blocks[block].size, request.size);
+		blocks[block].alignment = glm::max(blocks[block].alignment, request.alignment);
+		blocks[block].memoryTypeBits &= request.memoryTypeBits;
+		blockUsers[block].push_back(transient);
+		resources[transient].slot = slotCount + block;
+	}
+
+	VmaAllocationCreateInfo allocCreateInfo{};
+	allocCreateInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+	memoryBlocks.resize(blocks.size(), VK_NULL_HANDLE);
+	for (uint32_t block = 0; block < blocks.size(); block++)
+	{
+		VkResult res = Scope->AllocateWithinBudget(allocCreateInfo, blocks[block].size, [&, this](const VmaAllocationCreateInfo& Info) {
+			return vmaAllocateMemory(Scope->GetAllocator(), &blocks[block], &Info, &memoryBlocks[block], VK_NULL_HANDLE);
+		});
+
+		if (res != VK_SUCCESS)
+			continue;
+
+		transientMemorySize += blocks[block].size;
+		for (Handle user : blockUsers[block])
+		{
+			Resource& resource = resources[user];
+			resource.image = std::make_unique<VulkanImage>(*Scope);
+			resource.image->CreateImage(resource.imgInfo, memoryBlocks[block])
+				.CreateImageView(resource.viewInfo)
+				.CreateSampler(resource.sampler)
+				.TransitionLayout(VK_IMAGE_LAYOUT_GENERAL);
+
+			if (resource.imgInfo.mipLevels > 1)
+				resource.image->CreateMipViews();
+		}
+	}
+}
+
+void RenderGraph::compute_barriers()
+{
+	struct SlotState
+	{
+		VkPipelineStageFlags writeStages = 0;
+		VkAccessFlags writeAccess = 0;
+		uint32_t writeQueue = 0;
+		uint32_t writeSweep = 0;
+		// Stages of each queue that read since the last write, they already waited for it
+		TArray<VkPipelineStageFlags, 2> readStages = { 0, 0 };
+		TArray<uint32_t, 2> readSweeps = { 0, 0 };
+		Handle owner = UINT32_MAX;
+	};
+
+	const uint32_t blockCount = static_cast<uint32_t>(memoryBlocks.size());
+	TVector<SlotState> state(slotCount + blockCount);
+	asyncWaitStages = 0;
+	graphicsWaitStages = 0;
+
+	// Frames repeat the same passes, the second sweep starts from the state the previous frame left behind
+	for (uint32_t sweep = 0; sweep < 2; sweep++)
+	{
+		barriers.assign(order.size(), {});
+		for (uint32_t i = 0; i < order.size(); i++)
+		{
+			const Pass& pass = passes[order[i]];
+			const uint32_t queue = pass.async ? 1u : 0u;
+			const TVector<SlotState> before = state;
+			Barrier& barrier = barriers[i];
+			barrier.memory.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+
+			// Hazards within a queue are barriers, across queues the submissions wait on each other
+			const auto depend = [&](uint32_t srcQueue, uint32_t srcSweep, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+				if (srcStages == 0)
+					return;
+
+				if (srcQueue == queue)
+				{
+					barrier.srcStages |= srcStages;
+					barrier.memory.srcAccessMask |= srcAccess;
+					barrier.dstStages |= dstStages;
+					barrier.memory.dstAccessMask |= srcAccess != 0 ? dstAccess : 0;
+				}
+				else if (pass.async)
+				{
+					assert(srcSweep < sweep && "Async pass depends on graphics work of the same frame");
+					graphicsWaitStages |= dstStages;
+				}
+				else
+				{
+					asyncWaitStages |= dstStages;
+				}
+			};
+
+			const auto discard = [&](const Access& access) {
+				const Resource& resource = resources[access.resource];
+				const SlotState& previous = before[resource.slot];
+				if (!resource.transient || previous.owner == access.resource)
+					return false;
+
+				if (std::find(barrier.discards.begin(), barrier.discards.end(), access.resource) == barrier.discards.end())
+					barrier.discards.push_back(access.resource);
+
+				depend(previous.writeQueue, previous.writeSweep, previous.writeStages, previous.writeAccess, access.stages, access.access);
+				for (uint32_t reader = 0; reader < 2; reader++)
+					depend(reader, previous.readSweeps[reader], previous.readStages[reader], 0, access.stages, 0);
+
+				// Layout transition of the discarded image happens in this pass either way
+				barrier.dstStages |= access.stages;
+				barrier.memory.dstAccessMask |= access.access;
+
+				SlotState owned{};
+				owned.owner = access.resource;
+				state[resource.slot] = owned;
+				return true;
+			};
+
+			for (const Access& read : pass.reads)
+			{
+				const SlotState& previous = before[resources[read.resource].slot];
+				SlotState& current = state[resources[read.resource].slot];
+
+				if (!discard(read) && (read.stages & ~previous.readStages[queue]) != 0)
+					depend(previous.writeQueue, previous.writeSweep, previous.writeStages, previous.writeAccess, read.stages, read.access);
+
+				current.readStages[queue] |= read.stages;
+				current.readSweeps[queue] = sweep;
+			}
+
+			TVector<uint32_t> written = {};
+			for (const Access& write : pass.writes)
+			{
+				const uint32_t slot = resources[write.resource].slot;
+				const SlotState& previous = before[slot];
+				SlotState& current = state[slot];
+
+				// Readers only need to finish, earlier writes also have to become visible
+				if (!discard(write))
+				{
+					for (uint32_t reader = 0; reader < 2; reader++)
+						depend(reader, previous.readSweeps[reader], previous.readStages[reader], 0, write.stages, 0);
+
+					depend(previous.writeQueue, previous.writeSweep, previous.writeStages, previous.writeAccess, write.stages, write.access);
+				}
+
+				if (std::find(written.begin(), written.end(), slot) == written.end())
+				{
+					written.push_back(slot);
+					current.writeStages = 0;
+					current.writeAccess = 0;
+				}
+
+				current.writeStages |= write.stages;
+				current.writeAccess |= write.access;
+				current.writeQueue = queue;
+				current.writeSweep = sweep;
+				current.readStages = { 0, 0 };
+			}
+		}
+	}
+}
+
+void RenderGraph::Execute(VkCommandBuffer cmd, VkCommandBuffer asyncCmd) const
+{
+	TVector<VkImageMemoryBarrier> imageBarriers = {};
+	for (uint32_t i = 0; i < order.size(); i++)
+	{
+		const Barrier& barrier = barriers[i];
+		const Pass& pass = passes[order[i]];
+		const VkCommandBuffer target = pass.async ? asyncCmd : cmd;
+
+		if (barrier.dstStages != 0)
+		{
+			imageBarriers.clear();
+			for (Handle discard : barrier.discards)
+			{
+				const Resource& resource = resources[discard];
+
+				VkImageMemoryBarrier imageBarrier{};
+				imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+				imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				imageBarrier.image = resource.image->GetImage();
+				imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, resource.imgInfo.mipLevels, 0, resource.imgInfo.arrayLayers };
+				imageBarrier.srcAccessMask = barrier.memory.srcAccessMask;
+				imageBarrier.dstAccessMask = barrier.memory.dstAccessMask;
+				imageBarriers.push_back(imageBarrier);
+			}
+
+			const uint32_t memoryBarrierCount = (barrier.memory.srcAccessMask | barrier.memory.dstAccessMask) != 0 ? 1 : 0;
+			vkCmdPipelineBarrier(target, barrier.srcStages != 0 ? barrier.srcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT), barrier.dstStages, 0,
+				memoryBarrierCount, &barrier.memory, 0, VK_NULL_HANDLE, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+		}
+
+		pass.record(target);
+	}
+}
+
+const VulkanImage& RenderGraph::GetImage(Handle resource) const
+{
+	assert(resources[resource].transient && resources[resource].image);
+	return *resources[resource].image;
+}
\ No newline at end of file
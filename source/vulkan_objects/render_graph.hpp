@@ -0,0 +1,126 @@
+#pragma once
+#include <glfw/glfw3.h>
+#include <vma/vk_mem_alloc.h>
+#include <functional>
+#include "scope.hpp"
+#include "structs.hpp"
+#include "image.hpp"
+
+/*
+* !@brief Passes of a frame in submission order. Each pass declares what it reads and writes,
+* Compile derives the barriers between passes, culls passes nobody consumes and places
+* transient images with disjoint lifetimes into the same memory. Async passes go to the compute
+* queue, hazards between the queues turn into semaphore waits instead of barriers
+*/
+class RenderGraph
+{
+public:
+	using Handle = uint32_t;
+
+	struct Access
+	{
+		Handle resource = 0;
+		VkPipelineStageFlags stages = 0;
+		VkAccessFlags access = 0;
+	};
+
+	struct Pass
+	{
+		Pass& Read(Handle resource, VkPipelineStageFlags stages, VkAccessFlags access = VK_ACCESS_SHADER_READ_BIT);
+
+		Pass& Write(Handle resource, VkPipelineStageFlags stages, VkAccessFlags access = VK_ACCESS_SHADER_WRITE_BIT);
+		/*
+		* !@brief Pass is recorded even if none of its writes are consumed
+		*/
+		Pass& KeepAlive();
+		/*
+		* !@brief Pass is recorded into the compute queue command buffer and overlaps graphics work.
+		* It may depend on graphics passes of previous frames only
+		*/
+		Pass& Async();
+
+		std::string name = "";
+		std::function<void(VkCommandBuffer)> record = {};
+		TVector<Access> reads = {};
+		TVector<Access> writes = {};
+		bool keepAlive = false;
+		bool async = false;
+	};
+
+	RenderGraph(const RenderScope& Scope);
+
+	RenderGraph(const RenderGraph& other) = delete;
+
+	void operator=(const RenderGraph& other) = delete;
+
+	~RenderGraph();
+	/*
+	* !@brief Resource owned outside of the graph and kept in its layout, it lives across frames
+	* so writes to it are never culled
+	*/
+	Handle ImportResource(const std::string& name);
+	/*
+	* !@brief Image owned by the graph and only valid between its first and last use in a frame,
+	* kept in VK_IMAGE_LAYOUT_GENERAL. Available through GetImage once compiled. Images used
+	* by async passes are valid for the whole frame
+	*/
+	Handle CreateImage(const std::string& name, const VkImageCreateInfo& imgInfo, const VkImageViewCreateInfo& viewInfo, ESamplerType sampler);
+
+	Pass& AddPass(const std::string& name, const std::function<void(VkCommandBuffer)>& record);
+
+	VkBool32 Compile();
+
+	/*
+	* !@brief Record compiled passes, async ones into asyncCmd. The async submission has to wait
+	* on the graphics submission of the previous frame at GetGraphicsWaitStages and the graphics
+	* submission on the async submission of the same frame at GetAsyncWaitStages
+	*/
+	void Execute(VkCommandBuffer cmd, VkCommandBuffer asyncCmd) const;
+
+	const VulkanImage& GetImage(Handle resource) const;
+
+	VkDeviceSize GetTransientMemorySize() const { return transientMemorySize; };
+
+	VkPipelineStageFlags GetAsyncWaitStages() const { return asyncWaitStages; };
+
+	VkPipelineStageFlags GetGraphicsWaitStages() const { return graphicsWaitStages; };
+
+private:
+	struct Resource
+	{
+		std::string name = "";
+		bool transient = false;
+		VkImageCreateInfo imgInfo = {};
+		VkImageViewCreateInfo viewInfo = {};
+		ESamplerType sampler = ESamplerType::LinearClamp;
+		TAuto<VulkanImage> image = VK_NULL_HANDLE;
+		// Imported resources get a slot of their own, transients share the slot of their memory block
+		uint32_t slot = 0;
+	};
+
+	struct Barrier
+	{
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+		VkMemoryBarrier memory = {};
+		// Transients entering memory last used by another resource discard the old contents
+		TVector<Handle> discards = {};
+	};
+
+	void place_transients(const TVector<uint32_t>& first, const TVector<uint32_t>& last);
+
+	void compute_barriers();
+
+	TVector<Resource> resources = {};
+	TVector<Pass> passes = {};
+	TVector<uint32_t> order = {};
+	TVector<Barrier> barriers = {};
+	TVector<VmaAllocation> memoryBlocks = {};
+	uint32_t slotCount = 0;
+	VkDeviceSize transientMemorySize = 0;
+	// Stages of graphics passes reading async results and of async passes reusing graphics resources
+	VkPipelineStageFlags asyncWaitStages = 0;
+	VkPipelineStageFlags graphicsWaitStages = 0;
+
+	const RenderScope* Scope = VK_NULL_HANDLE;
+};
\ No newline at end of file
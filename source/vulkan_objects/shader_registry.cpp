@@ -0,0 +1,65 @@
+#include "pch.hpp"
+#include "shader_registry.hpp"
+#include "vulkan_api.hpp"
+
+#include <filesystem>
+
+ShaderRegistry::ShaderRegistry(const VkDevice& inDevice, const std::string& directory)
+	: device(inDevice)
+{
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+	{
+		if (!entry.is_regular_file() || entry.path().extension() != ".spv")
+			continue;
+
+		std::ifstream shaderFile(entry.path(), std::ios::ate | std::ios::binary);
+		std::size_t fileSize = (std::size_t)shaderFile.tellg();
+		if (!shaderFile.is_open() || fileSize == 0 || fileSize % sizeof(uint32_t) != 0)
+			continue;
+
+		Shader& shader = shaders[entry.path().stem().string()];
+		shader.code.resize(fileSize / sizeof(uint32_t));
+		shaderFile.seekg(0);
+		shaderFile.read(reinterpret_cast<char*>(shader.code.data()), fileSize);
+		shader.hash = ::Fnv1a(FNV1A_OFFSET, shader.code.data(), fileSize);
+	}
+}
+
+ShaderRegistry::~ShaderRegistry()
+{
+	for (auto& [name, shader] : shaders)
+	{
+		if (shader.module != VK_NULL_HANDLE)
+			vkDestroyShaderModule(device, shader.module, VK_NULL_HANDLE);
+	}
+}
+
+VkShaderModule ShaderRegistry::GetModule(const std::string& name)
+{
+	auto found = shaders.find(name);
+	if (found == shaders.end())
+		return VK_NULL_HANDLE;
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	Shader& shader = found->second;
+	if (shader.module == VK_NULL_HANDLE)
+	{
+		VkShaderModuleCreateInfo shaderModuleCI{};
+		shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		shaderModuleCI.codeSize = shader.code.size() * sizeof(uint32_t);
+		shaderModuleCI.pCode = shader.code.data();
+		if (vkCreateShaderModule(device, &shaderModuleCI, VK_NULL_HANDLE, &shader.module) != VK_SUCCESS)
+			shader.module = VK_NULL_HANDLE;
+	}
+
+	return shader.module;
+}
+
+uint64_t ShaderRegistry::GetHash(const std::string& name) const
+{
+	auto found = shaders.find(name);
+
+	return found != shaders.end() ? found->second.hash : 0;
+}
\ No newline at end of file
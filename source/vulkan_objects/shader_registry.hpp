@@ -0,0 +1,47 @@
+#pragma once
+#include <glfw/glfw3.h>
+#include <vma/vk_mem_alloc.h>
+#include <unordered_map>
+#include <mutex>
+#include "math.hpp"
+
+/*
+* !@brief SPIR-V binaries of a shader directory, read once when the registry is created.
+* Shader modules are created on first use and kept alive until the registry is destroyed,
+* so pipelines sharing a shader share its module and constructing them does no file I/O.
+* Modules may be requested from several threads
+*/
+class ShaderRegistry
+{
+public:
+	ShaderRegistry(const VkDevice& device, const std::string& directory);
+
+	ShaderRegistry(const ShaderRegistry& other) = delete;
+
+	void operator=(const ShaderRegistry& other) = delete;
+
+	~ShaderRegistry();
+	/*
+	* !@brief Module of the shader, VK_NULL_HANDLE if there is no binary with this name or it fails to load
+	*/
+	VkShaderModule GetModule(const std::string& name);
+	/*
+	* !@brief Hash of the shader binary, 0 if there is no binary with this name
+	*/
+	uint64_t GetHash(const std::string& name) const;
+
+	uint32_t GetShaderCount() const { return (uint32_t)shaders.size(); };
+
+private:
+	struct Shader
+	{
+		TVector<uint32_t> code = {};
+		uint64_t hash = 0;
+		VkShaderModule module = VK_NULL_HANDLE;
+	};
+
+	std::unordered_map<std::string, Shader> shaders = {};
+	std::mutex lock;
+
+	const VkDevice device = VK_NULL_HANDLE;
+};
\ No newline at end of file
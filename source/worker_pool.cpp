@@ -0,0 +1,76 @@
+#include "pch.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+
+WorkerPool::WorkerPool(uint32_t threadCount)
+{
+	for (uint32_t i = 0; i < std::max(threadCount, 1u); i++)
+		threads.emplace_back(&WorkerPool::work, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+std::shared_future<void> WorkerPool::Submit(std::function<void()> job)
+{
+	std::packaged_task<void()> task(std::move(job));
+	std::shared_future<void> done = task.get_future().share();
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.push_back(std::move(task));
+	}
+	wake.notify_one();
+
+	return done;
+}
+
+void WorkerPool::Wait(const std::shared_future<void>& job)
+{
+	// A blocked worker could hold the very thread the job is queued for
+	const bool worker = std::any_of(threads.begin(), threads.end(), [](const std::thread& thread) { return thread.get_id() == std::this_thread::get_id(); });
+
+	while (worker && job.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+	{
+		std::packaged_task<void()> task;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (jobs.empty())
+				break;
+
+			task = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		task();
+	}
+
+	job.wait();
+}
+
+void WorkerPool::work()
+{
+	while (true)
+	{
+		std::packaged_task<void()> task;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this]() { return stopping || !jobs.empty(); });
+
+			if (jobs.empty())
+				return;
+
+			task = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		task();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include "math.hpp"
+
+/*
+* !@brief Fixed set of threads running jobs in submission order. Jobs waiting through Wait run
+* queued jobs meanwhile, so they may wait on jobs submitted after them as long as no queued job waits
+* on a running one. Queued jobs are finished before the pool is destroyed
+*/
+class WorkerPool
+{
+public:
+	WorkerPool(uint32_t threadCount);
+
+	WorkerPool(const WorkerPool& other) = delete;
+
+	void operator=(const WorkerPool& other) = delete;
+
+	~WorkerPool();
+	/*
+	* !@brief Queue job for the next free thread
+	*
+	* @return Future becoming ready once the job has run
+	*/
+	std::shared_future<void> Submit(std::function<void()> job);
+	/*
+	* !@brief Block until job has run, a worker thread runs queued jobs until then
+	*/
+	void Wait(const std::shared_future<void>& job);
+
+	uint32_t GetThreadCount() const { return (uint32_t)threads.size(); };
+
+private:
+	void work();
+
+	TVector<std::thread> threads = {};
+	std::deque<std::packaged_task<void()>> jobs = {};
+	std::mutex lock;
+	std::condition_variable wake;
+	bool stopping = false;
+};
\ No newline at end of file